@@ -22,18 +22,20 @@ Example code: ?command=3y
 First Byte: Controls Lights, Heater, Cooler, Fan, AutoTemp
 Second Byte: Temperature (Fahrenheit) -- limit to 60<x<90 
 
-status = 0xSTAT && 0x8000 //NO ALWAYS 0
-UPDATE: status = 0xSTAT && 0x0080;
+The bit layout is the "aux" layout in protocol/frames.schema (generated accessors are in
+protocol/shs_frames.h); its output bits match the system controller's state packet:
 
-light = 0xSTAT && 0x4000
-lightauto = 0xSTAT && 0x2000
-heat = 0xSTAT && 0x1000
-cold = 0xSTAT && 0x0800
+status = 0xSTAT && 0x0080
+
+lightauto = 0xSTAT && 0x4000
+light = 0xSTAT && 0x2000
+cold = 0xSTAT && 0x1000
+heat = 0xSTAT && 0x0800
 fan = 0xSTAT && 0x0400
 acauto = 0xSTAT && 0x0200
 device = 0xSTAT && 0x0100 
 
-temp = 0xSTAT && 0x00FF
+temp = 0xSTAT && 0x007F
 
 
 ?status=1   ---   Request the current status from the Atmel
@@ -86,6 +88,8 @@ The Atmel processes the data, adjusts settings, and then
 #include <avr/io.h>
 #include <util/delay.h>
 
+#include "protocol/shs_frames.h"
+
 
 void usart_init(unsigned short ubrr)
 {
@@ -129,73 +133,46 @@ int main(void) {
 	
 	unsigned short n;
 	
-	unsigned char io_char;
-	unsigned char io_temp;
+	uint8_t frame[AUX_SIZE];
 	
 	
     usart_init(MYUBRR);                 // Initialize the SCI port
     
     while (1) {               // Loop forever
     	
-    	io_char = usart_in();
-    	io_temp = usart_in();
+    	frame[0] = usart_in();
+    	frame[1] = usart_in();
     	
     	
     	unsigned short i = 0;
     	n = 0;
     	
-    	if ((io_char & 0x01) != 0x00) //coming from electric imp
+    	if (aux_device(frame)) //coming from electric imp
     	{
-    		if ((io_temp & 0x80) != 0x00) //STATUS set to request information
+    		if (aux_status_req(frame)) //STATUS set to request information
     		{
-    			io_char = 0x00;
-    			if (lightsOn > 0) {
-    				io_char |= 0x40;
-    			} if (lightsAuto > 0) {
-    				io_char |= 0x20;
-    			} if (coolerOn > 0) {
-    				io_char |= 0x10;
-    			} if (heaterOn > 0) {
-    				io_char |= 0x08;
-    			} if (fanOn > 0) {
-    				io_char |= 0x04;
-    			} if (acAutoModeOn > 0) {
-    				io_char |= 0x02;
-    			}
-    			io_char |= 0x01; //Sending to Imp
+    			frame[0] = frame[1] = 0;
+    			aux_set_lights(frame, lightsOn > 0);
+    			aux_set_lights_auto(frame, lightsAuto > 0);
+    			aux_set_cooler(frame, coolerOn > 0);
+    			aux_set_heater(frame, heaterOn > 0);
+    			aux_set_fan(frame, fanOn > 0);
+    			aux_set_ac_auto(frame, acAutoModeOn > 0);
+    			aux_set_device(frame, 1); //Sending to Imp
     			
-    			io_temp = temp;
+    			aux_set_tempr(frame, temp);
     			
-    			usart_out(io_char);
-    			usart_out(io_temp);
+    			usart_out(frame[0]);
+    			usart_out(frame[1]);
     		}
     		else {
     			
-    			if (io_char & 0x40) {
-    				lightsOn = 1;
-    			} else {
-    				lightsOn=0;
-    			} if (io_char & 0x20) {
-    				lightsAuto = 1;
-    			}  else {
-    				lightsAuto=0;
-    			} if (io_char & 0x10) {
-    				coolerOn = 1;
-    			}  else {
-    				coolerOn=0;
-    			} if (io_char & 0x08) {
-    				heaterOn = 1;
-    			}  else {
-    				heaterOn=0;
-    			} if (io_char & 0x04) {
-    				fanOn = 1;
-    			}  else {
-    				fanOn=0;
-    			} if (io_char & 0x02) {
-    				acAutoModeOn = 1;
-    			}  else {
-    				acAutoModeOn=0;
-    			}
+    			lightsOn = aux_lights(frame);
+    			lightsAuto = aux_lights_auto(frame);
+    			coolerOn = aux_cooler(frame);
+    			heaterOn = aux_heater(frame);
+    			fanOn = aux_fan(frame);
+    			acAutoModeOn = aux_ac_auto(frame);
     			
     		}
     	}
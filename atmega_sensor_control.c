@@ -0,0 +1,279 @@
+/*************************************************************
+ *       atmega_sensor_control.c - Embedded software for the XBee sensor node. Samples room
+ *       temperature and humidity on a timer, keeps the samples in a small buffer, and answers
+ *       polls from the system controller with every sample it has not yet acknowledged.
+ *
+ *       PORTC, bit 0 (ADC0) - Analog input from the temperature sensor (10 mV per degree F)
+ *              bit 1 (ADC1) - Analog input from the humidity sensor (HIH-4000 type)
+ *       USART0 - XBee radio, 9600 baud
+ *
+ *       Frames to this node:
+ *           0xE4 <node> <ack>          Poll; <ack> is the last sequence number received
+ *           0xD4 <p0> <p1> <p2>        Current state packet from the controller
+ *       Frames from this node:
+ *           0xE5 <node> <count> <seq> then <count> pairs of <temp> <humid>
+ *                                      <seq> is the sequence number of the first pair
+ *
+ *       Sequence numbers, readings and counts are 7 bits so no reply byte after the header
+ *       reads as 0xFF, which the controller uses for a timeout. Exact layouts are in
+ *       protocol/frames.schema.
+ *
+ *************************************************************/
+
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "protocol/shs_frames.h"
+
+// Pre-declare C functions
+
+void sample_push(uint8_t, uint8_t);
+void sample_ack(uint8_t);
+void reply_send();
+
+void timer_init();
+void adc_init();
+
+// Serial I/O configuration
+void usart_init(unsigned short ubrr);
+void usart_out(char ch);
+
+// ---------- DEFINES ----------
+
+#define FOSC            9830400         // Clock frequency
+#define BAUD            9600            // Baud rate used by the XBee
+#define MYUBRR          FOSC/16/BAUD-1  // Value for UBRR0 register
+
+// Define EEPROM locations
+#define NODE_ID         0x00            // This node's address on the sensor network
+
+// Frame headers and layouts (XBEE_*, sample_*) are in protocol/shs_frames.h
+
+// Define sampling
+#define SAMPLE_PERIOD   10              // Seconds between samples
+#define SAMPLE_BUF      16              // Samples held until acknowledged (power of two)
+#define SEQ_MASK        0x7F
+
+#define ADC_TEMPR       0               // ADC channel of the temperature sensor
+#define ADC_HUMID       1               // ADC channel of the humidity sensor
+
+// ---------- GLOBALS ----------
+
+uint8_t node = 0;
+
+// Sample ring buffer. The newest sample has sequence number (next_seq - 1).
+uint8_t sample_buf[SAMPLE_BUF][SAMPLE_SIZE];
+volatile uint8_t next_seq = 0;     // Sequence number of the next sample taken
+volatile uint8_t held = 0;         // Samples in the buffer not yet acknowledged
+
+volatile uint8_t seconds = 0;
+volatile uint16_t tempr_adc = 0;
+
+volatile bool poll_pending = false;
+volatile uint8_t poll_ack = SEQ_MASK;
+
+uint8_t state[STATE_SIZE];         // Last state packet from the controller
+
+int main(void) {
+    uint8_t one = 1;
+
+    node = eeprom_read_byte((uint8_t *) NODE_ID);
+    if (node == 0xFF) node = 0;
+
+    usart_init(MYUBRR);
+    adc_init();
+    timer_init();
+    sei();
+
+    while (one) {
+        if (poll_pending) {
+            cli();
+            uint8_t ack = poll_ack;
+            poll_pending = false;
+            sei();
+
+            sample_ack(ack);
+            reply_send();
+        }
+
+        // Sampling and the radio are interrupt driven, so sleep until one of them needs us.
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        cli();
+        if (!poll_pending) {
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+    }
+    return 0;                             // Should never be reached in embedded system!
+}
+
+/*
+ sample_push - Store a sample in the ring buffer, dropping the oldest if the buffer is full.
+ Called from the ADC interrupt.
+ */
+void sample_push(uint8_t tempr, uint8_t humid)
+{
+    uint8_t i = next_seq & (SAMPLE_BUF - 1);
+    sample_set_tempr(sample_buf[i], tempr);
+    sample_set_humid(sample_buf[i], humid);
+    next_seq = (next_seq + 1) & SEQ_MASK;
+    if (held < SAMPLE_BUF) held++;
+}
+
+/*
+ sample_ack - Drop every sample up to and including sequence number "ack".
+ */
+void sample_ack(uint8_t ack)
+{
+    cli();
+    uint8_t newer = (next_seq - ack - 1) & SEQ_MASK;    // Samples taken after "ack"
+    if (newer < held) held = newer;
+    sei();
+}
+
+/*
+ reply_send - Send every unacknowledged sample in one batch, oldest first. The samples are
+ copied with interrupts off: a sample taken while the batch is going out would overwrite the
+ oldest one when the ring is full.
+ */
+void reply_send()
+{
+    uint8_t batch[SAMPLE_BUF][SAMPLE_SIZE];
+
+    cli();
+    uint8_t count = held;
+    uint8_t seq = (next_seq - count) & SEQ_MASK;
+    for (uint8_t n = 0; n < count; n++) {
+        memcpy(batch[n], sample_buf[(seq + n) & (SAMPLE_BUF - 1)], SAMPLE_SIZE);
+    }
+    sei();
+
+    usart_out(XBEE_BATCH);
+    usart_out(node);
+    usart_out(count);
+    usart_out(seq);
+    for (uint8_t n = 0; n < count; n++) {
+        for (uint8_t b = 0; b < SAMPLE_SIZE; b++) usart_out(batch[n][b]);
+    }
+}
+
+// ---------- SAMPLING ----------
+
+/*
+ timer_init - Start timer 1 in CTC mode to interrupt once per second.
+ */
+void timer_init()
+{
+    OCR1A  = FOSC/1024-1;
+    TCCR1A = 0;
+    TCCR1B = (1 << WGM12) | (1 << CS12) | (1 << CS10);  // CTC, clk/1024
+    TIMSK1 = (1 << OCIE1A);
+}
+
+/*
+ adc_init - Enable the ADC with an AVcc reference and interrupts, clocked at FOSC/128.
+ */
+void adc_init()
+{
+    ADMUX  = (1 << REFS0) | ADC_TEMPR;
+    ADCSRA = (1 << ADEN) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+}
+
+/*
+ Timer 1 compare interrupt - Start a temperature conversion every SAMPLE_PERIOD seconds.
+ */
+ISR(TIMER1_COMPA_vect)
+{
+    if (++seconds < SAMPLE_PERIOD) return;
+    seconds = 0;
+
+    ADMUX = (1 << REFS0) | ADC_TEMPR;
+    ADCSRA |= (1 << ADSC);
+}
+
+/*
+ ADC conversion complete interrupt - The temperature conversion chains into the humidity
+ conversion, and the pair is stored as one sample.
+ */
+ISR(ADC_vect)
+{
+    uint16_t value = ADC;
+
+    if ((ADMUX & 0x0F) == ADC_TEMPR) {
+        tempr_adc = value;
+        ADMUX = (1 << REFS0) | ADC_HUMID;
+        ADCSRA |= (1 << ADSC);
+        return;
+    }
+
+    // 10 mV per degree F against a 5 V reference: F = ADC * 500 / 1024
+    uint16_t tempr = ((uint32_t) tempr_adc * 500) >> 10;
+
+    // HIH-4000: Vout/Vs = 0.0062 * RH + 0.16, so RH = (ADC - 164) / 6.35
+    int16_t humid = ((int16_t) value - 164) * 20 / 127;
+    if (humid < 0) humid = 0;
+    if (humid > 100) humid = 100;
+
+    sample_push((tempr > SEQ_MASK) ? SEQ_MASK : tempr, humid);
+}
+
+// ---------- SERIAL I/O CONFIGURATION ----------
+
+void usart_init(unsigned short ubrr)
+{
+	UBRR0 = ubrr;
+	UCSR0B |= (1 << TXEN0);
+	UCSR0B |= (1 << RXEN0);
+	UCSR0B |= (1 << RXCIE0);
+	UCSR0C = (3 << UCSZ00);
+}
+
+void usart_out(char ch)
+{
+	while ((UCSR0A & (1 << UDRE0)) == 0);
+	UDR0 = ch;
+}
+
+/*
+ USART receive interrupt - Frame polls addressed to this node. State packets are kept for
+ reference; everything else is skipped.
+ */
+ISR(USART_RX_vect)
+{
+	static uint8_t hdr = 0;     // Header of the frame being received, 0 if none
+	static uint8_t pos = 0;     // Bytes received after the header
+	static uint8_t poll_node = 0;
+	uint8_t ch = UDR0;
+
+	if (hdr == 0) {
+		if (ch == XBEE_POLL || ch == XBEE_STATE) {
+			hdr = ch;
+			pos = 0;
+		}
+		return;
+	}
+
+	if (hdr == XBEE_POLL) {
+		if (pos++ == 0) {
+			poll_node = ch;
+			return;
+		}
+		if (poll_node == node) {
+			poll_ack = ch & SEQ_MASK;
+			poll_pending = true;
+		}
+		hdr = 0;
+	} else {
+		state[pos++] = ch;
+		if (pos == XBEE_STATE_LEN) hdr = 0;
+	}
+}
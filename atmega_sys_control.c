@@ -20,17 +20,76 @@
 #include <avr/eeprom.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
 #include <util/delay.h>
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "protocol/shs_frames.h"
+
 // Pre-declare C functions
 
+// Main loop
+void sys_init();
+void sys_task();
+void sys_idle();
+void imp_poll();
+void xbee_poll();
+void xbee_send_state();
+void imp_send_sensors();
+void xbee_pace(uint8_t);
+bool sensor_sample(uint8_t, const uint8_t *);
+void telemetry_send();
+#ifdef __AVR__
+void stack_paint(void) __attribute__((naked, used, section(".init1")));
+#endif
+uint16_t stack_free();
+bool cmd_seen(uint8_t);
+void cmd_ack(uint8_t);
+
+// Zones and thermostat
+void zone_load();
+void zone_store(uint8_t, uint8_t);
+void hvac_update();
+void sensor_average();
+void sensor_drop(uint8_t);
+void sensor_age();
+bool sensor_hold();
+uint8_t sensor_status();
+
 void var_config();
 void packet_config();
+void packet_apply(uint8_t *);
+
+// Scene storage
+bool scene_apply(uint8_t);
+bool scene_valid(const uint8_t *);
+void scene_store(uint8_t, uint8_t *);
+
+// Settings image
+void settings_check(const uint8_t *, uint8_t, uint8_t *);
+void settings_send();
+bool settings_load(const uint8_t *);
+
+// Rule engine
+void rules_eval();
+bool rule_valid(const uint8_t *);
+void rule_store(uint8_t, uint8_t *);
+void timer_init();
+
+// Watchdog and reset record
+#ifdef __AVR__
+void reset_capture(void) __attribute__((naked, used, section(".init3")));
+#endif
+void reset_log();
+void wdt_init();
+void wdt_checkin(uint8_t);
 
 // Clock settings/timing
 void clk();
@@ -45,16 +104,22 @@ void btn_db_mod();
 uint8_t btn_db_val();
 
 // LCD configuration
-void initialize(void);
+bool initialize(void);
 void strout(int, unsigned char *);
-void cmdout(unsigned char, unsigned char);
+void lcd_fmt(char *, PGM_P, ...);
+bool cmdout(unsigned char, unsigned char);
 void datout(unsigned char);
-void busywt(void);
+bool busywt(void);
+void lcd_fault(void);
 
 
 // Serial I/O configuration
 void usart_init(unsigned short ubrr);
 unsigned char usart_in_xbee(void);
+uint8_t usart_block_xbee(uint8_t *, uint8_t);
+uint8_t usart_block_imp(uint8_t *, uint8_t);
+void usart_xbee_begin(void);
+void usart_xbee_end(void);
 void usart_out_xbee(char ch);
 unsigned char usart_in_imp(void);
 void usart_out_imp(char ch);
@@ -85,6 +150,110 @@ void usart_out_imp(char ch);
 #define PACKET1         0x27
 #define PACKET2         0x28
 
+// Frame headers and bit layouts (IMP_*, XBEE_*, state_*, ...) are in protocol/shs_frames.h,
+// generated from protocol/frames.schema.
+
+#define SENSOR_NODES    4               // Sensor node addresses 0 to SENSOR_NODES-1
+#define SENSOR_BATCH    16              // Most samples a node holds (and replies with)
+#define SENSOR_POLL     (2*TICK_HZ)     // Ticks between sensor polls (one node per poll) at
+                                        // start-up, and at most while the HVAC is calling
+#define SENSOR_FAST     (TICK_HZ)       // Shortest poll interval, while readings are moving
+#define SENSOR_SLOW     (12*TICK_HZ)    // Longest, while readings are stable; a node must be
+                                        // polled before its SAMPLE_BUF samples overflow
+#define SENSOR_STALE    120             // Seconds without a sample before a node is stale: two
+                                        // rounds of SENSOR_SLOW polls of every node, and more
+#define SENSOR_DEAD     240             // Seconds before its reading leaves the averages (< 256)
+
+#define CMD_WINDOW      8               // Recent command IDs remembered to drop repeats
+
+#define IMP_RX_SIZE     128             // Imp receive ring (a power of two): a settings restore
+#define IMP_RX_WAIT     60              // 100 us waits for the next byte of a frame, about six
+                                        // character times
+
+#define STACK_PAINT     0xC5            // Fill for SRAM the stack has not reached yet
+
+// Watchdog check-ins. Each task sets its bit as it completes and the watchdog is only reset once
+// all of them have, so one that hangs or stops running resets the controller. Main loop tasks
+// are in pass order, so after a stall the lowest bit still clear is the task that stalled.
+#define TASK_UI         0x01            // Buttons and display
+#define TASK_IMP        0x02            // Imp frames
+#define TASK_XBEE       0x04            // Sensor polling
+#define TASK_TICK       0x08            // Timer 1 interrupt
+#define TASK_ALL        (TASK_UI|TASK_IMP|TASK_XBEE|TASK_TICK)
+#define WDT_TIMEOUT     WDTO_2S         // The interrupt notes the stalled tasks after one
+                                        // timeout, and the reset follows one timeout later
+
+// Define EEPROM locations for the record of the last reset, kept across reboots
+#define RESET_LOG       0x6C            // Reason (RESET_*), info, then the count of resets
+#define RESET_POWER     0               //   other than power on and the reset pin
+#define RESET_EXTERNAL  1
+#define RESET_BROWNOUT  2
+#define RESET_WATCHDOG  3               // Info: tasks that had not checked in
+#define RESET_CORRUPT   4               // Info: EEPROM cell that held corrupt data
+
+// Default settings, written to erased EEPROM and over a corrupt cell
+#define TEMPR_DEFAULT   0x75            // 75 F, in BCD
+#define HUMID_DEFAULT   0x40            // 40%, in BCD
+
+// xbee_pace() outcomes of one poll
+#define POLL_MOVED      0       // A reading changed
+#define POLL_STEADY     1       // Samples arrived but none changed, or there were none yet
+#define POLL_LOST       2       // No complete reply
+
+// Define EEPROM locations for the zone map, one zone_map byte per sensor node
+#define ZONE_MAP        0x68
+#define ZONE_COUNT      4
+
+// The settings image is every settings cell, from TEMPR_0 to the end of the zone map
+#define SETTINGS_BASE   TEMPR_0
+#define SETTINGS_SIZE   (ZONE_MAP + SENSOR_NODES - SETTINGS_BASE)
+
+// Define thermostat behaviour, in degrees F of demand (set temperature minus measured)
+#define HVAC_HYST       1       // Mean demand that starts a call; a call ends at zero demand
+#define HVAC_SPREAD     3       // No call may push any zone further than this past its set point
+
+// Define HVAC call bits, sent in the first packet byte but never stored
+#define CALL_HEAT       STATE_CALL_HEAT_MASK
+#define CALL_COOL       STATE_CALL_COOL_MASK
+#define CALL_BITS       (CALL_HEAT|CALL_COOL)
+
+// Define dirty flags: inputs set these and the main loop recomputes only what they name
+#define DIRTY_PACKET    0x01    // Settings cells changed: rebuild control variables and packet
+#define DIRTY_LCD       0x02    // Display text must be regenerated and written
+#define DIRTY_EDIT      0x04    // Editor must re-read the settings cells for the current mode
+#define DIRTY_HVAC      0x08    // Zone readings or thermostat settings changed
+
+// Define EEPROM locations for stored scenes (SCENE_COUNT slots of one packet each)
+#define SCENE_BASE      0x30
+#define SCENE_COUNT     8
+#define SCENE_SIZE      STATE_SIZE
+
+// Define EEPROM locations for automation rules (RULE_COUNT slots of RULE_SIZE bytes)
+#define RULE_BASE       0x48
+#define RULE_COUNT      8
+
+// Rule fields (src, cmp, operand, action, arg) follow the rule layout in shs_frames.h
+#define RULE_SRC_TEMP   0       // temp_sen, degrees F
+#define RULE_SRC_HUMID  1       // humid_sen, percent
+#define RULE_SRC_TIME   2       // Time of day in units of 10 minutes (0-143)
+#define RULE_SRC_STATE  3       // First packet byte (output states)
+#define RULE_SRC_NONE   7       // Empty slot (erased EEPROM)
+
+#define RULE_CMP_LT     0
+#define RULE_CMP_GT     1
+#define RULE_CMP_EQ     2
+#define RULE_CMP_BITS   3       // All operand bits set in input
+
+#define RULE_ACT_MODE   0       // Temperature mode: 0 auto, 1 fan, 2 heat, 3 cold
+#define RULE_ACT_TEMPR  1       // Set temperature, degrees F
+#define RULE_ACT_HUMID  2       // Humidifier: 0 off, 1 on
+#define RULE_ACT_LIGHT  3       // Lighting: 0 auto, 1 off, 2 on
+#define RULE_ACT_SCENE  4       // Apply stored scene
+
+// Timer 1 compare value for a TICK_HZ tick with a 1024 prescaler
+#define TICK_HZ         20
+#define TICK_OCR        (FOSC/1024/TICK_HZ-1)
+
 // Define bits for LCD initialisation
 #define LCD_RS          0x10
 #define LCD_RW          0x08
@@ -97,15 +266,30 @@ void usart_out_imp(char ch);
 #define WAIT            1
 #define NOWAIT          0
 
+#define LCD_COLS        24      // Characters per display line
+#define LCD_BUSY_POLLS  2000    // Busy flag reads, 1 us or more apart, before the display is taken
+                                // to have failed; its slowest instruction takes 1.52 ms
+#define LCD_RETRY       (10*TICK_HZ)    // Ticks between attempts to bring a failed display back
+
 // ---------- GLOBALS ----------
 
 // Define global variables (embedded system...)
-char str_0[24];
-char str_1[24];
+char str_0[LCD_COLS + 1];
+char str_1[LCD_COLS + 1];
+
+// Display text lives in flash; lcd_fmt() formats it with %S for the names below.
+const char blank_name[] PROGMEM = "    ";      // A field being edited, on the blink
+const char mode_names[4][5] PROGMEM = { "Auto", " Fan", " Hot", "Cold" };
+const char hum_names[2][4] PROGMEM = { "Off", " On" };
+const char light_names[3][5] PROGMEM = { "Auto", " Off", " On " };
 
 volatile uint8_t current = 0;   // Currently selected mode
 volatile uint8_t editing = 0;   // Whether or not user is editing stored data
 volatile uint8_t changed = 0;   // Whether the user edited anything
+volatile uint8_t dirty   = 0;   // Derived outputs that need recomputation (DIRTY_*)
+
+bool lcd_offline = false;           // The display stopped answering; text is not sent until it is back
+volatile uint8_t lcd_wait = 0;      // Ticks until the next attempt to bring it back
 
 uint8_t counter   = TCLCL;
 uint8_t pos_level = 0;
@@ -126,18 +310,106 @@ unsigned char humid_sen = 0;
 bool lights       = false;
 bool lights_auto  = false;
 
+// Time of day, kept by the timer 1 interrupt and set by the Imp
+volatile uint8_t  clock_tick = 0;
+volatile uint8_t  clock_sec = 0;
+volatile uint16_t clock_min = 0;
+
+volatile uint8_t rule_inputs = 0;   // Rule sources that changed since the last evaluation
+uint8_t rule_active = 0;            // Rules whose condition held at the last evaluation
+uint8_t state_bools = 0;            // Last first packet byte seen by the rule engine
+
+volatile uint8_t sensor_wait = 0;   // Ticks until the next sensor poll
+uint8_t sensor_interval = SENSOR_POLL;  // Ticks between sensor polls, adapted by xbee_pace()
+uint8_t sensor_ack[SENSOR_NODES];   // Sequence number of the last sample from each node
+uint8_t sensor_next = 0;            // Node to poll next
+
+// Zone model. Sums are of weight times reading, kept up to date as each sample arrives.
+uint8_t  node_zone[SENSOR_NODES];
+uint8_t  node_weight[SENSOR_NODES];
+uint8_t  node_temp[SENSOR_NODES];
+uint8_t  node_humid[SENSOR_NODES];
+uint8_t  node_valid = 0;            // Nodes that have reported since the zone map was loaded
+uint16_t zone_tsum[ZONE_COUNT];
+uint8_t  zone_wsum[ZONE_COUNT];
+uint16_t home_tsum = 0;
+uint16_t home_hsum = 0;
+uint8_t  home_wsum = 0;
+
+// Sensor freshness. Timestamps are in seconds of sensor_sec, which wraps, so ages are only
+// compared until a node's reading is dropped.
+volatile uint8_t sensor_sec = 0;    // Seconds, counted by the timer 1 interrupt
+uint8_t sensor_check = 0;           // sensor_sec at the last freshness check
+uint8_t node_seen[SENSOR_NODES];    // sensor_sec at each node's last sample
+uint8_t node_stale = 0;             // Installed nodes with no sample for SENSOR_STALE seconds
+uint8_t sensor_flags = 0;           // Sensor status last sent to the Imp
+
+uint8_t hvac_call = 0;              // CALL_HEAT, CALL_COOL or 0
+
+// Telemetry counters, reported to the Imp by telemetry_send(). They wrap.
+uint16_t tm_polls = 0;
+uint16_t tm_samples = 0;
+uint16_t tm_timeouts = 0;
+uint32_t tm_spin = 0;               // Spin loop passes spent waiting for XBee replies
+uint8_t  tm_dups = 0;
+uint8_t  tm_lcd_faults = 0;         // Times the display went offline
+
+#ifdef __AVR__
+// Ends of free SRAM, from the linker: the stack grows down from __stack towards _end.
+extern uint8_t _end;
+extern uint8_t __stack;
+#endif
+
+volatile uint8_t wdt_tasks = 0;     // Tasks checked in since the watchdog was last reset
+
+// Bytes from the Imp, stored by the receive interrupt while the mux selects the Imp
+volatile uint8_t imp_rx[IMP_RX_SIZE];
+volatile uint8_t imp_rx_head = 0;   // Next slot the interrupt fills
+volatile uint8_t imp_rx_tail = 0;   // Next byte usart_block_imp() takes
+
+// What the firmware knows about the reset to come, kept through it in uninitialised SRAM. Host
+// builds have no reset to keep it through.
+#ifdef __AVR__
+#define NOINIT __attribute__((section(".noinit")))
+#else
+#define NOINIT
+#endif
+uint8_t reset_flags NOINIT;         // MCUSR, saved by reset_capture()
+uint8_t reset_cause NOINIT;         // RESET_WATCHDOG or RESET_CORRUPT, for a watchdog reset
+uint8_t reset_info NOINIT;
+
+uint8_t cmd_recent[CMD_WINDOW];     // Last CMD_WINDOW command IDs applied, 0 for none
+uint8_t cmd_next = 0;               // Slot in cmd_recent for the next ID
+
+uint8_t packet[3];      // Copy of the PACKET cells, valid while DIRTY_PACKET is clear
+uint8_t * edit_addr;    // Settings cells for the current mode
+uint8_t edit_data[2];   // Working copy of the cells being edited
+
 int main(void) {
     uint8_t one = 1;      // Warning solved on 04/22/08
+    
+    sys_init();
+    while (one) {
+        sys_task();
+        sys_idle();
+    }
+    return 0;                             // Should never be reached in embedded system!
+}
+
+/*
+ sys_init - Set up the ports, serial I/O, LCD, EEPROM defaults, and the tick timer.
+ */
+void sys_init()
+{
     // The variable "current" may have any one of three values:
     //     00 - Current mode is temperature mode
     //     01 - Current mode is humidity mode
     //     10 - Current mode is lighting mode
     //     11 - Illegal combination
     
-    unsigned char tempDataByte = 0;
-    unsigned char io_char = 0;
-    unsigned char temp_char = 0;
-    unsigned char humid_char = 0;
+    // Record why the controller reset, then supervise everything after, the display included.
+    reset_log();
+    wdt_init();
     
     // Initialise string buffers to null terminators.
     str_0[0] = '\0';
@@ -157,9 +429,9 @@ int main(void) {
     // Initialise EEPROM data to be all zeroes except temperature and humidity.
     // Initialise default temperature to 75 F and default humidity to 40%.
     if (eeprom_read_byte((uint8_t *) TEMPR_0) == 0xFF) {
-        eeprom_write_byte((uint8_t *) TEMPR_0, 117);
+        eeprom_write_byte((uint8_t *) TEMPR_0, TEMPR_DEFAULT);
         eeprom_write_byte((uint8_t *) TEMPR_1, 0);
-        eeprom_write_byte((uint8_t *) HUMID_0, 64);
+        eeprom_write_byte((uint8_t *) HUMID_0, HUMID_DEFAULT);
         eeprom_write_byte((uint8_t *) HUMID_1, 0);
         eeprom_write_byte((uint8_t *) LIGHT_0, 0);
         eeprom_write_byte((uint8_t *) LIGHT_1, 0);
@@ -168,133 +440,526 @@ int main(void) {
         eeprom_write_byte((uint8_t *) PACKET2, 0);
     }
     
-    uint8_t current_loop = current;
-    while (one) {                         // Outer loop is for switching modes and reading memory.
-    	
-        uint8_t * addr = (current == 2) ? (uint8_t *) LIGHT_0 :
+    zone_load();
+    
+    // Start the tick timer and evaluate every rule once against the initial state.
+    timer_init();
+    rule_inputs = 0xFF;
+    
+    // Everything derived from the stored settings must be computed once.
+    dirty = DIRTY_PACKET | DIRTY_LCD | DIRTY_EDIT | DIRTY_HVAC;
+}
+
+/*
+ sys_task - One pass of the main loop. Inputs (buttons, radio, sensors, timer) set dirty flags,
+ and only the outputs they flag are recomputed, so an idle pass only polls the serial lines.
+ */
+void sys_task()
+{
+    uint8_t mode = current;
+    uint8_t edit = editing;
+    
+    btn_db_mod();
+    if (current != mode) dirty |= DIRTY_EDIT | DIRTY_LCD;
+    if (editing != edit) dirty |= DIRTY_LCD;
+    
+    if (!editing && changed) {
+        // If the user has stopped editing and has changed some values, update EEPROM.
+        eeprom_update_byte(edit_addr, edit_data[0]);
+        eeprom_update_byte(edit_addr+1, edit_data[1]);
+        changed = 0;
+        dirty |= DIRTY_PACKET;
+    }
+    
+    if (dirty & DIRTY_EDIT) {
+        // Mode changed or settings were replaced from the Imp: re-read the cells being edited.
+        dirty &= ~DIRTY_EDIT;
+        edit_addr = (current == 2) ? (uint8_t *) LIGHT_0 :
         (current == 1) ? (uint8_t *) HUMID_0 : (uint8_t *) TEMPR_0;
-        uint8_t data_0 = eeprom_read_byte(addr);
-        uint8_t data_1 = eeprom_read_byte(addr+1);
-        uint8_t local_data_0 = data_0;
-        uint8_t local_data_1 = data_1;
-        while (one) {                       // Inner loop is for editing values.
-        	
-            btn_db_mod();
-            if (!editing && changed) {
-                // If the user has stopped editing and has changed some values, update EEPROM.
-                eeprom_update_byte(addr, local_data_0);
-                eeprom_update_byte(addr+1, local_data_1);
-            }
-            if (current_loop != current) {
-                // If the user has changed the current selection, change the LCD to reflect new selection.
-                current_loop = current;
-                break;
-            }
-            switch (current) {
-                case 0: tempr_config(&local_data_0, &local_data_1); break;
-                case 1: humid_config(&local_data_0, &local_data_1); break;
-                case 2: light_config(&local_data_0, &local_data_1); break;
-                default: break;
-            }
-            strout(0x00, (unsigned char *) str_0); // Print first line of text to LCD.
-            strout(0x40, (unsigned char *) str_1); // Print second line of text to LCD.
-            
-            // Run the internal clock.
-            clk();
-            
-            
-            
-            packet_config();
-            io_char = eeprom_read_byte((uint8_t *) PACKET0);
-			temp_char = eeprom_read_byte((uint8_t *) PACKET1);
-			humid_char = eeprom_read_byte((uint8_t *) PACKET2);
-            
-            
-            UCSR0B &= ~(1 << RXEN0);
-            _delay_ms(5);
-            UCSR0B |= (1 << RXEN0);
-            _delay_ms(5);
-            
-            tempDataByte = usart_in_imp();
-            if (tempDataByte == 0xA9) {
-            	tempDataByte = usart_in_imp();
-            if (tempDataByte == 0x65) {
-            	tempDataByte = usart_in_imp();
-            	
-            if (tempDataByte != 0xFF) {
-            	io_char = tempDataByte;
-            	tempDataByte = usart_in_imp();
-            		if (tempDataByte != 0xFF) {
-            			temp_char = tempDataByte;
-            			tempDataByte = usart_in_imp();
-            				if (tempDataByte != 0xFF) {
-            					humid_char = tempDataByte;
-            					
-            					//At this point we have presumably valid data
-            					//check if it is a status request or not
-            					
-            					if ((temp_char & 0x80) != 0x00) {
-            						//send data to imp
-            						packet_config(); //Make sure data is current
-            						usart_out_imp(eeprom_read_byte((uint8_t *) PACKET0)); 
-            						usart_out_imp(eeprom_read_byte((uint8_t *) PACKET1)); 
-            						usart_out_imp(eeprom_read_byte((uint8_t *) PACKET2)); 
-            					}
-            					
-            					else {
-            						//update our data and send to xbee
-            						eeprom_update_byte(((uint8_t *) PACKET0), io_char);
-            						eeprom_update_byte(((uint8_t *) PACKET1), temp_char);
-            						eeprom_update_byte(((uint8_t *) PACKET2), humid_char);
-            						
-            						//TODO: reverse packet config method - given packets in memory, modify the control variables appropriately
-            						var_config();
-            						
-            						usart_out_xbee(io_char);
-            						usart_out_xbee(temp_char);
-            						usart_out_xbee(humid_char);
-            					}
-            				}
-           			}
+        edit_data[0] = eeprom_read_byte(edit_addr);
+        edit_data[1] = eeprom_read_byte(edit_addr+1);
+    }
+    
+    // Value buttons are read by the renderers, so a press while editing is a display input.
+    if (editing && (PINC & (BTN_2 | BTN_3))) dirty |= DIRTY_LCD;
+    
+    // Run the internal clock; the edited field blinks with it.
+    uint8_t level = pos_level;
+    clk();
+    if (editing && level != pos_level) dirty |= DIRTY_LCD;
+    
+    // Age the readings; a node going stale changes what the thermostat may do.
+    sensor_age();
+    
+    if (dirty & DIRTY_PACKET) {
+        dirty &= ~DIRTY_PACKET;
+        packet_config();
+    }
+    
+    if (dirty & DIRTY_HVAC) {
+        dirty &= ~DIRTY_HVAC;
+        uint8_t call = hvac_call;
+        hvac_update();
+        if (call != hvac_call) xbee_send_state();
+        else if (sensor_status() != sensor_flags) imp_send_sensors();
+        if (hvac_call && sensor_interval > SENSOR_POLL) {
+            // A call just started: stop any backed-off wait from delaying the reading that ends it.
+            sensor_interval = SENSOR_POLL;
+            if (sensor_wait > SENSOR_POLL) sensor_wait = SENSOR_POLL;
+        }
+    }
+    
+    if (dirty & DIRTY_LCD) {
+        dirty &= ~DIRTY_LCD;
+        switch (current) {
+            case 0: tempr_config(&edit_data[0], &edit_data[1]); break;
+            case 1: humid_config(&edit_data[0], &edit_data[1]); break;
+            case 2: light_config(&edit_data[0], &edit_data[1]); break;
+            default: break;
+        }
+        strout(0x00, (unsigned char *) str_0); // Print first line of text to LCD.
+        strout(0x40, (unsigned char *) str_1); // Print second line of text to LCD.
+    }
+    if (lcd_offline && !lcd_wait && initialize()) {
+        // The display answers again: back online, redrawn in full.
+        lcd_offline = false;
+        dirty |= DIRTY_LCD;
+    }
+    wdt_checkin(TASK_UI);
+    
+    imp_poll();
+    wdt_checkin(TASK_IMP);
+    xbee_poll();
+    wdt_checkin(TASK_XBEE);
+    
+    // Run any automation whose inputs changed.
+    if (rule_inputs) rules_eval();
+}
+
+/*
+ sys_idle - Sleep until the next interrupt (the timer tick at the latest) unless work is pending.
+ */
+void sys_idle()
+{
+    cli();
+    if (dirty || rule_inputs) {
+        sei();
+        return;
+    }
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei();              // The instruction after sei() always runs, so no tick can be missed.
+    sleep_cpu();
+    sleep_disable();
+}
+
+/*
+ imp_poll - Act on a frame from the Imp, if one has started to arrive.
+ */
+void imp_poll()
+{
+    unsigned char tempDataByte = 0;
+    uint8_t hdr[IMP_COMMAND_ID_LEN + 2];
+    
+    // The receive interrupt takes the Imp's bytes into imp_rx as they arrive, so an idle pass
+    // only finds the ring empty. Bytes ahead of a header are the rest of a frame cut short.
+    if (imp_rx_tail == imp_rx_head) return;
+    do {
+        if (usart_block_imp(hdr, 1) != 1) return;
+    } while (hdr[0] != IMP_HDR);
+    if (usart_block_imp(hdr, 1) != 1) return;
+    tempDataByte = hdr[0];
+    
+    // A command ID in front of a frame makes it idempotent: the frame is always read and
+    // acknowledged, but only applied if the ID is not one of the last CMD_WINDOW applied.
+    uint8_t id = 0;
+    bool apply = true;
+    if (tempDataByte == IMP_COMMAND_ID) {
+        // The ID, then the header of the frame it belongs to
+        if (usart_block_imp(hdr, sizeof hdr) != sizeof hdr) return;
+        id = hdr[IMP_COMMAND_ID_ID];
+        if (id == 0 || id == 0xFF || hdr[IMP_COMMAND_ID_LEN] != IMP_HDR) return;
+        tempDataByte = hdr[IMP_COMMAND_ID_LEN + 1];
+        apply = !cmd_seen(id);
+        if (!apply) tm_dups++;
+    }
+    bool done = false;      // The whole frame was read
+    
+    if (tempDataByte == IMP_STATE) {
+        uint8_t pkt[IMP_STATE_LEN];
+        if (usart_block_imp(pkt, IMP_STATE_LEN) != IMP_STATE_LEN) return;
+        done = true;
+        
+        //check if it is a status request or not
+        if (state_status_req(pkt + IMP_STATE_STATE)) {
+            //send data to imp
+            if (dirty & DIRTY_PACKET) { //Make sure data is current
+                dirty &= ~DIRTY_PACKET;
+                packet_config();
             }
-            
-            }// end if header 1
-            }// end if header 0
-            
-            UCSR0B &= ~(1 << RXEN0);
-            _delay_ms(5);
-            UCSR0B |= (1 << RXEN0);
-            _delay_ms(5);
-            
-            tempDataByte = usart_in_xbee();
-            //if (tempDataByte != 0xFF) {
-            if (tempDataByte == 0xE3) {
-            	tempDataByte = usart_in_xbee();
-            	if (tempDataByte != 0xFF) {
-            		temp_char = tempDataByte;
-            		tempDataByte = usart_in_xbee();
-            		if (tempDataByte != 0xFF) {
-            			humid_char = tempDataByte;
-            			
-            			humid_sen = (humid_char & 0x7F);
-            			temp_sen = (temp_char & 0x7F);
-
-            			
-            			usart_out_xbee(0xD4);
-            			usart_out_xbee(io_char);
-            			usart_out_xbee(temp_char);
-            			usart_out_xbee(humid_char);
-            			
-           			}
-           		}
+            usart_out_imp(packet[0] | hvac_call);
+            usart_out_imp(packet[1]);
+            usart_out_imp(packet[2]);
+            sensor_flags = sensor_status();
+            usart_out_imp(sensor_flags);
+        }
+        else if (apply) {
+            //update our data and send to xbee
+            packet_apply(pkt + IMP_STATE_STATE);
+            xbee_send_state();
+        }
+    }
+    else if (tempDataByte == IMP_SCENE) {
+        // A whole scene is one ID byte; the settings it applies are already stored here.
+        uint8_t scene[IMP_SCENE_LEN];
+        done = usart_block_imp(scene, IMP_SCENE_LEN) == IMP_SCENE_LEN;
+        if (done && apply && scene_apply(scene[IMP_SCENE_SCENE])) {
+            xbee_send_state();
+        }
+    }
+    else if (tempDataByte == IMP_SCENE_SET) {
+        // Slot, then the packet to store there; every byte value is data, so a short read is the timeout
+        uint8_t scene[IMP_SCENE_SET_LEN];
+        done = usart_block_imp(scene, IMP_SCENE_SET_LEN) == IMP_SCENE_SET_LEN;
+        done = done && scene[IMP_SCENE_SET_SCENE] < SCENE_COUNT && scene_valid(scene + IMP_SCENE_SET_STATE);
+        if (done && apply) scene_store(scene[IMP_SCENE_SET_SCENE], scene + IMP_SCENE_SET_STATE);
+    }
+    else if (tempDataByte == IMP_RULE_SET) {
+        // Slot, then the rule bytes; an operand or argument of 0xFF is data like any other
+        uint8_t rule[IMP_RULE_SET_LEN];
+        done = usart_block_imp(rule, IMP_RULE_SET_LEN) == IMP_RULE_SET_LEN;
+        done = done && rule[IMP_RULE_SET_INDEX] < RULE_COUNT && rule_valid(rule + IMP_RULE_SET_RULE);
+        if (done && apply) rule_store(rule[IMP_RULE_SET_INDEX], rule + IMP_RULE_SET_RULE);
+    }
+    else if (tempDataByte == IMP_CLOCK) {
+        uint8_t clock[IMP_CLOCK_LEN];
+        done = usart_block_imp(clock, IMP_CLOCK_LEN) == IMP_CLOCK_LEN;
+        uint8_t hour = clock[IMP_CLOCK_HOUR];
+        uint8_t minute = clock[IMP_CLOCK_MINUTE];
+        done = done && hour < 24 && minute < 60;
+        if (done && apply) {
+            cli();
+            clock_tick = 0;
+            clock_sec = 0;
+            clock_min = hour * 60 + minute;
+            rule_inputs |= (1 << RULE_SRC_TIME);
+            sei();
+        }
+    }
+    else if (tempDataByte == IMP_ZONE_SET) {
+        uint8_t zone[IMP_ZONE_SET_LEN];
+        done = usart_block_imp(zone, IMP_ZONE_SET_LEN) == IMP_ZONE_SET_LEN &&
+               zone[IMP_ZONE_SET_NODE] < SENSOR_NODES;
+        if (done && apply) zone_store(zone[IMP_ZONE_SET_NODE], zone[IMP_ZONE_SET_ZONE_MAP]);
+    }
+    else if (tempDataByte == IMP_TELEMETRY) {
+        telemetry_send();
+    }
+    else if (tempDataByte == IMP_SETTINGS_GET) {
+        settings_send();
+    }
+    else if (tempDataByte == IMP_SETTINGS_PUT) {
+        // Size and check bytes, then the image, all in the same burst
+        uint8_t head[IMP_SETTINGS_PUT_LEN];
+        uint8_t image[SETTINGS_SIZE];
+        if (usart_block_imp(head, IMP_SETTINGS_PUT_LEN) != IMP_SETTINGS_PUT_LEN ||
+            head[IMP_SETTINGS_PUT_SIZE] != SETTINGS_SIZE ||
+            usart_block_imp(image, SETTINGS_SIZE) != SETTINGS_SIZE) return;
+        
+        const uint8_t * check = head + IMP_SETTINGS_PUT_SETTINGS_CHECK;
+        uint8_t sum[SETTINGS_CHECK_SIZE];
+        settings_check(image, SETTINGS_SIZE, sum);
+        done = sum[0] == check[0] && sum[1] == check[1];
+        if (done && apply && settings_load(image)) {
+            xbee_send_state();
+        }
+    }
+    
+    if (id && done) cmd_ack(id);
+}
+
+/*
+ cmd_seen - Whether command "id" is one of the last CMD_WINDOW commands applied.
+ */
+bool cmd_seen(uint8_t id)
+{
+    for (uint8_t i = 0; i < CMD_WINDOW; i++) {
+        if (cmd_recent[i] == id) return true;
+    }
+    return false;
+}
+
+/*
+ cmd_ack - Remember command "id" as applied, unless it already is, and acknowledge it to the Imp
+ so it stops resending. Repeats are acknowledged too: the first acknowledgement may have been lost.
+ */
+void cmd_ack(uint8_t id)
+{
+    if (!cmd_seen(id)) {
+        cmd_recent[cmd_next] = id;
+        cmd_next = (cmd_next + 1) % CMD_WINDOW;
+    }
+    usart_out_imp(IMP_ACK);
+    usart_out_imp(id);
+}
+
+/*
+ telemetry_send - Answer a telemetry request from the Imp with the counters, low byte first.
+ */
+void telemetry_send()
+{
+    uint8_t t[TELEMETRY_SIZE] = { 0 };
+    uint16_t spin = tm_spin >> 8;
+    
+    telemetry_set_polls_lo(t, tm_polls);
+    telemetry_set_polls_hi(t, tm_polls >> 8);
+    telemetry_set_samples_lo(t, tm_samples);
+    telemetry_set_samples_hi(t, tm_samples >> 8);
+    telemetry_set_timeouts_lo(t, tm_timeouts);
+    telemetry_set_timeouts_hi(t, tm_timeouts >> 8);
+    telemetry_set_spin_lo(t, spin);
+    telemetry_set_spin_hi(t, spin >> 8);
+    telemetry_set_poll_interval(t, sensor_interval);
+    telemetry_set_dups(t, tm_dups);
+    uint16_t free = stack_free();
+    telemetry_set_stack_free_lo(t, free);
+    telemetry_set_stack_free_hi(t, free >> 8);
+    telemetry_set_reset_reason(t, eeprom_read_byte((uint8_t *) RESET_LOG));
+    telemetry_set_reset_info(t, eeprom_read_byte((uint8_t *) RESET_LOG + 1));
+    telemetry_set_resets(t, eeprom_read_byte((uint8_t *) RESET_LOG + 2));
+    telemetry_set_lcd_faults(t, tm_lcd_faults);
+    telemetry_set_lcd_offline(t, lcd_offline);
+    
+    for (uint8_t i = 0; i < TELEMETRY_SIZE; i++) usart_out_imp(t[i]);
+}
+
+#ifdef __AVR__
+
+/*
+ stack_paint - Fill the SRAM between the end of .bss and the top of the stack with STACK_PAINT.
+ It runs from .init1, before the start-up code has set the stack pointer or cleared r1, so it is
+ written in assembly and uses no stack.
+ */
+void stack_paint(void)
+{
+    __asm volatile (
+        "    ldi r30, lo8(_end)      \n"
+        "    ldi r31, hi8(_end)      \n"
+        "    ldi r24, %0             \n"
+        "    ldi r25, hi8(__stack)   \n"
+        "    rjmp 2f                 \n"
+        "1:  st Z+, r24              \n"
+        "2:  cpi r30, lo8(__stack)   \n"
+        "    cpc r31, r25            \n"
+        "    brlo 1b                 \n"
+        "    breq 1b                 \n"
+        :: "i" (STACK_PAINT));
+}
+
+/*
+ stack_free - Bytes above the end of .bss that the stack has never reached since reset: the
+ deepest the stack has been is the first byte that lost its paint. Only run for telemetry, as it
+ walks the whole gap.
+ */
+uint16_t stack_free()
+{
+    const uint8_t * p = &_end;
+    while (p <= &__stack && *p == STACK_PAINT) p++;
+    return p - &_end;
+}
+
+#else
+
+// Host builds (sim/) run on the host's stack, so there is nothing to measure.
+uint16_t stack_free()
+{
+    return 0;
+}
+
+#endif
+
+/*
+ xbee_poll - Every sensor_interval ticks, poll the next installed sensor node for the samples it
+ took since its last poll and answer with the current state. Older boards reply with a single
+ reading. The interval adapts to how much the readings move; see xbee_pace().
+ */
+void xbee_poll()
+{
+    if (sensor_wait) return;
+    sensor_wait = sensor_interval;
+    
+    // Pick the next node with a non-zero weight in the zone map.
+    uint8_t node = sensor_next;
+    uint8_t n;
+    for (n = 0; n < SENSOR_NODES && !node_weight[node]; n++) {
+        node = (node + 1) % SENSOR_NODES;
+    }
+    if (n == SENSOR_NODES) return;
+    sensor_next = (node + 1) % SENSOR_NODES;
+    
+    uint8_t buf[SAMPLE_SIZE * SENSOR_BATCH];
+    
+    // The mux stays on the XBee from the poll to the end of the reply, which starts at once.
+    usart_xbee_begin();
+    usart_out_xbee(XBEE_POLL);
+    usart_out_xbee(node);
+    usart_out_xbee(sensor_ack[node]);
+    tm_polls++;
+    
+    uint8_t outcome = POLL_LOST;
+    if (usart_block_xbee(buf, 1) != 1) {
+        // No reply
+    } else if (buf[0] == XBEE_LEGACY) {
+        if (usart_block_xbee(buf, XBEE_LEGACY_LEN) == XBEE_LEGACY_LEN) {
+            tm_samples++;
+            outcome = sensor_sample(node, buf + XBEE_LEGACY_SAMPLE) ? POLL_MOVED : POLL_STEADY;
+        }
+    } else if (buf[0] == XBEE_BATCH) {
+        // Node, sample count, sequence number of the first sample, then the samples.
+        if (usart_block_xbee(buf, XBEE_BATCH_LEN) == XBEE_BATCH_LEN &&
+            buf[XBEE_BATCH_NODE] == node && buf[XBEE_BATCH_COUNT] <= SENSOR_BATCH) {
+            uint8_t count = buf[XBEE_BATCH_COUNT];
+            uint8_t seq = buf[XBEE_BATCH_SEQ];
+            if (usart_block_xbee(buf, SAMPLE_SIZE * count) == SAMPLE_SIZE * count) {
+                outcome = POLL_STEADY;
+                for (uint8_t i = 0; i < count; i++) {
+                    if (sensor_sample(node, buf + SAMPLE_SIZE * i)) outcome = POLL_MOVED;
+                }
+                if (count) sensor_ack[node] = (seq + count - 1) & 0x7F;
+                tm_samples += count;
             }
-            
-            
-            
-            _delay_ms(50);
         }
     }
-    return 0;                             // Should never be reached in embedded system!
+    usart_xbee_end();
+    
+    xbee_pace(outcome);
+    if (outcome == POLL_LOST) {
+        tm_timeouts++;
+        return;
+    }
+    xbee_send_state();
+}
+
+/*
+ xbee_pace - Adapt the poll interval to the outcome of the last poll. Moving readings halve it
+ down to SENSOR_FAST; steady readings, polls that came too early for a new sample and lost polls
+ stretch it by a quarter up to SENSOR_SLOW. While the thermostat is calling for heat or cooling
+ the interval is held at SENSOR_POLL or less, so a running control loop never waits long for
+ the reading that ends its call.
+ */
+void xbee_pace(uint8_t outcome)
+{
+    uint8_t interval = sensor_interval;
+    
+    if (outcome == POLL_MOVED) {
+        interval /= 2;
+        if (interval < SENSOR_FAST) interval = SENSOR_FAST;
+    } else if (interval < SENSOR_SLOW) {
+        uint8_t step = interval / 4 + 1;
+        interval = (interval > SENSOR_SLOW - step) ? SENSOR_SLOW : interval + step;
+    }
+    if (hvac_call && interval > SENSOR_POLL) interval = SENSOR_POLL;
+    
+    sensor_interval = interval;
+    if (sensor_wait > interval) sensor_wait = interval;
+}
+
+/*
+ sensor_sample - Take one sample (temperature and humidity reading) from sensor node "node". The node's
+ previous reading is swapped out of its zone and home sums, so averages cost the same however
+ many samples arrive, and the node is marked fresh again. Returns whether the node's reading
+ changed.
+ */
+bool sensor_sample(uint8_t node, const uint8_t * sample)
+{
+    uint8_t t = sample_tempr(sample);
+    uint8_t h = sample_humid(sample);
+    uint8_t z = node_zone[node];
+    uint8_t w = node_weight[node];
+    if (w == 0) return false;
+    
+    node_seen[node] = sensor_sec;
+    if (node_stale & (1 << node)) {
+        node_stale &= ~(1 << node);
+        dirty |= DIRTY_HVAC;
+    }
+    
+    bool moved = true;
+    if (node_valid & (1 << node)) {
+        moved = t != node_temp[node] || h != node_humid[node];
+        zone_tsum[z] -= w * node_temp[node];
+        home_tsum    -= w * node_temp[node];
+        home_hsum    -= w * node_humid[node];
+    } else {
+        node_valid |= (1 << node);
+        zone_wsum[z] += w;
+        home_wsum    += w;
+    }
+    zone_tsum[z] += w * t;
+    home_tsum    += w * t;
+    home_hsum    += w * h;
+    node_temp[node]  = t;
+    node_humid[node] = h;
+    if (moved) dirty |= DIRTY_HVAC;
+    
+    sensor_average();
+    return moved;
+}
+
+/*
+ sensor_average - Recompute the whole-home averages from the home sums. Only averages that moved
+ need the display and rules looked at again. With no reading in the sums they are left as they
+ were; the thermostat is shut down then (see hvac_update()).
+ */
+void sensor_average()
+{
+    if (home_wsum == 0) return;
+    
+    // Whole-home averages, rounded, are what the display and rules see.
+    uint8_t temp_avg  = (home_tsum + home_wsum / 2) / home_wsum;
+    uint8_t humid_avg = (home_hsum + home_wsum / 2) / home_wsum;
+    if (humid_avg != humid_sen) {
+        humid_sen = humid_avg;
+        rule_inputs |= (1 << RULE_SRC_HUMID);
+        dirty |= DIRTY_LCD;
+    }
+    if (temp_avg != temp_sen) {
+        temp_sen = temp_avg;
+        rule_inputs |= (1 << RULE_SRC_TEMP);
+        dirty |= DIRTY_LCD;
+    }
+}
+
+/*
+ xbee_send_state - Send the current state packet to the sensor array.
+ */
+void xbee_send_state()
+{
+    if (dirty & DIRTY_PACKET) {
+        dirty &= ~DIRTY_PACKET;
+        packet_config();
+    }
+    usart_xbee_begin();
+    usart_out_xbee(XBEE_STATE);
+    usart_out_xbee(packet[0] | hvac_call);
+    usart_out_xbee(packet[1]);
+    usart_out_xbee(packet[2]);
+    usart_xbee_end();
+    
+    // The broadcast reaches only the XBee (PC0 steers TX), so the Imp gets the sensor status
+    // here and asks for the state itself.
+    imp_send_sensors();
+}
+
+/*
+ imp_send_sensors - Send the Imp the sensor status: which nodes are stale, and whether the
+ thermostat is holding or shut down for want of fresh readings.
+ */
+void imp_send_sensors()
+{
+    sensor_flags = sensor_status();
+    usart_out_imp(IMP_SENSORS);
+    usart_out_imp(sensor_flags);
 }
 
 /*
@@ -314,27 +979,29 @@ void clk() {
 }
 
 /*
- data_corruption - States that data has been corrupted at a location in the LCD.
+ data_corruption - States that data has been corrupted at a location in the LCD, puts the default
+ setting back in the cell and restarts the controller through the watchdog, recording why.
  */
 void data_corruption(uint8_t address)
 {
-    // Reset string buffers
-    str_0[0] = '\0';
-    str_1[1] = '\0';
-    char buf[8];  // Temporary character buffer for LCD display
-    
     // Display data corruption error and location.
-    strcat(str_0, "Data corruption during  ");
-    sprintf(buf, "0x%X", address);
-    strcat(str_1, "read! addr: ");
-    strcat(str_1, buf);
-    strcat(str_1, "        ");
+    lcd_fmt(str_0, PSTR("Data corruption during"));
+    lcd_fmt(str_1, PSTR("read! addr: 0x%X"), address);
     
-    // Print the text to the LCD and busywait forever (crash).
+    // Print the text to the LCD and leave it up for a second.
+    wdt_reset();
     strout(0x00, (unsigned char *) str_0); // Print first line of text to LCD.
     strout(0x40, (unsigned char *) str_1); // Print second line of text to LCD.
-    
-    _delay_ms(2000);
+    eeprom_update_byte((uint8_t *) address, address == HUMID_0 ? HUMID_DEFAULT : TEMPR_DEFAULT);
+    _delay_ms(1000);
+    
+    cli();
+    reset_cause = RESET_CORRUPT;
+    reset_info = address;
+    wdt_enable(WDTO_15MS);
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    for (;;) sleep_cpu();           // Until the watchdog resets the controller
 }
 
 /*
@@ -344,35 +1011,19 @@ void data_corruption(uint8_t address)
 
 void var_config()
 {
-	int byte_bools = eeprom_read_byte((uint8_t *) PACKET0);
-	int byte_tempr = eeprom_read_byte((uint8_t *) PACKET1);
-	int byte_humid = eeprom_read_byte((uint8_t *) PACKET2);
+	uint8_t pkt[STATE_SIZE];
+	eeprom_read_block(pkt, (uint8_t *) PACKET0, STATE_SIZE);
+	
+	uint8_t byte_tempr = state_tempr(pkt);
+	uint8_t byte_humid = state_humid(pkt);
 	
-	/*
-	lights = ((statusBit0 & 0x40) != 0x00);
-    lights_auto = ((statusBit0 & 0x20) != 0x00);
-    
-    heater_on = ((statusBit0 & 0x10) != 0x00);
-    cooler_on = ((statusBit0 & 0x08) != 0x00);
-    fan_on = ((statusBit0 & 0x04) != 0x00);
-    
-    ac_auto = ((statusBit0 & 0x02) != 0x00);
-    
-    
-    //Update temperature and humidity data
-    
-    tempr_val = (statusBit1 & 0x7F);
-    humid_val = (statusBit2 & 0x7F);
-    humid_on = ((statusBit2 & 0x80) != 0x00);
-    */
-    
     uint8_t tempr_MSD = (byte_tempr / 10) << 4;
   	uint8_t tempr_LSD = byte_tempr % 10;
   	uint8_t tempr_BCD = tempr_MSD | tempr_LSD;
   
-  	uint8_t tempr_set = (byte_bools & 0x02) ? 0 :
-                      (byte_bools & 0x04) ? 1 :
-                      (byte_bools & 0x08) ? 2 : 3;
+  	uint8_t tempr_set = state_ac_auto(pkt) ? 0 :
+                      state_fan(pkt)     ? 1 :
+                      state_heater(pkt)  ? 2 : 3;
   	tempr_set <<= 6;
   
   	eeprom_update_byte((uint8_t *) TEMPR_0, tempr_BCD);
@@ -383,20 +1034,138 @@ void var_config()
   	uint8_t humid_LSD = byte_humid % 10;
   	uint8_t humid_BCD = humid_MSD | humid_LSD;
   
-  	uint8_t humid_set = byte_humid & 0x80;
+  	uint8_t humid_set = state_humid_on(pkt) << 7;
   
   	eeprom_update_byte((uint8_t *) HUMID_0, humid_BCD);
   	eeprom_update_byte((uint8_t *) HUMID_1, humid_set);
   
   	// Write light settings.
-  	uint8_t light_set = (byte_bools & 0x40) ? 0 :
-                      (byte_bools & 0x20) ? 2 : 1;
+  	uint8_t light_set = state_lights_auto(pkt) ? 0 :
+                      state_lights(pkt)      ? 2 : 1;
   	light_set <<= 6;
   
   	eeprom_update_byte((uint8_t *) LIGHT_0, light_set);
 
 }
 
+/*
+ packet_apply - Commit a full state packet to EEPROM as one block write and bring the settings
+ cells and control variables in line with it. Any edit in progress is dropped so that stale
+ local copies in the main loop cannot overwrite the new settings afterwards.
+ */
+void packet_apply(uint8_t * pkt)
+{
+    pkt[0] &= ~CALL_BITS;           // HVAC call is computed here, never stored
+    state_set_status_req(pkt, 0);   // Status request bit is never stored
+    eeprom_update_block(pkt, (uint8_t *) PACKET0, STATE_SIZE);
+    var_config();
+    
+    editing = 0;
+    changed = 0;
+    dirty |= DIRTY_PACKET | DIRTY_EDIT | DIRTY_LCD;
+}
+
+/*
+ scene_apply - Apply the scene stored in slot "id". Returns false if the slot is out of range or
+ has never been programmed.
+ */
+bool scene_apply(uint8_t id)
+{
+    if (id >= SCENE_COUNT) return false;
+    
+    uint8_t pkt[SCENE_SIZE];
+    eeprom_read_block(pkt, (uint8_t *) (SCENE_BASE + id * SCENE_SIZE), SCENE_SIZE);
+    
+    // The heat call bit is never stored in a valid packet, so erased EEPROM reads as empty.
+    if (state_call_heat(pkt)) return false;
+    
+    packet_apply(pkt);
+    return true;
+}
+
+/*
+ scene_valid - True if "pkt" can be stored as a scene: all 0xFF, which erases the slot, or a state
+ packet whose set temperature (60-90) and humidity (0-99) the controller accepts.
+ */
+bool scene_valid(const uint8_t * pkt)
+{
+    if (pkt[0] == 0xFF && pkt[1] == 0xFF && pkt[2] == 0xFF) return true;
+    return state_tempr(pkt) >= 60 && state_tempr(pkt) <= 90 && state_humid(pkt) < 100;
+}
+
+/*
+ scene_store - Store a state packet in scene slot "id" for later activation. A packet of all 0xFF
+ erases the slot.
+ */
+void scene_store(uint8_t id, uint8_t * pkt)
+{
+    if (id >= SCENE_COUNT || !scene_valid(pkt)) return;
+    
+    // The call bits and status request are never stored, so only an erased slot has the heat call set.
+    if (pkt[0] != 0xFF || pkt[1] != 0xFF || pkt[2] != 0xFF) {
+        pkt[0] &= ~CALL_BITS;
+        state_set_status_req(pkt, 0);
+    }
+    eeprom_update_block(pkt, (uint8_t *) (SCENE_BASE + id * SCENE_SIZE), SCENE_SIZE);
+}
+
+/*
+ settings_check - Fletcher-16 check bytes of "len" bytes at "p" into "check" (settings_check layout).
+ */
+void settings_check(const uint8_t * p, uint8_t len, uint8_t * check)
+{
+    uint16_t a = 0, b = 0;
+    for (uint8_t i = 0; i < len; i++) {
+        a = (a + p[i]) % 255;
+        b = (b + a) % 255;
+    }
+    settings_check_set_sum_a(check, a);
+    settings_check_set_sum_b(check, b);
+}
+
+/*
+ settings_send - Answer a settings request from the Imp with the whole settings image. The image
+ is read from EEPROM twice, once for the check bytes that go first and once to send it, rather
+ than held in SRAM.
+ */
+void settings_send()
+{
+    uint16_t a = 0, b = 0;
+    for (uint8_t i = 0; i < SETTINGS_SIZE; i++) {
+        a = (a + eeprom_read_byte((uint8_t *) (SETTINGS_BASE + i))) % 255;
+        b = (b + a) % 255;
+    }
+    usart_out_imp(SETTINGS_SIZE);
+    usart_out_imp(a);
+    usart_out_imp(b);
+    for (uint8_t i = 0; i < SETTINGS_SIZE; i++) {
+        usart_out_imp(eeprom_read_byte((uint8_t *) (SETTINGS_BASE + i)));
+    }
+}
+
+/*
+ settings_load - Write a whole settings image to EEPROM and rebuild everything derived from it:
+ control variables and packet, zone model and rule state. Returns false, writing nothing, if the
+ set temperature is not valid BCD, which would otherwise stop the controller in data_corruption().
+ */
+bool settings_load(const uint8_t * image)
+{
+    uint8_t tempr = image[TEMPR_0 - SETTINGS_BASE];
+    if ((tempr >> 4) > 9 || (tempr & 0x0F) > 9) return false;
+    
+    eeprom_update_block(image, (uint8_t *) SETTINGS_BASE, SETTINGS_SIZE);
+    
+    editing = 0;
+    changed = 0;
+    dirty |= DIRTY_PACKET | DIRTY_EDIT | DIRTY_LCD;
+    zone_load();
+    
+    // Every rule may have changed: none has triggered yet and all are evaluated again.
+    rule_active = 0;
+    rule_inputs = 0xFF;
+    return true;
+}
+
 void packet_config()
 {
     // Perform the very slow process of reading from the entire EEPROM
@@ -449,29 +1218,336 @@ void packet_config()
     lights_auto = (light == 0);
     
     // Create three bytes of data for later transmission.
-    uint8_t byte_bools = 0;
-    uint8_t byte_tempr = 0;
-    uint8_t byte_humid = 0;
+    packet[0] = packet[1] = packet[2] = 0;
     
     // Set bytes with appropriate data
-    byte_bools |= lights_auto << 6;
-    byte_bools |= lights      << 5;
-    byte_bools |= cooler_on   << 4;
-    byte_bools |= heater_on   << 3;
-    byte_bools |= fan_on      << 2;   // Unimplemented in sensor array
-    byte_bools |= ac_auto     << 1;
+    state_set_lights_auto(packet, lights_auto);
+    state_set_lights(packet, lights);
+    state_set_cooler(packet, cooler_on);
+    state_set_heater(packet, heater_on);
+    state_set_fan(packet, fan_on);      // Unimplemented in sensor array
+    state_set_ac_auto(packet, ac_auto);
+    
+    state_set_tempr(packet, tempr_val);
+    state_set_humid_on(packet, humid_on);
+    state_set_humid(packet, humid_val);
+    
+    // Output states are a rule input; flag them only when they actually change.
+    if (packet[0] != state_bools) {
+        state_bools = packet[0];
+        rule_inputs |= (1 << RULE_SRC_STATE);
+    }
     
-    byte_tempr |= (tempr_val & 0x7F);
-    byte_humid |= humid_on    << 7;
-    byte_humid |= (humid_val & 0x7F);
+    // The thermostat follows the mode and set temperature.
+    dirty |= DIRTY_HVAC;
     
     // Write the universal packets to the EEPROM for later retrieval.
-    eeprom_update_byte((uint8_t *) PACKET0, byte_bools);
-    eeprom_update_byte((uint8_t *) PACKET1, byte_tempr);
-    eeprom_update_byte((uint8_t *) PACKET2, byte_humid);
+    eeprom_update_block(packet, (uint8_t *) PACKET0, STATE_SIZE);
+}
+
+
+// ---------- ZONES AND THERMOSTAT ----------
+
+/*
+ zone_load - Read the zone map from EEPROM and clear the zone sums. Until a map is stored, node 0
+ is the only node and covers the whole home.
+ */
+void zone_load()
+{
+    for (uint8_t n = 0; n < SENSOR_NODES; n++) {
+        uint8_t map = eeprom_read_byte((uint8_t *) (ZONE_MAP + n));
+        if (map == 0xFF) map = (n == 0) ? 0x01 : 0x00;
+        node_zone[n]   = zone_map_zone(&map);
+        node_weight[n] = zone_map_weight(&map);
+        sensor_ack[n]  = 0x7F;
+        node_seen[n]   = sensor_sec;
+    }
+    for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+        zone_tsum[z] = 0;
+        zone_wsum[z] = 0;
+    }
+    node_valid = 0;
+    node_stale = 0;
+    home_tsum = home_hsum = 0;
+    home_wsum = 0;
+    dirty |= DIRTY_HVAC;
+}
+
+/*
+ zone_store - Store the zone map entry for sensor node "node" and rebuild the zone model.
+ */
+void zone_store(uint8_t node, uint8_t map)
+{
+    if (node >= SENSOR_NODES) return;
+    eeprom_update_byte((uint8_t *) (ZONE_MAP + node), map & (ZONE_MAP_ZONE_MASK | ZONE_MAP_WEIGHT_MASK));
+    zone_load();
+}
+
+/*
+ sensor_drop - Take node "node"'s reading out of its zone and home sums, as if it had not reported
+ since the zone map was loaded.
+ */
+void sensor_drop(uint8_t node)
+{
+    uint8_t z = node_zone[node];
+    uint8_t w = node_weight[node];
+    if (!(node_valid & (1 << node))) return;
+    
+    node_valid &= ~(1 << node);
+    zone_tsum[z] -= w * node_temp[node];
+    zone_wsum[z] -= w;
+    home_tsum    -= w * node_temp[node];
+    home_hsum    -= w * node_humid[node];
+    home_wsum    -= w;
+    dirty |= DIRTY_HVAC;
+    sensor_average();
+}
+
+/*
+ sensor_age - Once a second, flag installed nodes that have sent no sample for SENSOR_STALE
+ seconds and drop the readings of those silent for SENSOR_DEAD. Samples clear the flag as they
+ arrive (see sensor_sample()), so nothing is recounted here.
+ */
+void sensor_age()
+{
+    uint8_t now = sensor_sec;
+    if (now == sensor_check) return;
+    sensor_check = now;
+    
+    for (uint8_t n = 0; n < SENSOR_NODES; n++) {
+        if (!node_weight[n]) continue;
+        uint8_t age = now - node_seen[n];
+        if (!(node_stale & (1 << n))) {
+            if (age >= SENSOR_STALE) {
+                node_stale |= (1 << n);
+                dirty |= DIRTY_HVAC;
+            }
+        } else if ((node_valid & (1 << n)) && age >= SENSOR_DEAD) {
+            sensor_drop(n);
+        }
+    }
+}
+
+/*
+ sensor_hold - Whether every reading in the averages is stale.
+ */
+bool sensor_hold()
+{
+    return node_valid && !(node_valid & ~node_stale);
+}
+
+/*
+ sensor_status - The sensors byte sent to the Imp.
+ */
+uint8_t sensor_status()
+{
+    uint8_t s = 0;
+    sensors_set_stale(&s, node_stale);
+    sensors_set_hold(&s, sensor_hold());
+    sensors_set_shutdown(&s, home_wsum == 0);
+    return s;
+}
+
+/*
+ hvac_update - Decide the HVAC call from zone demand (set temperature minus zone average). A call
+ starts when the weighted mean demand reaches HVAC_HYST and ends when it reaches zero, or earlier
+ if it would push any single zone more than HVAC_SPREAD past the set point. Heat mode only heats,
+ cold mode only cools, auto mode does either and fan mode never calls. Stale readings hold the
+ call as it is unless they end it, and with no reading left there is no call.
+ */
+void hvac_update()
+{
+    if (home_wsum == 0 || fan_on) {
+        hvac_call = 0;
+        return;
+    }
+    
+    int8_t mean = (int8_t) tempr_val - (int8_t) temp_sen;
+    int8_t lo = 127;    // Smallest zone demand (the warmest zone)
+    int8_t hi = -128;   // Largest zone demand (the coldest zone)
+    for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+        if (zone_wsum[z] == 0) continue;
+        int8_t d = (int8_t) tempr_val - (int8_t) ((zone_tsum[z] + zone_wsum[z] / 2) / zone_wsum[z]);
+        if (d < lo) lo = d;
+        if (d > hi) hi = d;
+    }
+    
+    bool heat_ok = heater_on || ac_auto;
+    bool cool_ok = cooler_on || ac_auto;
+    
+    if (hvac_call == CALL_HEAT) {
+        if (!heat_ok || mean <= 0 || lo <= -HVAC_SPREAD) hvac_call = 0;
+    } else if (hvac_call == CALL_COOL) {
+        if (!cool_ok || mean >= 0 || hi >= HVAC_SPREAD) hvac_call = 0;
+    }
+    
+    if (hvac_call == 0 && !sensor_hold()) {
+        if (heat_ok && mean >= HVAC_HYST && lo > -HVAC_SPREAD) hvac_call = CALL_HEAT;
+        else if (cool_ok && mean <= -HVAC_HYST && hi < HVAC_SPREAD) hvac_call = CALL_COOL;
+    }
+}
+
+// ---------- RULE ENGINE ----------
+
+/*
+ rule_valid - True if "rule" can be stored: source RULE_SRC_NONE, which erases the slot, or a known
+ source with an action whose argument is in range. Any operand is valid for every comparison.
+ */
+bool rule_valid(const uint8_t * rule)
+{
+    uint8_t src = rule_src(rule);
+    uint8_t arg = rule_arg(rule);
+    if (src == RULE_SRC_NONE) return true;
+    if (src > RULE_SRC_STATE) return false;
+    
+    switch (rule_action(rule)) {
+        case RULE_ACT_MODE:  return arg <= 3;
+        case RULE_ACT_TEMPR: return arg >= 60 && arg <= 90;
+        case RULE_ACT_HUMID: return arg <= 1;
+        case RULE_ACT_LIGHT: return arg <= 2;
+        case RULE_ACT_SCENE: return arg < SCENE_COUNT;
+        default: return false;
+    }
+}
+
+/*
+ rule_store - Store rule bytes in slot "id". A rule with source RULE_SRC_NONE erases the slot.
+ */
+void rule_store(uint8_t id, uint8_t * rule)
+{
+    if (id >= RULE_COUNT || !rule_valid(rule)) return;
+    
+    uint8_t src = rule_src(rule);
+    if (src == RULE_SRC_NONE) {
+        rule[0] = rule[1] = rule[2] = rule[3] = 0xFF;
+    }
+    eeprom_update_block(rule, (uint8_t *) (RULE_BASE + id * RULE_SIZE), RULE_SIZE);
+    
+    // Treat the new rule as not yet triggered and evaluate it on the next pass.
+    rule_active &= ~(1 << id);
+    if (src != RULE_SRC_NONE) rule_inputs |= (1 << src);
+}
+
+/*
+ rules_eval - Evaluate the rules whose input sources changed since the last call. A rule acts
+ once when its condition becomes true, not on every evaluation while it stays true, and the new
+ state is broadcast once after all rules have run.
+ */
+void rules_eval()
+{
+    cli();
+    uint8_t inputs = rule_inputs;
+    rule_inputs = 0;
+    sei();
+    
+    uint8_t tod = clock_min / 10;
+    uint8_t pkt[3];
+    bool pkt_read = false;
+    bool acted = false;     // An action changed the state packet
+    
+    for (uint8_t id = 0; id < RULE_COUNT; id++) {
+        uint8_t rule[RULE_SIZE];
+        eeprom_read_block(rule, (uint8_t *) (RULE_BASE + id * RULE_SIZE), RULE_SIZE);
+        
+        uint8_t src = rule_src(rule);
+        if (src == RULE_SRC_NONE || !(inputs & (1 << src))) continue;
+        
+        uint8_t value = (src == RULE_SRC_TEMP)  ? temp_sen :
+                        (src == RULE_SRC_HUMID) ? humid_sen :
+                        (src == RULE_SRC_TIME)  ? tod : state_bools;
+        
+        uint8_t cmp = rule_cmp(rule);
+        uint8_t operand = rule_operand(rule);
+        bool hold = (cmp == RULE_CMP_LT) ? (value < operand) :
+                    (cmp == RULE_CMP_GT) ? (value > operand) :
+                    (cmp == RULE_CMP_EQ) ? (value == operand) :
+                    ((value & operand) == operand);
+        
+        uint8_t was = rule_active & (1 << id);
+        if (!hold) {
+            rule_active &= ~(1 << id);
+            continue;
+        }
+        rule_active |= (1 << id);
+        if (was) continue;
+        
+        // Condition just became true: perform the action.
+        uint8_t act = rule_action(rule);
+        uint8_t arg = rule_arg(rule);
+        if (act == RULE_ACT_SCENE) {
+            if (scene_apply(arg)) acted = true;
+            pkt_read = false;
+            continue;
+        }
+        
+        if (!pkt_read) {
+            if (dirty & DIRTY_PACKET) {
+                dirty &= ~DIRTY_PACKET;
+                packet_config();
+            }
+            memcpy(pkt, packet, 3);
+            pkt_read = true;
+        }
+        switch (act) {
+            case RULE_ACT_MODE:
+                state_set_ac_auto(pkt, arg == 0);
+                state_set_fan(pkt, arg == 1);
+                state_set_heater(pkt, arg == 2);
+                state_set_cooler(pkt, arg == 3);
+                break;
+            case RULE_ACT_TEMPR:
+                if (arg >= 60 && arg <= 90) state_set_tempr(pkt, arg);
+                break;
+            case RULE_ACT_HUMID:
+                state_set_humid_on(pkt, arg != 0);
+                break;
+            case RULE_ACT_LIGHT:
+                state_set_lights_auto(pkt, arg == 0);
+                state_set_lights(pkt, arg == 2);
+                break;
+            default: break;
+        }
+        packet_apply(pkt);
+        acted = true;
+    }
+    
+    // Rules act on their own, so the sensor array hears of the change now, not at the next poll.
+    if (acted) xbee_send_state();
 }
 
+/*
+ timer_init - Start timer 1 in CTC mode to interrupt TICK_HZ times a second. The tick wakes the
+ main loop from sleep and drives the time of day clock.
+ */
+void timer_init()
+{
+    OCR1A  = TICK_OCR;
+    TCCR1A = 0;
+    TCCR1B = (1 << WGM12) | (1 << CS12) | (1 << CS10);  // CTC, clk/1024
+    TIMSK1 = (1 << OCIE1A);
+    sei();
+}
 
+/*
+ Timer 1 compare interrupt - Advance the time of day and the seconds sensor readings are aged
+ by, and flag the time source for the rule engine when the 10 minute period changes.
+ */
+ISR(TIMER1_COMPA_vect)
+{
+    wdt_tasks |= TASK_TICK;
+    if (sensor_wait) sensor_wait--;
+    if (lcd_wait) lcd_wait--;
+    
+    if (++clock_tick < TICK_HZ) return;
+    clock_tick = 0;
+    sensor_sec++;
+    
+    if (++clock_sec < 60) return;
+    clock_sec = 0;
+    
+    if (++clock_min >= 1440) clock_min = 0;
+    if (clock_min % 10 == 0) rule_inputs |= (1 << RULE_SRC_TIME);
+}
 
 /*
  tempr_config - Modify stored temperature and display temperature on LCD.
@@ -539,41 +1615,15 @@ void tempr_config(uint8_t * data_0, uint8_t * data_1)
         }
     }
     
-    char * mode_disp;   // Stores text representation of temperature mode.
-    // Use ternary operator to create the appropriate text.
-    mode_disp = (mode == 3) ? "Cold" :
-    (mode == 2) ? " Hot" :
-    (mode == 1) ? " Fan" : "Auto";
-    
     // Toggle the currently edited field.
-    if (editing != 0 && !pos_level) {
-        if (editing == 1) mode_disp = "   ";
-    }
+    bool blink = editing != 0 && !pos_level;
+    PGM_P mode_disp = (blink && editing == 1) ? blank_name : mode_names[mode];
+    bool set_blank = blink && editing == 2;
     
-    str_0[0] = '\0';  // Delete previous string to prepare for new one.
-    str_1[0] = '\0';
-    char buf[8];      // Create a temporary string buffer for storing numbers for printing.
     // Generate strings based on values, settings, and editing status
-    strcat(str_0, "T        Type: ");
-    strcat(str_0, mode_disp);
-    strcat(str_0, "     ");
-    
-    strcat(str_1, "   Actual/Set: ");
-    
-    unsigned char tempLSD = temp_sen%10;
-    unsigned char tempMSD = temp_sen/10;
-    
-    sprintf(buf, "%d%d", tempMSD, tempLSD);
-    strcat(str_1, buf); // Temporary until sensors polling is working
-    strcat(str_1, "/");
-    // Toggle printing of temperature
-    sprintf(buf, "%d", tempr_high);
-    if (editing == 2 && !pos_level) buf[0] = ' ';
-    strcat(str_1, buf);
-    sprintf(buf, "%d", tempr_low);
-    if (editing == 2 && !pos_level) buf[0] = ' ';
-    strcat(str_1, buf);
-    strcat(str_1, " F  ");
+    lcd_fmt(str_0, PSTR("T        Type: %S"), mode_disp);
+    lcd_fmt(str_1, PSTR("   Actual/Set: %02u/%c%c F"), temp_sen,
+            set_blank ? ' ' : '0' + tempr_high, set_blank ? ' ' : '0' + tempr_low);
     
     // Prints something akin to the following:
     // T        Type: Cold     
@@ -636,39 +1686,14 @@ void humid_config(uint8_t * data_0, uint8_t * data_1)
         }
     }
     
-    char * hum_disp;  // Stores text representation of humidifier status.
-    // Use ternary operators to create the appropriate text.
-    hum_disp = (hum_e == 1) ? " On" : "Off";
-    
     // Toggle the currently edited field.
-    if (!pos_level && editing == 1) {
-        hum_disp = "   ";
-    }
+    PGM_P hum_disp = (!pos_level && editing == 1) ? blank_name + 1 : hum_names[hum_e];
+    bool set_blank = !pos_level && editing == 2;
     
-    str_0[0] = '\0';  // Delete previous string to prepare for new one.
-    str_1[0] = '\0';
-    char buf[8];      // Create a temporary string buffer for storing numbers for printing.
     // Generate strings based on values, settings, and editing status
-    strcat(str_0, "H      Humidifer: ");
-    strcat(str_0, hum_disp);
-    strcat(str_0, "   ");
-    
-    strcat(str_1, " Hum Actual/Set: ");
-    
-    unsigned char humidLSD = humid_sen%10;
-    unsigned char humidMSD = humid_sen/10;
-    
-    sprintf(buf, "%d%d", humidMSD, humidLSD);
-    strcat(str_1, buf); // Temporary until sensors polling is working
-    strcat(str_1, "/");
-    // Toggle printing of humidity
-    sprintf(buf, "%d", humid_high);
-    if (editing == 2 && !pos_level) buf[0] = ' ';
-    strcat(str_1, buf);
-    sprintf(buf, "%d", humid_low);
-    if (editing == 2 && !pos_level) buf[0] = ' ';
-    strcat(str_1, buf);
-    strcat(str_1, "%");
+    lcd_fmt(str_0, PSTR("H      Humidifer: %S"), hum_disp);
+    lcd_fmt(str_1, PSTR(" Hum Actual/Set: %02u/%c%c%%"), humid_sen,
+            set_blank ? ' ' : '0' + humid_high, set_blank ? ' ' : '0' + humid_low);
     
     // Prints something akin to the following (note empty spaces):
     // H      Humidifer: Off   
@@ -696,23 +1721,13 @@ void light_config(uint8_t * data_0, uint8_t * data_1)
         // Ignore the second data byte to save on EEPROM writes.
     }
     
-    char * light_disp;    // Stores text representation of light settings.
-    // Use ternary operators to create the appropriate text.
-    light_disp = (light == 2) ? " On " :
-    (light == 1) ? " Off" : "Auto";
-    
     // Toggle the currently edited field.
-    if (!pos_level && editing == 1) {
-        light_disp = "      ";
-    }
+    if (light > 2) light = 0;   // Shown as "Auto", as before
+    PGM_P light_disp = (!pos_level && editing == 1) ? blank_name : light_names[light];
     
-    str_0[0] = '\0';  // Delete previous string to prepare for new one.
-    str_1[0] = '\0';
     // Generate strings based on values, settings, and editing status
-    strcat(str_0, "L                       ");
-    strcat(str_1, "    Lighting: ");
-    strcat(str_1, light_disp);
-    strcat(str_1, "      ");
+    lcd_fmt(str_0, PSTR("L"));
+    lcd_fmt(str_1, PSTR("    Lighting: %S"), light_disp);
     
     // Prints something akin to the following:
     // L                       
@@ -786,23 +1801,129 @@ uint8_t btn_db_val()
     return 0;     // User did not press anything.
 }
 
+// ---------- WATCHDOG ----------
+
+#ifdef __AVR__
+
+/*
+ reset_capture - Save MCUSR for reset_log() and clear it, and stop the watchdog, which a watchdog
+ reset leaves running at its shortest timeout. It runs from .init3, before .bss is cleared and
+ long before main() could.
+ */
+void reset_capture(void)
+{
+    reset_flags = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+}
+
+#endif
+
+/*
+ reset_log - Record the reason for the last reset in EEPROM at RESET_LOG, where telemetry reports
+ it, and count the resets that were not asked for. Only cells that change are written.
+ */
+void reset_log()
+{
+    uint8_t reason = RESET_POWER;
+    uint8_t info = 0;
+    if (reset_flags & (1 << WDRF)) {
+        reason = (reset_cause == RESET_CORRUPT) ? RESET_CORRUPT : RESET_WATCHDOG;
+        info = reset_info;
+    } else if (reset_flags & (1 << BORF)) {
+        reason = RESET_BROWNOUT;
+    } else if (reset_flags & (1 << EXTRF)) {
+        reason = RESET_EXTERNAL;
+    }
+    
+    // A watchdog reset with no warning (interrupts were off) leaves no tasks.
+    reset_cause = RESET_WATCHDOG;
+    reset_info = 0;
+    
+    eeprom_update_byte((uint8_t *) RESET_LOG, reason);
+    eeprom_update_byte((uint8_t *) RESET_LOG + 1, info);
+    uint8_t count = eeprom_read_byte((uint8_t *) RESET_LOG + 2);
+    if (count == 0xFF) count = 0;               // Erased
+    if (reason >= RESET_BROWNOUT && count < 0xFE) count++;
+    eeprom_update_byte((uint8_t *) RESET_LOG + 2, count);
+}
+
+/*
+ wdt_init - Start the watchdog in interrupt and reset mode: a first timeout runs the interrupt,
+ which notes the tasks that had not checked in, and a second resets the controller.
+ */
+void wdt_init()
+{
+    wdt_tasks = 0;
+    wdt_enable(WDT_TIMEOUT);
+    WDTCSR |= (1 << WDIE);
+}
+
+/*
+ wdt_checkin - Note that "task" made progress, and reset the watchdog once every task has since
+ it was last reset.
+ */
+void wdt_checkin(uint8_t task)
+{
+    cli();
+    uint8_t tasks = wdt_tasks | task;
+    if (tasks == TASK_ALL) {
+        wdt_reset();
+        if (!(WDTCSR & (1 << WDIE))) {
+            // A slow pass used up the interrupt, but everything caught up: re-arm it.
+            reset_info = 0;
+            WDTCSR |= (1 << WDIE);
+        }
+        tasks = 0;
+    }
+    wdt_tasks = tasks;
+    sei();
+}
+
+/*
+ Watchdog interrupt - One timeout left before the reset: note the tasks holding it up.
+ */
+ISR(WDT_vect)
+{
+    reset_info = TASK_ALL & ~wdt_tasks;
+}
+
 // ---------- LCD CONFIGURATION ----------
 
 /*
  strout - Print the contents of the character string "s" starting at LCD
  RAM location "x".  The string must be terminated by a zero byte.
+ Nothing is sent while the display is offline.
  */
 void strout(int x, unsigned char *s)
 {
     unsigned char ch;
     
+    if (lcd_offline) return;
     cmdout(x | 0x80, WAIT);   // Make A contain a Set Display Address command
     
-    while ((ch = *s++) != (unsigned char) '\0') {
+    while (!lcd_offline && (ch = *s++) != (unsigned char) '\0') {
         datout(ch);     // Output the next character
     }
 }
 
+/*
+ lcd_fmt - Format a display line into "line" from the format string "fmt" in program memory,
+ padded with spaces to LCD_COLS characters so it overwrites the whole line. Strings passed for
+ %S are read from program memory too.
+ */
+void lcd_fmt(char * line, PGM_P fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf_P(line, LCD_COLS + 1, fmt, args);
+    va_end(args);
+    
+    if (n < 0) n = 0;
+    while (n < LCD_COLS) line[n++] = ' ';
+    line[LCD_COLS] = '\0';
+}
+
 /*
  datout - Output a byte to the LCD display data register (the display)
  and wait for the busy flag to reset.
@@ -824,10 +1945,10 @@ void datout(unsigned char x)
  cmdout - Output a byte to the LCD display instruction register.  If
  "wait" is non-zero, wait for the busy flag to reset before returning.
  If "wait" is zero, return immediately since the BUSY flag isn't
- working during initialization.
+ working during initialization. Returns false if the display failed.
  */
 
-void cmdout(unsigned char x, unsigned char wait)
+bool cmdout(unsigned char x, unsigned char wait)
 {
     PORTB |= (x & LCD_Data_B);  // Put low 2 bits of data in PORTB
     PORTB &= (x | ~LCD_Data_B);
@@ -837,15 +1958,16 @@ void cmdout(unsigned char x, unsigned char wait)
     PORTB |= LCD_E;             // Set E to 1
     PORTB &= ~LCD_E;            // Set E to 0
     if (wait)
-        busywt();                   // Wait for BUSY flag to reset
+        return busywt();            // Wait for BUSY flag to reset
+    return true;
 }
 
 /*
  initialize - Do various things to force a initialization of the LCD
  display by instructions, and then set up the display parameters and
- turn the display on.
+ turn the display on. Returns false if the display did not answer.
  */
-void initialize()
+bool initialize()
 {
     _delay_ms(15);      // Delay at least 15ms
     
@@ -855,17 +1977,19 @@ void initialize()
     cmdout(0x30, NOWAIT); // Send a 0x30
     _delay_us(120);     // Delay at least 100usec
     
-    cmdout(0x38, WAIT); // Function Set: 8-bit interface, 2 lines
+    if (!cmdout(0x38, WAIT)) return false;  // Function Set: 8-bit interface, 2 lines
     
-    cmdout(0x0f, WAIT); // Display and cursor on
+    return cmdout(0x0f, WAIT);  // Display and cursor on
 }
 
 /*
- busywt - Wait for the BUSY flag to reset.
+ busywt - Wait for the BUSY flag to reset, reading it at most LCD_BUSY_POLLS times. A display that
+ stays busy has failed or is missing: it is taken offline (see lcd_fault()) and false returned.
  */
-void busywt()
+bool busywt()
 {
     unsigned char bf;
+    uint16_t polls = 0;
     
     PORTB &= ~LCD_Data_B;       // Set for no pull ups
     PORTD &= ~LCD_Data_D;
@@ -880,10 +2004,25 @@ void busywt()
         _delay_us(1);           // Wait for signal to appear
         bf = PIND & 0x80;       // Read status register
         PORTB &= ~LCD_E;        // Set E=0
-    } while (bf != 0);          // If Busy (PORTD, bit 7 = 1), loop
+    } while (bf != 0 && ++polls < LCD_BUSY_POLLS);  // If Busy (PORTD, bit 7 = 1), loop
     
     DDRB |= LCD_Data_B;         // Set PORTB, PORTD bits for output
     DDRD |= LCD_Data_D;
+    
+    if (bf) lcd_fault();
+    return !bf;
+}
+
+/*
+ lcd_fault - The display stopped answering. Until it is back, text is rendered but not sent, so
+ the radio and control tasks keep their pace; the main loop tries to bring it back every
+ LCD_RETRY ticks.
+ */
+void lcd_fault()
+{
+    if (!lcd_offline) tm_lcd_faults++;
+    lcd_offline = true;
+    lcd_wait = LCD_RETRY;
 }
 
 
@@ -902,6 +2041,46 @@ void usart_init(unsigned short ubrr)
 	UCSR0B |= (1 << TXEN0);
 	UCSR0B |= (1 << RXEN0);
 	UCSR0C = (3 << UCSZ00);
+	PORTC &= ~(1 << PC0);	// The mux rests on the Imp
+	UCSR0B |= (1 << RXCIE0);
+}
+
+/*
+ usart_xbee_begin - Stop taking bytes into imp_rx and switch the mux to the XBee for an exchange.
+ Anything left in the receiver is read away, so the first byte read is the XBee's.
+ */
+void usart_xbee_begin(void)
+{
+	UCSR0B &= ~(1 << RXCIE0);
+	PORTC |= 1 << PC0;
+	while (UCSR0A & (1 << RXC0)) (void) UDR0;
+}
+
+/*
+ usart_xbee_end - Switch the mux back to the Imp, where it rests, once the last byte sent has
+ left (PC0 steers TX too), and take the Imp's bytes into imp_rx again. Whatever the XBee left
+ in the receiver is read away first.
+ */
+void usart_xbee_end(void)
+{
+	unsigned int timeOut = 0;
+	while (!(UCSR0A & (1 << TXC0)) && ++timeOut < time_const1) {}
+	while (UCSR0A & (1 << RXC0)) (void) UDR0;
+	PORTC &= ~(1 << PC0);
+	UCSR0B |= (1 << RXCIE0);
+}
+
+/*
+ USART receive interrupt - Store a byte from the Imp in imp_rx. It is only enabled while the mux
+ selects the Imp; a byte that finds the ring full is lost.
+ */
+ISR(USART_RX_vect)
+{
+	uint8_t byte = UDR0;
+	uint8_t next = (imp_rx_head + 1) & (IMP_RX_SIZE - 1);
+	if (next == imp_rx_tail) return;
+	imp_rx[imp_rx_head] = byte;
+	imp_rx_head = next;
 }
 
 
@@ -919,10 +2098,13 @@ void usart_out_imp(char ch)
 	UDR0 = ch;
 }
 
+/*
+ usart_out_xbee - Send a byte to the XBee. The mux is left on the XBee, between usart_xbee_begin()
+ and usart_xbee_end(), so a reply that starts at once is not lost.
+ */
 void usart_out_xbee(char ch)
 {
 	PORTC |= 1 << PC0;
-	_delay_ms(5);
 	unsigned int timeOut = 0;
 	while ((UCSR0A & (1 <<UDRE0)) == 0) {
 		timeOut++;
@@ -930,9 +2112,8 @@ void usart_out_xbee(char ch)
 			return;
 		}
 	}
+	UCSR0A |= (1 << TXC0);	// Cleared by writing a one; set again once this byte has left
 	UDR0 = ch;
-	_delay_ms(5);
-	PORTC &= ~(1 << PC0);
 }
 
 unsigned char usart_in_imp(void)
@@ -951,6 +2132,49 @@ unsigned char usart_in_imp(void)
 	return UDR0;
 }
 
+/*
+ usart_block_xbee - Read up to "n" bytes from the XBee back to back. The select line is set once
+ so a reply sent in one burst is not overrun. Returns the number of bytes read before a timeout.
+ */
+uint8_t usart_block_xbee(uint8_t * buf, uint8_t n)
+{
+	PORTC |= 1 << PC0; //Set select line to 1 to select Xbee on UART mux
+	for (uint8_t i = 0; i < n; i++) {
+		unsigned int timeOut = 0;
+		while (!(UCSR0A & (1 << RXC0)))
+		{
+			timeOut++;
+			if (timeOut >= (time_const4)) {
+				tm_spin += timeOut;
+				return i;
+			}
+		}
+		tm_spin += timeOut;
+		buf[i] = UDR0;
+	}
+	return n;
+}
+
+/*
+ usart_block_imp - Take up to "n" bytes from the Imp out of imp_rx, waiting up to IMP_RX_WAIT
+ for each one still on the line. Returns the number of bytes taken before a timeout.
+ */
+uint8_t usart_block_imp(uint8_t * buf, uint8_t n)
+{
+	for (uint8_t i = 0; i < n; i++) {
+		uint8_t wait = 0;
+		while (imp_rx_tail == imp_rx_head) {
+			if (++wait > IMP_RX_WAIT) {
+				return i;
+			}
+			_delay_us(100);
+		}
+		buf[i] = imp_rx[imp_rx_tail];
+		imp_rx_tail = (imp_rx_tail + 1) & (IMP_RX_SIZE - 1);
+	}
+	return n;
+}
+
 unsigned char usart_in_xbee(void)
 {
 	_delay_ms(5);
@@ -0,0 +1,51 @@
+# AvrFirmware.cmake - Build the controller firmware with avr-gcc, alongside the host build.
+#
+# The host compiler builds everything else, so the firmware is built with custom commands
+# rather than a cross toolchain file. Sets SHS_AVR when avr-gcc is found.
+#
+#   avr_firmware(<name> <source> <f_cpu>)
+#       <name>.elf, <name>.hex and <name>.map in the build directory, a target <name>, and a
+#       memory report after each build.
+
+set(AVR_MCU atmega328p CACHE STRING "Part the firmware is built for")
+
+find_program(AVR_GCC avr-gcc)
+find_program(AVR_OBJCOPY avr-objcopy)
+find_program(AVR_SIZE avr-size)
+
+if(AVR_GCC AND AVR_OBJCOPY)
+    set(SHS_AVR TRUE)
+    get_filename_component(AVR_BIN ${AVR_GCC} DIRECTORY)
+    set(AVR_PREFIX ${AVR_BIN}/avr-)
+else()
+    set(SHS_AVR FALSE)
+endif()
+
+set(AVR_CFLAGS -mmcu=${AVR_MCU} -Os -std=gnu99 -Wall -ffunction-sections -fdata-sections)
+
+function(avr_firmware name source f_cpu)
+    set(src ${PROJECT_SOURCE_DIR}/${source})
+    set(elf ${PROJECT_BINARY_DIR}/${name}.elf)
+    set(hex ${PROJECT_BINARY_DIR}/${name}.hex)
+    set(map ${PROJECT_BINARY_DIR}/${name}.map)
+
+    set(report)
+    if(Python3_FOUND)
+        set(report COMMAND ${Python3_EXECUTABLE} ${PROJECT_SOURCE_DIR}/tools/mem_report.py
+            ${elf} --mcu ${AVR_MCU} --map ${map} --prefix ${AVR_PREFIX})
+    endif()
+
+    add_custom_command(OUTPUT ${elf} ${map}
+        COMMAND ${AVR_GCC} ${AVR_CFLAGS} -DF_CPU=${f_cpu}UL -I${PROJECT_SOURCE_DIR}
+            -Wl,--gc-sections -Wl,-Map,${map} -o ${elf} ${src}
+        DEPENDS ${src} ${PROJECT_SOURCE_DIR}/protocol/shs_frames.h
+        COMMENT "avr-gcc ${name}"
+        VERBATIM)
+    add_custom_command(OUTPUT ${hex}
+        COMMAND ${AVR_OBJCOPY} -O ihex -R .eeprom ${elf} ${hex}
+        ${report}
+        DEPENDS ${elf}
+        COMMENT "${name}.hex"
+        VERBATIM)
+    add_custom_target(${name} ALL DEPENDS ${hex})
+endfunction()
@@ -0,0 +1,22 @@
+# CheckOutput.cmake - Run a program and compare what it prints with the output expected of it.
+#
+#   cmake -DPROGRAM=<path> -DEXPECTED=<file> -DACTUAL=<file> -P CheckOutput.cmake
+#
+# Fails if the program exits non-zero or its output differs from EXPECTED, and shows the
+# difference. The output is kept in ACTUAL; when a change to it is intended, copy ACTUAL over
+# EXPECTED.
+
+execute_process(COMMAND ${PROGRAM} OUTPUT_FILE ${ACTUAL} RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${PROGRAM} exited with ${status}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${EXPECTED} ${ACTUAL}
+    RESULT_VARIABLE differ)
+if(differ)
+    find_program(DIFF diff)
+    if(DIFF)
+        execute_process(COMMAND ${DIFF} -u ${EXPECTED} ${ACTUAL})
+    endif()
+    message(FATAL_ERROR "output of ${PROGRAM} differs from ${EXPECTED}")
+endif()
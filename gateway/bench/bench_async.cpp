@@ -0,0 +1,128 @@
+// bench_async.cpp - Thousands of controller exchanges as coroutines on one reactor thread.
+//
+// Every home is a socket pair. One end is a simulated controller that answers like
+// imp_poll(): state commands are applied, and a status request is answered with the three
+// state bytes. The other end is the gateway's side, a coroutine per home that sends a new
+// setpoint, asks for the status and checks that the reply carries the setpoint back. A few
+// controllers are dead and never answer: their homes give up after three timeouts in a row
+// while the others keep running. Both sides run on the same Reactor.
+//
+//   bench_async [homes] [exchanges per home] [dead homes]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "shs/async.hpp"
+
+namespace {
+
+using namespace shs;
+using namespace std::chrono_literals;
+
+struct Totals {
+    std::uint64_t replies = 0;
+    std::uint64_t timeouts = 0;
+    std::uint64_t wrong = 0;
+};
+
+// The controller's side: apply commands and answer status requests until the gateway hangs up.
+Task<void> controller(Channel& ch, bool dead)
+{
+    std::uint8_t packet[proto::State::size] = {};
+    for (;;) {
+        std::optional<Frame> f = co_await ch.read_frame(1h);
+        if (!f) co_return;
+        if (dead || f->kind != FrameKind::imp_state) continue;
+
+        proto::State s = proto::State::unpack(f->payload.data());
+        if (s.status_req) {
+            co_await ch.write(packet);
+        } else {
+            s.pack(packet);
+        }
+    }
+}
+
+// The gateway's side: set, then read back, the setpoint.
+Task<void> home(Channel& ch, std::size_t exchanges, Totals& totals)
+{
+    int missed = 0;
+    for (std::size_t i = 0; i < exchanges && missed < 3; i++) {
+        proto::State s;
+        s.fan = 1;
+        s.tempr = static_cast<std::uint8_t>(60 + i % 20);
+        s.humid = 45;
+        std::uint8_t cmd[proto::State::size];
+        s.pack(cmd);
+        co_await ch.write_frame(FrameKind::imp_state, cmd);
+
+        proto::State req;
+        req.status_req = 1;
+        std::uint8_t ask[proto::State::size];
+        req.pack(ask);
+        ch.discard();
+        co_await ch.write_frame(FrameKind::imp_state, ask);
+
+        std::uint8_t reply[proto::State::size];
+        if (co_await ch.read_reply(reply, 250ms) != sizeof reply) {
+            totals.timeouts++;
+            missed++;
+            continue;
+        }
+        totals.replies++;
+        missed = 0;
+        if (proto::State::unpack(reply).tempr != s.tempr) totals.wrong++;
+    }
+    ::shutdown(ch.fd(), SHUT_WR);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    std::size_t homes = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 2000;
+    std::size_t exchanges = argc > 2 ? std::strtoul(argv[2], nullptr, 0) : 200;
+    std::size_t dead = argc > 3 ? std::strtoul(argv[3], nullptr, 0) : 10;
+
+    Reactor reactor;
+    std::vector<std::unique_ptr<Channel>> channels;
+    Totals totals;
+    for (std::size_t h = 0; h < homes; h++) {
+        int sv[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+            std::perror("bench_async: socketpair");
+            return 1;
+        }
+        channels.push_back(std::make_unique<Channel>(reactor, sv[0]));
+        channels.push_back(std::make_unique<Channel>(reactor, sv[1]));
+        reactor.spawn(home(*channels[2 * h], exchanges, totals));
+        reactor.spawn(controller(*channels[2 * h + 1], h < dead));
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    reactor.run();
+    auto t1 = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    std::uint64_t total = totals.replies + totals.timeouts;
+    const Reactor::Stats& rs = reactor.stats();
+    std::printf("%zu homes, %zu exchanges each, %zu dead, one thread\n", homes, exchanges, dead);
+    std::printf("%.2f s  %.0f exchanges/s  %llu replies  %llu timeouts  %llu polls  %llu resumes\n",
+                secs, double(total) / secs, static_cast<unsigned long long>(totals.replies),
+                static_cast<unsigned long long>(totals.timeouts),
+                static_cast<unsigned long long>(rs.polls), static_cast<unsigned long long>(rs.resumes));
+
+    bool ok = totals.wrong == 0 && totals.timeouts == 3 * dead &&
+              totals.replies == (homes - dead) * exchanges;
+    if (!ok) {
+        std::printf("MISMATCH: %llu wrong replies, expected %zu timeouts\n",
+                    static_cast<unsigned long long>(totals.wrong), 3 * dead);
+        return 1;
+    }
+    return 0;
+}
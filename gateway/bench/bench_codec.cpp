@@ -0,0 +1,115 @@
+// bench_codec.cpp - Compare the compile-time state codecs against a naive decoder.
+//
+// Decodes a batch of random 3 byte state packets into one column per field with:
+//   naive   - walks State::fields at run time, looking up byte, shift and mask per field
+//   scalar  - the template accessors, fully inlined
+//   ssse3   - decode_batch() gathering 16 packets per shuffle
+//   avx2    - decode_batch() gathering 32 packets per shuffle
+// Every decoder's output is checked against the naive one before it is timed.
+//
+//   bench_codec [frames] [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "shs/codec.hpp"
+#include "shs/frames.hpp"
+
+namespace {
+
+using State = shs::proto::State;
+using Layout = State::layout;
+
+struct Output {
+    std::vector<std::vector<std::uint8_t>> store;
+    shs::Columns<Layout> cols;
+
+    explicit Output(std::size_t count) : store(Layout::count, std::vector<std::uint8_t>(count))
+    {
+        for (std::size_t i = 0; i < Layout::count; i++) cols[i] = store[i].data();
+    }
+};
+
+void decode_naive(const std::uint8_t* frames, std::size_t count, const shs::Columns<Layout>& out)
+{
+    for (std::size_t n = 0; n < count; n++) {
+        const std::uint8_t* p = frames + n * State::size;
+        for (std::size_t i = 0; i < State::fields.size(); i++) {
+            out[i][n] = shs::proto::get(p, State::fields[i]);
+        }
+    }
+}
+
+template <typename Decode>
+double time_ns(Decode decode, std::size_t count, int rounds)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) decode();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / (double(count) * rounds);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    std::size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 1000000;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    std::vector<std::uint8_t> frames(count * State::size);
+    std::mt19937 rng(1);
+    for (auto& b : frames) b = static_cast<std::uint8_t>(rng());
+
+    Output want(count);
+    decode_naive(frames.data(), count, want.cols);
+
+    struct Run {
+        const char* name;
+        shs::Isa isa;
+        bool naive;
+    };
+    const Run runs[] = {
+        {"naive", shs::Isa::scalar, true},
+        {"scalar", shs::Isa::scalar, false},
+        {"ssse3", shs::Isa::ssse3, false},
+        {"avx2", shs::Isa::avx2, false},
+    };
+
+    static_assert(shs::column_of<Layout, State::bits::tempr>() == 8);
+
+    std::printf("%zu frames x %d rounds, best ISA %d\n", count, rounds, int(shs::best_isa()));
+    double base = 0;
+    int status = 0;
+    for (const Run& run : runs) {
+        if (run.isa > shs::best_isa()) {
+            std::printf("%-8s unsupported\n", run.name);
+            continue;
+        }
+
+        Output got(count);
+        auto decode = [&] {
+            if (run.naive) {
+                decode_naive(frames.data(), count, got.cols);
+            } else {
+                shs::decode_batch<Layout>(frames.data(), count, got.cols, run.isa);
+            }
+        };
+
+        decode();
+        for (std::size_t i = 0; i < Layout::count; i++) {
+            if (std::memcmp(got.cols[i], want.cols[i], count) != 0) {
+                std::printf("%-8s MISMATCH in field %s\n", run.name, State::fields[i].name);
+                status = 1;
+            }
+        }
+
+        double ns = time_ns(decode, count, rounds);
+        if (run.naive) base = ns;
+        std::printf("%-8s %6.3f ns/frame  %5.1fx\n", run.name, ns, base / ns);
+    }
+    return status;
+}
@@ -0,0 +1,199 @@
+// bench_fanout.cpp - Long-poll fan-out of device state to many loopback viewers.
+//
+// A publisher thread runs state broadcasts for a few homes through a Gateway whose only
+// subscriber is a StateFeed. Viewers connect to the LongPollServer on loopback, each
+// watching one home, and re-poll with the version they last saw. The run is repeated for
+// growing viewer counts: rendered responses track the device traffic and stay the same,
+// while only the socket writes grow with the viewers. Every viewer must end on each home's
+// final version, with the versions it saw strictly increasing.
+//
+//   bench_fanout [homes] [updates per home] [max viewers]
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "shs/fanout.hpp"
+
+namespace {
+
+using namespace shs;
+
+struct Viewer {
+    int fd;
+    std::uint32_t home;
+    std::uint64_t version = 0;
+    std::string in;
+    bool ok = true;
+};
+
+void request(Viewer& v)
+{
+    std::string req = "GET /state/" + std::to_string(v.home) + "?since=" + std::to_string(v.version) +
+                      " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    if (::send(v.fd, req.data(), req.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(req.size())) {
+        v.ok = false;
+    }
+}
+
+// Consume whole responses from v.in; returns how many there were.
+std::size_t take_responses(Viewer& v)
+{
+    std::size_t count = 0;
+    for (;;) {
+        std::size_t head = v.in.find("\r\n\r\n");
+        if (head == std::string::npos) return count;
+        std::size_t cl = v.in.find("Content-Length: ");
+        if (cl == std::string::npos || cl > head) {
+            v.ok = false;
+            return count;
+        }
+        std::size_t body_len = std::strtoul(v.in.c_str() + cl + 16, nullptr, 10);
+        if (v.in.size() < head + 4 + body_len) return count;
+
+        if (v.in.starts_with("HTTP/1.1 200")) {
+            std::size_t at = v.in.find("\"version\":", head);
+            std::uint64_t version = std::strtoull(v.in.c_str() + at + 10, nullptr, 10);
+            if (at == std::string::npos || version <= v.version) v.ok = false;
+            v.version = version;
+        } else if (!v.in.starts_with("HTTP/1.1 204")) {
+            v.ok = false;
+        }
+        v.in.erase(0, head + 4 + body_len);
+        count++;
+    }
+}
+
+void publish_updates(Gateway& gateway, std::size_t homes, std::size_t updates)
+{
+    std::vector<Link> links;
+    for (std::size_t h = 0; h < homes; h++) links.emplace_back(static_cast<std::uint32_t>(h));
+
+    for (std::size_t i = 0; i < updates; i++) {
+        for (std::size_t h = 0; h < homes; h++) {
+            // A state broadcast whose setpoint moves every update, so each one is a delta.
+            std::uint8_t frame[] = {proto::XbeeStateFrame::header[0], 0x20,
+                                    static_cast<std::uint8_t>(60 + (i + h) % 20), 45};
+            gateway.receive(links[h], [&](std::span<std::uint8_t> buf) {
+                std::memcpy(buf.data(), frame, sizeof frame);
+                return sizeof frame;
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    std::size_t homes = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 8;
+    std::size_t updates = argc > 2 ? std::strtoul(argv[2], nullptr, 0) : 2000;
+    std::size_t max_viewers = argc > 3 ? std::strtoul(argv[3], nullptr, 0) : 1000;
+
+    std::printf("%zu homes, %zu updates each\n", homes, updates);
+    int status = 0;
+
+    for (std::size_t viewers = 1; viewers <= max_viewers; viewers *= 10) {
+        StateFeed feed(homes);
+        LongPollServer server(feed, 0, 1);
+        BlockPool blocks;
+        Gateway gateway(homes, blocks);
+        gateway.subscribe(feed);
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(server.port());
+
+        int ep = ::epoll_create1(EPOLL_CLOEXEC);
+        std::vector<Viewer> vs(viewers);
+        for (std::size_t i = 0; i < viewers; i++) {
+            Viewer& v = vs[i];
+            v.home = static_cast<std::uint32_t>(i % homes);
+            v.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (v.fd < 0 || ::connect(v.fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0) {
+                std::perror("bench_fanout: connect");
+                return 1;
+            }
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = i;
+            ::epoll_ctl(ep, EPOLL_CTL_ADD, v.fd, &ev);
+            request(v);
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        std::thread publisher(publish_updates, std::ref(gateway), homes, updates);
+
+        // Read until every viewer has seen its home's last version.
+        std::size_t received = 0;
+        std::size_t done = 0;
+        auto finished = [&](const Viewer& v) { return v.version == updates; };
+        epoll_event events[256];
+        while (done < viewers) {
+            int n = ::epoll_wait(ep, events, 256, 5000);
+            if (n == 0) {
+                std::printf("%5zu viewers  TIMEOUT: %zu viewers never saw the last version\n",
+                            viewers, viewers - done);
+                status = 1;
+                break;
+            }
+            for (int e = 0; e < n; e++) {
+                Viewer& v = vs[events[e].data.u64];
+                char buf[4096];
+                ssize_t got = ::recv(v.fd, buf, sizeof buf, MSG_DONTWAIT);
+                if (got <= 0) {
+                    if (got < 0 && errno == EAGAIN) continue;
+                    v.ok = false;
+                    ::epoll_ctl(ep, EPOLL_CTL_DEL, v.fd, nullptr);
+                    done++;
+                    continue;
+                }
+                v.in.append(buf, static_cast<std::size_t>(got));
+                bool was_done = finished(v);
+                std::size_t r = take_responses(v);
+                received += r;
+                if (!was_done && finished(v)) {
+                    ::epoll_ctl(ep, EPOLL_CTL_DEL, v.fd, nullptr);
+                    done++;
+                } else if (r) {
+                    request(v);
+                }
+            }
+        }
+        publisher.join();
+        auto t1 = std::chrono::steady_clock::now();
+
+        double secs = std::chrono::duration<double>(t1 - t0).count();
+        LongPollServer::Stats s = server.stats();
+        std::size_t bad = static_cast<std::size_t>(
+            std::count_if(vs.begin(), vs.end(), [](const Viewer& v) { return !v.ok; }));
+        std::printf("%5zu viewers  %6llu device deltas  %6llu rendered  %8llu responses"
+                    "  %7.1f per render  %8.0f responses/s\n",
+                    viewers, static_cast<unsigned long long>(gateway.stats().deltas),
+                    static_cast<unsigned long long>(feed.rendered()),
+                    static_cast<unsigned long long>(s.responses),
+                    double(s.shared) / double(feed.rendered()), double(received) / secs);
+        if (bad) {
+            std::printf("%5zu viewers  MISMATCH: %zu viewers saw versions out of order\n", viewers, bad);
+            status = 1;
+        }
+
+        for (Viewer& v : vs) ::close(v.fd);
+        ::close(ep);
+    }
+    return status;
+}
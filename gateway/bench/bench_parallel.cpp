@@ -0,0 +1,180 @@
+// bench_parallel.cpp - Gateway throughput against worker count under a synthetic many-home load.
+//
+// Every home has a stream of state commands, state broadcasts and sensor samples. The main
+// thread plays the reactor: each round it makes a burst of every home's stream readable and
+// tells the gateway, which drains the connections on its shard strands. Each home's deltas
+// are folded into an order-sensitive hash and compared with a single-threaded Gateway, so any
+// reordering within a device shows up as a mismatch.
+//
+//   bench_parallel [homes] [kilobytes per home] [max threads]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "shs/parallel.hpp"
+
+namespace {
+
+using namespace shs;
+
+std::vector<std::uint8_t> make_stream(std::size_t size, std::mt19937& rng)
+{
+    std::vector<std::uint8_t> out;
+    auto state = [&] {
+        out.push_back(static_cast<std::uint8_t>(0x20 | (rng() % 8)));
+        out.push_back(static_cast<std::uint8_t>(66 + rng() % 8));
+        out.push_back(static_cast<std::uint8_t>(40 + rng() % 4));
+    };
+    while (out.size() < size) {
+        switch (rng() % 3) {
+        case 0:
+            out.insert(out.end(), proto::ImpStateFrame::header.begin(),
+                       proto::ImpStateFrame::header.end());
+            state();
+            break;
+        case 1:
+            out.push_back(proto::XbeeStateFrame::header[0]);
+            state();
+            break;
+        default:
+            out.push_back(proto::XbeeLegacyFrame::header[0]);
+            out.push_back(static_cast<std::uint8_t>(60 + rng() % 16));
+            out.push_back(static_cast<std::uint8_t>(30 + rng() % 16));
+            break;
+        }
+    }
+    return out;
+}
+
+// A home's stream, released to the gateway a burst at a time. Reads return at most 256
+// bytes, about what a serial port delivers per wake-up.
+class ReplaySource : public Source {
+public:
+    explicit ReplaySource(const std::vector<std::uint8_t>& data) : data_(data) {}
+
+    void release(std::size_t n)
+    {
+        std::size_t end = end_.load(std::memory_order_relaxed);
+        end_.store(std::min(data_.size(), end + n), std::memory_order_release);
+    }
+
+    bool done() const { return end_.load(std::memory_order_relaxed) == data_.size(); }
+
+    std::ptrdiff_t read(std::span<std::uint8_t> buf) override
+    {
+        std::size_t end = end_.load(std::memory_order_acquire);
+        std::size_t n = std::min({end - pos_, buf.size(), std::size_t(256)});
+        if (n == 0) return -1;
+        std::memcpy(buf.data(), data_.data() + pos_, n);
+        pos_ += n;
+        return static_cast<std::ptrdiff_t>(n);
+    }
+
+private:
+    const std::vector<std::uint8_t>& data_;
+    std::atomic<std::size_t> end_{0};
+    std::size_t pos_ = 0;   // Only touched by the home's shard
+};
+
+// Folds each home's deltas into a hash that depends on their order. Each home's slot is only
+// written from its own shard.
+class OrderHash : public Subscriber {
+public:
+    explicit OrderHash(std::size_t homes) : hash(homes) {}
+
+    std::vector<std::uint64_t> hash;
+
+    void publish(std::span<const StateDelta> deltas) override
+    {
+        for (const StateDelta& d : deltas) {
+            std::uint64_t h = hash[d.device];
+            h = h * 1099511628211ull + static_cast<std::uint8_t>(d.kind);
+            for (std::uint8_t b : d.payload) h = h * 1099511628211ull + b;
+            hash[d.device] = h;
+        }
+    }
+};
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    std::size_t homes = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 10000;
+    std::size_t kb = argc > 2 ? std::strtoul(argv[2], nullptr, 0) : 4;
+    std::size_t max_threads = argc > 3 ? std::strtoul(argv[3], nullptr, 0)
+                                       : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::vector<std::uint8_t>> streams;
+    std::mt19937 rng(9);
+    for (std::size_t h = 0; h < homes; h++) streams.push_back(make_stream(kb << 10, rng));
+
+    // Reference: one gateway, one home at a time.
+    OrderHash want(homes);
+    std::uint64_t frames = 0;
+    {
+        BlockPool pool;
+        Gateway gateway(homes, pool);
+        gateway.subscribe(want);
+        for (std::size_t h = 0; h < homes; h++) {
+            ReplaySource src(streams[h]);
+            src.release(streams[h].size());
+            Link link(static_cast<std::uint32_t>(h));
+            while (gateway.receive(link, src) > 0) {
+            }
+        }
+        frames = gateway.stats().frames;
+    }
+    std::printf("%zu homes, %zu KB each, %llu frames\n", homes, kb,
+                static_cast<unsigned long long>(frames));
+
+    int status = 0;
+    double base = 0;
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+        std::vector<std::unique_ptr<ReplaySource>> sources;
+        std::vector<std::unique_ptr<Connection>> conns;
+        for (std::size_t h = 0; h < homes; h++) {
+            sources.push_back(std::make_unique<ReplaySource>(streams[h]));
+            conns.push_back(std::make_unique<Connection>(static_cast<std::uint32_t>(h), *sources[h]));
+        }
+
+        ThreadPool pool(threads);
+        ParallelGateway gateway(homes, pool);
+        OrderHash got(homes);
+        gateway.subscribe(got);
+
+        std::mt19937 burst(1);
+        auto t0 = std::chrono::steady_clock::now();
+        for (bool more = true; more;) {
+            more = false;
+            for (std::size_t h = 0; h < homes; h++) {
+                if (sources[h]->done()) continue;
+                sources[h]->release(256 + burst() % 768);
+                gateway.readable(*conns[h]);
+                more = true;
+            }
+        }
+        gateway.wait();
+        auto t1 = std::chrono::steady_clock::now();
+
+        double secs = std::chrono::duration<double>(t1 - t0).count();
+        double rate = double(gateway.stats().frames) / secs;
+        if (base == 0) base = rate;
+        ThreadPool::Stats ps = pool.stats();
+        std::printf("%2zu threads  %6.2f M frames/s  %5.2fx  %llu tasks, %llu stolen\n", threads,
+                    rate / 1e6, rate / base, static_cast<unsigned long long>(ps.executed),
+                    static_cast<unsigned long long>(ps.stolen));
+
+        if (gateway.stats().frames != frames || got.hash != want.hash) {
+            std::printf("%2zu threads  MISMATCH: frames or per-home delta order differ\n", threads);
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,268 @@
+// bench_pipeline.cpp - Heap allocations and time per frame through parse, update and publish.
+//
+// Each simulated home sends a stream of state commands, state broadcasts and sensor samples,
+// delivered in reads of random size as a serial port or socket would. The streams run through
+//   copying - a pipeline that copies each hop into its own vectors, as the agent path does
+//   arena   - shs::Gateway, passing views of arena-held receive buffers between stages
+// after one warm-up pass. Operator new is counted, so the arena row should show no
+// allocations per frame.
+//
+//   bench_pipeline [homes] [kilobytes per home] [passes]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "shs/pipeline.hpp"
+
+namespace {
+
+std::atomic<std::uint64_t> allocations{0};
+
+}  // namespace
+
+void* operator new(std::size_t n)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+using namespace shs;
+
+std::vector<std::uint8_t> make_stream(std::size_t size, std::mt19937& rng)
+{
+    std::vector<std::uint8_t> out;
+    // Homes mostly repeat a few states, so many frames change nothing.
+    auto state = [&] {
+        out.push_back(static_cast<std::uint8_t>(0x20 | (rng() % 4)));
+        out.push_back(static_cast<std::uint8_t>(68 + rng() % 4));
+        out.push_back(static_cast<std::uint8_t>(40 + rng() % 3));
+    };
+    while (out.size() < size) {
+        switch (rng() % 4) {
+        case 0:
+            out.insert(out.end(), proto::ImpStateFrame::header.begin(),
+                       proto::ImpStateFrame::header.end());
+            state();
+            break;
+        case 1:
+            out.push_back(proto::XbeeStateFrame::header[0]);
+            state();
+            break;
+        case 2:
+            out.push_back(proto::XbeeLegacyFrame::header[0]);
+            out.push_back(static_cast<std::uint8_t>(65 + rng() % 8));
+            out.push_back(static_cast<std::uint8_t>(35 + rng() % 10));
+            break;
+        default:
+            out.push_back(proto::XbeePollFrame::header[0]);   // Traffic the gateway skips
+            out.push_back(static_cast<std::uint8_t>(rng() % 4));
+            out.push_back(static_cast<std::uint8_t>(rng() & 0x7F));
+            break;
+        }
+    }
+    return out;
+}
+
+// Feeds every home's stream in reads of 1 to 256 bytes, visiting homes in turn.
+struct Wire {
+    std::vector<std::vector<std::uint8_t>> streams;
+    std::vector<std::size_t> pos;
+
+    template <typename Read>
+    void replay(Read read)
+    {
+        pos.assign(streams.size(), 0);
+        std::mt19937 rng(11);
+        for (bool more = true; more;) {
+            more = false;
+            for (std::size_t h = 0; h < streams.size(); h++) {
+                std::size_t left = streams[h].size() - pos[h];
+                if (!left) continue;
+                std::size_t n = std::min<std::size_t>(left, 1 + rng() % 256);
+                read(h, streams[h].data() + pos[h], n);
+                pos[h] += n;
+                more = true;
+            }
+        }
+    }
+};
+
+struct Totals {
+    std::uint64_t deltas = 0;
+    std::uint64_t sum = 0;   // Keeps the payload reads from being optimised away
+};
+
+class CountingSubscriber : public Subscriber {
+public:
+    Totals totals;
+
+    void publish(std::span<const StateDelta> deltas) override
+    {
+        for (const StateDelta& d : deltas) {
+            totals.deltas++;
+            totals.sum += d.device + d.payload[0];
+        }
+    }
+};
+
+// The copying pipeline: every stage owns copies of what it was given.
+class CopyingPipeline {
+public:
+    struct Frame {
+        std::uint32_t device;
+        FrameKind kind;
+        std::vector<std::uint8_t> payload;
+    };
+    struct Delta {
+        std::uint32_t device;
+        FrameKind kind;
+        std::vector<std::uint8_t> payload;
+    };
+
+    explicit CopyingPipeline(std::size_t homes) : carry_(homes), last_(homes) {}
+
+    Totals totals;
+
+    void receive(std::uint32_t device, const std::uint8_t* data, std::size_t n)
+    {
+        std::vector<std::uint8_t> bytes = carry_[device];
+        bytes.insert(bytes.end(), data, data + n);
+        carry_[device].clear();
+
+        std::vector<Frame> frames;
+        for (std::size_t pos = 0; pos < bytes.size();) {
+            FrameMatch m = match_frame(bytes.data() + pos, bytes.size() - pos);
+            if (m.len < 0) {
+                carry_[device].assign(bytes.begin() + static_cast<std::ptrdiff_t>(pos), bytes.end());
+                break;
+            }
+            if (m.len == 0) {
+                pos++;
+                continue;
+            }
+            const std::uint8_t* p = bytes.data() + pos + header_size(m.kind);
+            frames.push_back({device, m.kind, std::vector<std::uint8_t>(p, p + payload_size(m.kind))});
+            pos += static_cast<std::size_t>(m.len);
+        }
+
+        std::vector<Delta> deltas;
+        for (const Frame& f : frames) {
+            auto& last = last_[f.device][static_cast<std::size_t>(f.kind)];
+            if (last == f.payload) continue;
+            last = f.payload;
+            deltas.push_back({f.device, f.kind, f.payload});
+        }
+
+        for (const Delta& d : deltas) {
+            totals.deltas++;
+            totals.sum += d.device + d.payload[0];
+        }
+    }
+
+private:
+    std::vector<std::vector<std::uint8_t>> carry_;
+    std::vector<std::array<std::vector<std::uint8_t>, frame_kinds>> last_;
+};
+
+struct Result {
+    double ns_per_frame;
+    double allocs_per_frame;
+};
+
+template <typename Pass>
+Result measure(Pass pass, int passes, std::uint64_t frames)
+{
+    pass();   // Warm up pools and state
+    std::uint64_t before = allocations.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < passes; i++) pass();
+    auto t1 = std::chrono::steady_clock::now();
+    double total = double(frames) * passes;
+    return {std::chrono::duration<double, std::nano>(t1 - t0).count() / total,
+            double(allocations.load() - before) / total};
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    std::size_t homes = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 1000;
+    std::size_t kb = argc > 2 ? std::strtoul(argv[2], nullptr, 0) : 16;
+    int passes = argc > 3 ? std::atoi(argv[3]) : 3;
+
+    Wire wire;
+    std::mt19937 rng(5);
+    for (std::size_t h = 0; h < homes; h++) wire.streams.push_back(make_stream(kb << 10, rng));
+
+    BlockPool pool;
+    Gateway gateway(homes, pool);
+    CountingSubscriber sub;
+    gateway.subscribe(sub);
+    std::vector<Link> links;
+    for (std::size_t h = 0; h < homes; h++) links.emplace_back(static_cast<std::uint32_t>(h));
+
+    CopyingPipeline copying(homes);
+
+    auto arena_pass = [&] {
+        wire.replay([&](std::size_t h, const std::uint8_t* p, std::size_t n) {
+            gateway.receive(links[h], [&](std::span<std::uint8_t> buf) {
+                std::memcpy(buf.data(), p, n);   // Stands in for read(2)
+                return n;
+            });
+        });
+    };
+    auto copying_pass = [&] {
+        wire.replay([&](std::size_t h, const std::uint8_t* p, std::size_t n) {
+            copying.receive(static_cast<std::uint32_t>(h), p, n);
+        });
+    };
+
+    // Every pass carries the same frames; count them from a throwaway gateway.
+    std::uint64_t frames = 0;
+    {
+        BlockPool p;
+        Gateway g(homes, p);
+        std::vector<Link> l(links);
+        wire.replay([&](std::size_t h, const std::uint8_t* data, std::size_t n) {
+            g.receive(l[h], [&](std::span<std::uint8_t> buf) {
+                std::memcpy(buf.data(), data, n);
+                return n;
+            });
+        });
+        frames = g.stats().frames;
+    }
+    std::printf("%zu homes, %zu bytes, %llu frames per pass\n", homes, homes * (kb << 10),
+                static_cast<unsigned long long>(frames));
+
+    Result c = measure(copying_pass, passes, frames);
+    std::printf("copying  %7.1f ns/frame  %6.2f allocations/frame\n", c.ns_per_frame,
+                c.allocs_per_frame);
+    std::size_t blocks = 0;
+    Result a = measure([&] { arena_pass(); blocks = blocks ? blocks : pool.blocks(); }, passes,
+                       frames);
+    std::printf("arena    %7.1f ns/frame  %6.2f allocations/frame  %zu pool blocks\n",
+                a.ns_per_frame, a.allocs_per_frame, pool.blocks());
+
+    int status = 0;
+    if (copying.totals.deltas != sub.totals.deltas || copying.totals.sum != sub.totals.sum) {
+        std::printf("pipelines published different deltas\n");
+        status = 1;
+    }
+    if (a.allocs_per_frame != 0 || pool.blocks() != blocks) {
+        std::printf("arena pipeline allocated in steady state\n");
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,166 @@
+// bench_scan.cpp - Compare the vector capture scans against the byte at a time state machine.
+//
+// Builds a synthetic capture of Imp state commands, controller state broadcasts and legacy
+// sensor samples separated by runs of other traffic, then scans it with each instruction set.
+// Every scan must find the same frames as the state machine, in one pass and when the capture
+// arrives in odd sized chunks. The Imp state payloads are then split into columns with
+// decode_batch() to time the whole ingest.
+//
+//   bench_scan [megabytes] [rounds] [gap]
+//
+// "gap" is the longest run of other traffic between frames (default 48); raise it to see the
+// scan rate of sparse captures.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "shs/codec.hpp"
+#include "shs/frames.hpp"
+#include "shs/scan.hpp"
+
+namespace {
+
+using namespace shs;
+
+std::vector<std::uint8_t> make_capture(std::size_t size, unsigned gap)
+{
+    std::vector<std::uint8_t> out;
+    out.reserve(size + 64);
+    std::mt19937 rng(7);
+
+    auto state = [&] {
+        std::uint8_t p[proto::State::size] = {static_cast<std::uint8_t>(rng()),
+                                              static_cast<std::uint8_t>(rng() & 0x7F),
+                                              static_cast<std::uint8_t>(rng() % 101)};
+        out.insert(out.end(), p, p + sizeof p);
+    };
+
+    while (out.size() < size) {
+        switch (rng() % 8) {
+        case 0:
+        case 1:
+            out.insert(out.end(), proto::ImpStateFrame::header.begin(),
+                       proto::ImpStateFrame::header.end());
+            state();
+            break;
+        case 2:
+        case 3:
+            out.push_back(proto::XbeeStateFrame::header[0]);
+            state();
+            break;
+        case 4:
+            out.push_back(proto::XbeeLegacyFrame::header[0]);
+            out.push_back(static_cast<std::uint8_t>(rng() & 0x7F));
+            out.push_back(static_cast<std::uint8_t>(rng() % 101));
+            break;
+        default:
+            // Other traffic: polls, batches, status replies and line noise.
+            for (unsigned n = 1 + rng() % gap; n; n--) {
+                out.push_back(static_cast<std::uint8_t>(rng()));
+            }
+            break;
+        }
+    }
+    return out;
+}
+
+bool same(const Capture& a, const Capture& b)
+{
+    if (a.invalid != b.invalid) return false;
+    for (std::size_t k = 0; k < frame_kinds; k++) {
+        if (a.frames[k].offset != b.frames[k].offset) return false;
+        if (a.frames[k].payload != b.frames[k].payload) return false;
+    }
+    return true;
+}
+
+Capture scan_chunked(const std::vector<std::uint8_t>& data, Isa isa)
+{
+    Capture out;
+    CaptureReader reader(out, isa);
+    std::mt19937 rng(3);
+    for (std::size_t pos = 0; pos < data.size();) {
+        std::size_t n = std::min<std::size_t>(1 + rng() % 4099, data.size() - pos);
+        reader.feed(data.data() + pos, n);
+        pos += n;
+    }
+    reader.finish();
+    return out;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    std::size_t mb = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 64;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+    unsigned gap = argc > 3 ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 0)) : 48;
+
+    std::vector<std::uint8_t> data = make_capture(mb << 20, gap ? gap : 1);
+
+    Capture want;
+    {
+        CaptureReader reader(want, Isa::scalar);
+        reader.feed(data.data(), data.size());
+        reader.finish();
+    }
+    std::printf("%zu bytes: %zu imp state, %zu xbee state, %zu legacy, %llu invalid headers\n",
+                data.size(), want.count(FrameKind::imp_state), want.count(FrameKind::xbee_state),
+                want.count(FrameKind::xbee_legacy), static_cast<unsigned long long>(want.invalid));
+
+    const struct {
+        const char* name;
+        Isa isa;
+    } runs[] = {{"scalar", Isa::scalar}, {"sse2", Isa::ssse3}, {"avx2", Isa::avx2}};
+
+    int status = 0;
+    double base = 0;
+    for (const auto& run : runs) {
+        if (run.isa > best_isa()) {
+            std::printf("%-8s unsupported\n", run.name);
+            continue;
+        }
+        if (!same(scan_chunked(data, run.isa), want)) {
+            std::printf("%-8s MISMATCH\n", run.name);
+            status = 1;
+            continue;
+        }
+
+        Capture got;
+        using Layout = proto::State::layout;
+        std::vector<std::uint8_t> store;
+        double scan_s = 0, total_s = 0;
+        for (int r = 0; r < rounds; r++) {
+            got.clear();
+            auto t0 = std::chrono::steady_clock::now();
+            CaptureReader reader(got, run.isa);
+            reader.feed(data.data(), data.size());
+            reader.finish();
+            auto t1 = std::chrono::steady_clock::now();
+
+            std::size_t n = got.count(FrameKind::imp_state);
+            store.resize(n * Layout::count);
+            Columns<Layout> cols;
+            for (std::size_t i = 0; i < Layout::count; i++) cols[i] = store.data() + i * n;
+            decode_batch<Layout>(got[FrameKind::imp_state].payload.data(), n, cols, run.isa);
+            auto t2 = std::chrono::steady_clock::now();
+
+            scan_s += std::chrono::duration<double>(t1 - t0).count();
+            total_s += std::chrono::duration<double>(t2 - t0).count();
+        }
+        if (!same(got, want)) {
+            std::printf("%-8s MISMATCH\n", run.name);
+            status = 1;
+            continue;
+        }
+
+        double gbps = double(data.size()) * rounds / scan_s / 1e9;
+        if (base == 0) base = gbps;
+        std::printf("%-8s scan %6.2f GB/s  %5.1fx   scan+decode %6.2f GB/s\n", run.name, gbps,
+                    gbps / base, double(data.size()) * rounds / total_s / 1e9);
+    }
+    return status;
+}
@@ -0,0 +1,109 @@
+// arena.hpp - Pooled arenas for the gateway's receive buffers and per-batch records.
+//
+// A BlockPool hands out fixed size blocks and takes them back, so after warm-up a gateway
+// allocates nothing per frame. An Arena bump-allocates from pool blocks and releases them all
+// at once with reset(); everything made in an arena lives until then, which is what lets
+// parse, state update and publish pass views into received bytes instead of copies.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace shs {
+
+class BlockPool {
+public:
+    explicit BlockPool(std::size_t block_size = 64 * 1024) : block_size_(block_size) {}
+
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    std::size_t block_size() const { return block_size_; }
+
+    std::uint8_t* get()
+    {
+        if (free_.empty()) {
+            blocks_.push_back(std::make_unique<std::uint8_t[]>(block_size_));
+            free_.reserve(blocks_.size());
+            return blocks_.back().get();
+        }
+        std::uint8_t* b = free_.back();
+        free_.pop_back();
+        return b;
+    }
+
+    void put(std::uint8_t* b) { free_.push_back(b); }
+
+    // Blocks ever allocated; stays flat once the pool has warmed up.
+    std::size_t blocks() const { return blocks_.size(); }
+
+private:
+    std::size_t block_size_;
+    std::vector<std::unique_ptr<std::uint8_t[]>> blocks_;
+    std::vector<std::uint8_t*> free_;
+};
+
+class Arena {
+public:
+    explicit Arena(BlockPool& pool) : pool_(pool) {}
+    ~Arena() { reset(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Space for at least n bytes at the end of the arena. Bytes written there belong to the
+    // arena only once commit() is called, so a read can reserve more than it receives.
+    std::span<std::uint8_t> reserve(std::size_t n)
+    {
+        if (used_.empty() || top_ + n > pool_.block_size()) next_block(n);
+        return {used_.back() + top_, pool_.block_size() - top_};
+    }
+
+    void commit(std::size_t n) { top_ += n; }
+
+    std::uint8_t* alloc(std::size_t n, std::size_t align = alignof(std::max_align_t))
+    {
+        // Blocks come from operator new[], so aligning the offset aligns the pointer.
+        top_ = (top_ + align - 1) & ~(align - 1);
+        std::uint8_t* p = reserve(n).data();
+        top_ += n;
+        return p;
+    }
+
+    // Storage for n records, constructed by the caller. Nothing is destroyed on reset(), so
+    // records must be trivially destructible.
+    template <typename T>
+    T* alloc_array(std::size_t n)
+    {
+        static_assert(std::is_trivially_destructible_v<T>);
+        return reinterpret_cast<T*>(alloc(n * sizeof(T), alignof(T)));
+    }
+
+    // Give every block back to the pool. Views into the arena are invalid afterwards.
+    void reset()
+    {
+        for (std::uint8_t* b : used_) pool_.put(b);
+        used_.clear();
+        top_ = 0;
+    }
+
+private:
+    void next_block(std::size_t n)
+    {
+        if (n > pool_.block_size()) throw std::bad_alloc();
+        used_.push_back(pool_.get());
+        top_ = 0;
+    }
+
+    BlockPool& pool_;
+    std::vector<std::uint8_t*> used_;
+    std::size_t top_ = 0;
+};
+
+}  // namespace shs
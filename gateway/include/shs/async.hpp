@@ -0,0 +1,303 @@
+// async.hpp - Coroutine serial I/O for controller connections on a single-threaded reactor.
+//
+// Each exchange with a controller is written as a coroutine that reads like imp_poll() on
+// the controller itself: write a frame, then wait for its header and payload, with a
+// timeout where the firmware would give up on the UART. Whenever a read or write would
+// block the coroutine suspends, and the Reactor resumes it from its epoll loop once the
+// descriptor is ready or the deadline passes, so one thread runs thousands of them.
+//
+//   Task<void> status(Channel& ch)
+//   {
+//       co_await ch.write_frame(FrameKind::imp_state, request);
+//       std::uint8_t reply[3];
+//       if (co_await ch.read_reply(reply, 100ms) != sizeof reply) co_return;   // Timed out
+//       ...
+//   }
+//
+// Channels wrap any non-blocking stream descriptor: a pty, a serial port or a TCP socket.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <queue>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "shs/pipeline.hpp"
+
+struct epoll_event;
+
+namespace shs {
+
+// ---------- TASK ----------
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Resume whoever awaited the task, by symmetric transfer so long chains don't nest.
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T v) { value.emplace(std::move(v)); }
+    T result()
+    {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result()
+    {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+}  // namespace detail
+
+// A coroutine that starts when awaited and hands its result, or exception, to the awaiter.
+template <typename T = void>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::Promise<T>;
+
+    Task(Task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    Task& operator=(Task&& o) noexcept
+    {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    ~Task()
+    {
+        if (h_) h_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+    {
+        h_.promise().continuation = awaiter;
+        return h_;
+    }
+    T await_resume() { return h_.promise().result(); }
+
+private:
+    friend promise_type;
+
+    explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+    std::coroutine_handle<promise_type> h_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+}  // namespace detail
+
+// ---------- REACTOR ----------
+
+class Channel;
+
+class Reactor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        std::uint64_t polls = 0;      // epoll_wait calls
+        std::uint64_t resumes = 0;    // Coroutines resumed for I/O or a timer
+        std::uint64_t timeouts = 0;   // Waits that ended at their deadline
+    };
+
+    Reactor();
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    // Start a task that runs on its own; it is destroyed when it finishes.
+    void spawn(Task<void> task);
+
+    // Run until every spawned task has finished. Rethrows the first exception a spawned
+    // task let escape, once the others are done.
+    void run();
+
+    std::size_t tasks() const { return live_; }
+    const Stats& stats() const { return stats_; }
+
+    // co_await reactor.sleep(50ms);
+    auto sleep(Clock::duration d)
+    {
+        struct Awaiter {
+            Reactor& r;
+            Clock::time_point deadline;
+            Waiter w{};
+
+            bool await_ready() const { return Clock::now() >= deadline; }
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                w.h = h;
+                r.arm(w, deadline);
+            }
+            void await_resume() const {}
+        };
+        return Awaiter{*this, Clock::now() + d};
+    }
+
+private:
+    friend class Channel;
+
+    // A suspended coroutine and the timer, if any, that ends its wait.
+    struct Waiter {
+        std::coroutine_handle<> h;
+        std::uint64_t timer = 0;
+        bool timed_out = false;
+    };
+
+    struct Timer {
+        Clock::time_point deadline;
+        std::uint64_t id;
+        bool operator>(const Timer& o) const { return deadline > o.deadline; }
+    };
+
+    void arm(Waiter& w, Clock::time_point deadline);
+    void wake(Waiter& w);   // Cancels the waiter's timer and resumes it
+    void fire_timers();
+    int next_timeout();
+    void forget(Channel* ch);   // Drop a closed channel's events from the current batch
+
+    int epoll_fd_;
+    ::epoll_event* batch_ = nullptr;   // Events being handled by run()
+    int batch_len_ = 0;
+    std::size_t live_ = 0;
+    std::exception_ptr error_;
+    std::uint64_t next_timer_ = 1;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers_;
+    std::unordered_map<std::uint64_t, Waiter*> armed_;   // Timers not yet fired or cancelled
+    Stats stats_;
+};
+
+// ---------- CHANNEL ----------
+
+// A frame read from a channel, payload copied out of the receive buffer.
+struct Frame {
+    FrameKind kind;
+    std::array<std::uint8_t, max_payload> payload{};
+};
+
+class Channel {
+public:
+    using Duration = Reactor::Clock::duration;
+
+    // Takes ownership of fd and makes it non-blocking.
+    Channel(Reactor& reactor, int fd);
+    ~Channel();
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // The next valid frame, skipping noise as imp_poll() does; nullopt on timeout or EOF.
+    Task<std::optional<Frame>> read_frame(Duration timeout);
+
+    // Exactly out.size() bytes, such as a status reply. Returns the number read before the
+    // timeout or EOF, as usart_block_xbee() does.
+    Task<std::size_t> read_reply(std::span<std::uint8_t> out, Duration timeout);
+
+    // Drop whatever has been received so far, as imp_poll() does by toggling RXEN0, so a
+    // late reply to an earlier request is not taken for the next one.
+    void discard();
+
+    // Writes everything, waiting for the descriptor to drain as needed. Throws on error.
+    Task<void> write(std::span<const std::uint8_t> bytes);
+    Task<void> write_frame(FrameKind kind, std::span<const std::uint8_t> payload);
+
+    int fd() const { return fd_; }
+    bool eof() const { return eof_; }
+
+private:
+    friend class Reactor;
+
+    // Suspends until the descriptor may have more to give (or take), or until the deadline;
+    // resumes with false if the deadline passed.
+    struct Ready {
+        Channel& ch;
+        Reactor::Waiter*& slot;
+        bool& ready;
+        std::optional<Reactor::Clock::time_point> deadline;
+        Reactor::Waiter w{};
+
+        bool await_ready() const { return ready; }
+        void await_suspend(std::coroutine_handle<> h);
+        bool await_resume()
+        {
+            if (slot == &w) slot = nullptr;   // The deadline passed first
+            return !w.timed_out;
+        }
+    };
+
+    Ready readable(Reactor::Clock::time_point deadline) { return {*this, reader_, can_read_, deadline}; }
+    Ready writable() { return {*this, writer_, can_write_, std::nullopt}; }
+
+    void fill();   // Read what the descriptor has into in_
+    void events(std::uint32_t ev);
+
+    Reactor& reactor_;
+    int fd_;
+    bool socket_;   // Written with send(MSG_NOSIGNAL) rather than write()
+    std::vector<std::uint8_t> in_;
+    std::size_t head_ = 0;   // First unread byte of in_
+    bool eof_ = false;
+    bool can_read_ = true;
+    bool can_write_ = true;
+    Reactor::Waiter* reader_ = nullptr;
+    Reactor::Waiter* writer_ = nullptr;
+};
+
+}  // namespace shs
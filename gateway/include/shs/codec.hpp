@@ -0,0 +1,263 @@
+// codec.hpp - Compile-time frame codecs for the host gateway.
+//
+// A layout is described by types: BitField<Byte, Shift, Width> names the bits of one field and
+// Layout<Size, Fields...> groups the fields of a fixed-size payload. Because every position is a
+// template argument, get<Field>() and set<Field>() compile to a single load, shift and mask, and
+// decode_batch() builds its SIMD shuffle masks at compile time.
+//
+// The generated frames.hpp provides these types for every layout in protocol/frames.schema,
+// e.g. shs::proto::State::bits::heater and shs::proto::State::layout.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHS_X86 1
+#endif
+
+namespace shs {
+
+template <std::size_t Byte, unsigned Shift, unsigned Width>
+struct BitField {
+    static_assert(Width >= 1 && Shift + Width <= 8, "field must fit in one byte");
+
+    static constexpr std::size_t byte = Byte;
+    static constexpr unsigned shift = Shift;
+    static constexpr unsigned width = Width;
+    static constexpr std::uint8_t mask = static_cast<std::uint8_t>((1u << Width) - 1);
+};
+
+template <std::size_t Size, typename... Fields>
+struct Layout {
+    static_assert(((Fields::byte < Size) && ...), "field outside layout");
+
+    static constexpr std::size_t size = Size;
+    static constexpr std::size_t count = sizeof...(Fields);
+    using fields = std::tuple<Fields...>;
+
+    template <std::size_t I>
+    using field = std::tuple_element_t<I, fields>;
+};
+
+template <typename F>
+constexpr std::uint8_t get(const std::uint8_t* p)
+{
+    if constexpr (F::width == 8) {
+        return p[F::byte];
+    } else {
+        return static_cast<std::uint8_t>((p[F::byte] >> F::shift) & F::mask);
+    }
+}
+
+template <typename F>
+constexpr void set(std::uint8_t* p, std::uint8_t v)
+{
+    if constexpr (F::width == 8) {
+        p[F::byte] = v;
+    } else {
+        constexpr std::uint8_t bits = static_cast<std::uint8_t>(F::mask << F::shift);
+        p[F::byte] = static_cast<std::uint8_t>((p[F::byte] & ~bits) | ((v << F::shift) & bits));
+    }
+}
+
+// Columns of decoded fields: column I holds field I of every frame.
+template <typename L>
+using Columns = std::array<std::uint8_t*, L::count>;
+
+// Column index of field F in layout L.
+template <typename L, typename F>
+constexpr std::size_t column_of()
+{
+    return []<std::size_t... I>(std::index_sequence<I...>) {
+        std::size_t col = L::count;
+        ((std::is_same_v<typename L::template field<I>, F> ? (col = I) : 0), ...);
+        return col;
+    }(std::make_index_sequence<L::count>{});
+}
+
+namespace detail {
+
+template <typename L, std::size_t... I>
+inline void decode_one(const std::uint8_t* p, const Columns<L>& out, std::size_t n,
+                       std::index_sequence<I...>)
+{
+    ((out[I][n] = get<typename L::template field<I>>(p)), ...);
+}
+
+template <typename L>
+inline void decode_scalar(const std::uint8_t* frames, std::size_t count, const Columns<L>& out)
+{
+    for (std::size_t n = 0; n < count; n++) {
+        decode_one<L>(frames + n * L::size, out, n, std::make_index_sequence<L::count>{});
+    }
+}
+
+#ifdef SHS_X86
+
+// Sixteen frames of stride S span S 16-byte registers. For payload byte B, register R
+// contributes the lanes whose source byte (frame * S + B) falls inside it.
+template <std::size_t S, std::size_t B, std::size_t R>
+constexpr std::array<std::int8_t, 16> gather_mask()
+{
+    std::array<std::int8_t, 16> m{};
+    for (std::size_t lane = 0; lane < 16; lane++) {
+        std::size_t src = lane * S + B;
+        m[lane] = (src / 16 == R) ? static_cast<std::int8_t>(src % 16) : std::int8_t(-128);
+    }
+    return m;
+}
+
+template <std::size_t S, std::size_t B, std::size_t R>
+inline constexpr std::array<std::int8_t, 16> gather_mask_v = gather_mask<S, B, R>();
+
+template <std::size_t S, std::size_t B, std::size_t... R>
+__attribute__((target("ssse3"))) inline __m128i gather_byte_sse(const __m128i* regs,
+                                                                 std::index_sequence<R...>)
+{
+    __m128i v = _mm_setzero_si128();
+    ((v = _mm_or_si128(v, _mm_shuffle_epi8(regs[R], _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(gather_mask_v<S, B, R>.data()))))), ...);
+    return v;
+}
+
+template <typename F>
+__attribute__((target("ssse3"))) inline __m128i extract_sse(__m128i bytes)
+{
+    if constexpr (F::width == 8) {
+        return bytes;
+    } else {
+        // 16-bit shifts pull neighbouring bits into the top of each byte; the mask drops them.
+        __m128i v = F::shift ? _mm_srli_epi16(bytes, F::shift) : bytes;
+        return _mm_and_si128(v, _mm_set1_epi8(static_cast<char>(F::mask)));
+    }
+}
+
+template <typename L, std::size_t... I>
+__attribute__((target("ssse3"))) inline void decode_block_sse(const std::uint8_t* p,
+                                                              const Columns<L>& out, std::size_t n,
+                                                              std::index_sequence<I...>)
+{
+    __m128i regs[L::size];
+    for (std::size_t r = 0; r < L::size; r++) {
+        regs[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * r));
+    }
+    ((_mm_storeu_si128(reinterpret_cast<__m128i*>(out[I] + n),
+                       extract_sse<typename L::template field<I>>(
+                           gather_byte_sse<L::size, L::template field<I>::byte>(
+                               regs, std::make_index_sequence<L::size>{})))),
+     ...);
+}
+
+template <typename L>
+__attribute__((target("ssse3"))) inline void decode_ssse3(const std::uint8_t* frames,
+                                                          std::size_t count, const Columns<L>& out)
+{
+    std::size_t n = 0;
+    for (; n + 16 <= count; n += 16) {
+        decode_block_sse<L>(frames + n * L::size, out, n, std::make_index_sequence<L::count>{});
+    }
+    for (; n < count; n++) {
+        decode_one<L>(frames + n * L::size, out, n, std::make_index_sequence<L::count>{});
+    }
+}
+
+// AVX2 shuffles stay within 128-bit lanes, so each 256-bit register holds the same register
+// of two consecutive 16-frame blocks and reuses the SSE masks in both lanes.
+template <std::size_t S, std::size_t B, std::size_t... R>
+__attribute__((target("avx2"))) inline __m256i gather_byte_avx2(const __m256i* regs,
+                                                                 std::index_sequence<R...>)
+{
+    __m256i v = _mm256_setzero_si256();
+    ((v = _mm256_or_si256(v, _mm256_shuffle_epi8(regs[R], _mm256_broadcastsi128_si256(
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(gather_mask_v<S, B, R>.data())))))),
+     ...);
+    return v;
+}
+
+template <typename F>
+__attribute__((target("avx2"))) inline __m256i extract_avx2(__m256i bytes)
+{
+    if constexpr (F::width == 8) {
+        return bytes;
+    } else {
+        __m256i v = F::shift ? _mm256_srli_epi16(bytes, F::shift) : bytes;
+        return _mm256_and_si256(v, _mm256_set1_epi8(static_cast<char>(F::mask)));
+    }
+}
+
+template <typename L, std::size_t... I>
+__attribute__((target("avx2"))) inline void decode_block_avx2(const std::uint8_t* p,
+                                                              const Columns<L>& out, std::size_t n,
+                                                              std::index_sequence<I...>)
+{
+    const std::uint8_t* q = p + 16 * L::size;   // Second block of 16 frames
+    __m256i regs[L::size];
+    for (std::size_t r = 0; r < L::size; r++) {
+        regs[r] = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * r))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(q + 16 * r)), 1);
+    }
+    ((_mm256_storeu_si256(reinterpret_cast<__m256i*>(out[I] + n),
+                          extract_avx2<typename L::template field<I>>(
+                              gather_byte_avx2<L::size, L::template field<I>::byte>(
+                                  regs, std::make_index_sequence<L::size>{})))),
+     ...);
+}
+
+template <typename L>
+__attribute__((target("avx2"))) inline void decode_avx2(const std::uint8_t* frames,
+                                                        std::size_t count, const Columns<L>& out)
+{
+    std::size_t n = 0;
+    for (; n + 32 <= count; n += 32) {
+        decode_block_avx2<L>(frames + n * L::size, out, n, std::make_index_sequence<L::count>{});
+    }
+    for (; n < count; n++) {
+        decode_one<L>(frames + n * L::size, out, n, std::make_index_sequence<L::count>{});
+    }
+}
+
+#endif  // SHS_X86
+
+}  // namespace detail
+
+enum class Isa { scalar, ssse3, avx2 };
+
+// Best instruction set the running CPU supports.
+inline Isa best_isa()
+{
+#ifdef SHS_X86
+    static const Isa isa = __builtin_cpu_supports("avx2")    ? Isa::avx2
+                           : __builtin_cpu_supports("ssse3") ? Isa::ssse3
+                                                             : Isa::scalar;
+    return isa;
+#else
+    return Isa::scalar;
+#endif
+}
+
+// Decode "count" back-to-back payloads of layout L into one column per field.
+// Each column must have room for "count" bytes.
+template <typename L>
+void decode_batch(const std::uint8_t* frames, std::size_t count, const Columns<L>& out,
+                  Isa isa = best_isa())
+{
+#ifdef SHS_X86
+    // The SIMD paths gather sixteen frames from L::size registers.
+    if constexpr (L::size <= 16) {
+        if (isa == Isa::avx2) return detail::decode_avx2<L>(frames, count, out);
+        if (isa == Isa::ssse3) return detail::decode_ssse3<L>(frames, count, out);
+    }
+#endif
+    (void) isa;
+    detail::decode_scalar<L>(frames, count, out);
+}
+
+}  // namespace shs
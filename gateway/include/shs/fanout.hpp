@@ -0,0 +1,114 @@
+// fanout.hpp - Fan device state changes out to app viewers over loopback long-poll HTTP.
+//
+// StateFeed subscribes to the gateway. For every device that changed in a batch it renders
+// one complete HTTP response holding the device's whole state and keeps it as an immutable
+// shared buffer. LongPollServer parks each viewer's "GET /state/<device>?since=<version>"
+// until the device's version passes "since", then writes that same buffer to every waiting
+// viewer. The device's traffic and the rendering work are the same for one viewer or a
+// thousand; only the socket writes grow.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shs/pipeline.hpp"
+
+namespace shs {
+
+class StateFeed : public Subscriber {
+public:
+    struct Snapshot {
+        std::uint64_t version = 0;                       // 0 until the device is first heard
+        std::shared_ptr<const std::string> response;     // Complete HTTP response
+    };
+
+    explicit StateFeed(std::size_t devices);
+
+    // Safe to call from several gateway shards at once.
+    void publish(std::span<const StateDelta> deltas) override;
+
+    std::size_t devices() const { return slots_.size(); }
+    Snapshot latest(std::uint32_t device) const;
+
+    // Called with every device that changed since the last call; wakes the server.
+    void take_changed(std::vector<std::uint32_t>& out);
+
+    // Readable (as an eventfd) whenever take_changed() has something to return.
+    int notify_fd() const { return notify_fd_; }
+
+    // Responses rendered; one per device per batch that changed it.
+    std::uint64_t rendered() const { return rendered_.load(std::memory_order_relaxed); }
+
+    ~StateFeed() override;
+
+private:
+    struct Slot {
+        DeviceState state;   // Written only by the device's shard
+        Snapshot snap;       // Guarded by m_
+    };
+
+    std::shared_ptr<const std::string> render(std::uint32_t device, const Slot& slot,
+                                              std::uint64_t version) const;
+
+    std::vector<Slot> slots_;
+    mutable std::mutex m_;
+    std::vector<std::uint32_t> changed_;
+    int notify_fd_;
+    std::atomic<std::uint64_t> rendered_{0};
+};
+
+class LongPollServer {
+public:
+    struct Stats {
+        std::uint64_t connections = 0;
+        std::uint64_t responses = 0;   // Including timeouts and errors
+        std::uint64_t shared = 0;      // Responses written from a feed snapshot
+    };
+
+    // Listens on 127.0.0.1; port 0 picks a free one.
+    explicit LongPollServer(StateFeed& feed, std::uint16_t port = 0, int timeout_s = 25);
+    ~LongPollServer();
+
+    LongPollServer(const LongPollServer&) = delete;
+    LongPollServer& operator=(const LongPollServer&) = delete;
+
+    std::uint16_t port() const { return port_; }
+    Stats stats() const;
+
+private:
+    struct Client;
+
+    void run();
+    void accept_clients();
+    void read_request(Client& c);
+    void answer(Client& c, std::uint32_t device, std::uint64_t since);
+    // False once the viewer has gone and c has been closed.
+    bool send(Client& c, std::shared_ptr<const std::string> response);
+    bool flush(Client& c);
+    void close(Client& c);
+    void wake_device(std::uint32_t device);
+    void expire();
+
+    StateFeed& feed_;
+    int timeout_s_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int stop_fd_ = -1;
+    std::uint16_t port_ = 0;
+
+    std::vector<std::unique_ptr<Client>> clients_;            // Indexed by descriptor
+    std::vector<std::vector<int>> waiting_;                   // Parked descriptors per device
+    std::atomic<std::uint64_t> connections_{0};
+    std::atomic<std::uint64_t> responses_{0};
+    std::atomic<std::uint64_t> shared_{0};
+    std::thread thread_;
+};
+
+}  // namespace shs
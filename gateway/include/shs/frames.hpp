@@ -0,0 +1,599 @@
+// frames.hpp - Frame layouts for the host gateway.
+//
+// Generated by tools/gen_codec.py from protocol/frames.schema. Do not edit.
+//
+// Each layout has a table of Field descriptors and a struct with one byte per field.
+// unpack() and pack() are a fixed sequence of shifts and masks with no branches.
+// bits:: and layout describe the same fields as types for the compile-time codecs in
+// shs/codec.hpp.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "shs/codec.hpp"
+
+namespace shs::proto {
+
+struct Field {
+    const char* name;
+    std::uint8_t byte;
+    std::uint8_t shift;
+    std::uint8_t mask;
+};
+
+constexpr std::uint8_t get(const std::uint8_t* p, const Field& f)
+{
+    return static_cast<std::uint8_t>((p[f.byte] >> f.shift) & f.mask);
+}
+
+constexpr void set(std::uint8_t* p, const Field& f, std::uint8_t v)
+{
+    p[f.byte] = static_cast<std::uint8_t>((p[f.byte] & ~(f.mask << f.shift)) |
+                                          ((v & f.mask) << f.shift));
+}
+
+// ---------- state ----------
+
+struct State {
+    static constexpr std::size_t size = 3;
+    static constexpr std::array<Field, 12> fields{{
+        {"call_cool", 0, 0, 0x01},
+        {"ac_auto", 0, 1, 0x01},
+        {"fan", 0, 2, 0x01},
+        {"heater", 0, 3, 0x01},
+        {"cooler", 0, 4, 0x01},
+        {"lights", 0, 5, 0x01},
+        {"lights_auto", 0, 6, 0x01},
+        {"call_heat", 0, 7, 0x01},
+        {"tempr", 1, 0, 0x7F},
+        {"status_req", 1, 7, 0x01},
+        {"humid", 2, 0, 0x7F},
+        {"humid_on", 2, 7, 0x01},
+    }};
+
+    struct bits {
+        using call_cool = shs::BitField<0, 0, 1>;
+        using ac_auto = shs::BitField<0, 1, 1>;
+        using fan = shs::BitField<0, 2, 1>;
+        using heater = shs::BitField<0, 3, 1>;
+        using cooler = shs::BitField<0, 4, 1>;
+        using lights = shs::BitField<0, 5, 1>;
+        using lights_auto = shs::BitField<0, 6, 1>;
+        using call_heat = shs::BitField<0, 7, 1>;
+        using tempr = shs::BitField<1, 0, 7>;
+        using status_req = shs::BitField<1, 7, 1>;
+        using humid = shs::BitField<2, 0, 7>;
+        using humid_on = shs::BitField<2, 7, 1>;
+    };
+    using layout = shs::Layout<3, bits::call_cool, bits::ac_auto, bits::fan, bits::heater, bits::cooler, bits::lights, bits::lights_auto, bits::call_heat, bits::tempr, bits::status_req, bits::humid, bits::humid_on>;
+
+    std::uint8_t call_cool = 0;
+    std::uint8_t ac_auto = 0;
+    std::uint8_t fan = 0;
+    std::uint8_t heater = 0;
+    std::uint8_t cooler = 0;
+    std::uint8_t lights = 0;
+    std::uint8_t lights_auto = 0;
+    std::uint8_t call_heat = 0;
+    std::uint8_t tempr = 0;
+    std::uint8_t status_req = 0;
+    std::uint8_t humid = 0;
+    std::uint8_t humid_on = 0;
+
+    static constexpr State unpack(const std::uint8_t* p)
+    {
+        State v;
+        v.call_cool = static_cast<std::uint8_t>((p[0] >> 0) & 0x01);
+        v.ac_auto = static_cast<std::uint8_t>((p[0] >> 1) & 0x01);
+        v.fan = static_cast<std::uint8_t>((p[0] >> 2) & 0x01);
+        v.heater = static_cast<std::uint8_t>((p[0] >> 3) & 0x01);
+        v.cooler = static_cast<std::uint8_t>((p[0] >> 4) & 0x01);
+        v.lights = static_cast<std::uint8_t>((p[0] >> 5) & 0x01);
+        v.lights_auto = static_cast<std::uint8_t>((p[0] >> 6) & 0x01);
+        v.call_heat = static_cast<std::uint8_t>((p[0] >> 7) & 0x01);
+        v.tempr = static_cast<std::uint8_t>((p[1] >> 0) & 0x7F);
+        v.status_req = static_cast<std::uint8_t>((p[1] >> 7) & 0x01);
+        v.humid = static_cast<std::uint8_t>((p[2] >> 0) & 0x7F);
+        v.humid_on = static_cast<std::uint8_t>((p[2] >> 7) & 0x01);
+        return v;
+    }
+
+    constexpr void pack(std::uint8_t* p) const
+    {
+        p[0] = static_cast<std::uint8_t>(((call_cool & 0x01) << 0) | ((ac_auto & 0x01) << 1) | ((fan & 0x01) << 2) | ((heater & 0x01) << 3) | ((cooler & 0x01) << 4) | ((lights & 0x01) << 5) | ((lights_auto & 0x01) << 6) | ((call_heat & 0x01) << 7));
+        p[1] = static_cast<std::uint8_t>(((tempr & 0x7F) << 0) | ((status_req & 0x01) << 7));
+        p[2] = static_cast<std::uint8_t>(((humid & 0x7F) << 0) | ((humid_on & 0x01) << 7));
+    }
+};
+
+// ---------- aux ----------
+
+struct Aux {
+    static constexpr std::size_t size = 2;
+    static constexpr std::array<Field, 9> fields{{
+        {"device", 0, 0, 0x01},
+        {"ac_auto", 0, 1, 0x01},
+        {"fan", 0, 2, 0x01},
+        {"heater", 0, 3, 0x01},
+        {"cooler", 0, 4, 0x01},
+        {"lights", 0, 5, 0x01},
+        {"lights_auto", 0, 6, 0x01},
+        {"tempr", 1, 0, 0x7F},
+        {"status_req", 1, 7, 0x01},
+    }};
+
+    struct bits {
+        using device = shs::BitField<0, 0, 1>;
+        using ac_auto = shs::BitField<0, 1, 1>;
+        using fan = shs::BitField<0, 2, 1>;
+        using heater = shs::BitField<0, 3, 1>;
+        using cooler = shs::BitField<0, 4, 1>;
+        using lights = shs::BitField<0, 5, 1>;
+        using lights_auto = shs::BitField<0, 6, 1>;
+        using tempr = shs::BitField<1, 0, 7>;
+        using status_req = shs::BitField<1, 7, 1>;
+    };
+    using layout = shs::Layout<2, bits::device, bits::ac_auto, bits::fan, bits::heater, bits::cooler, bits::lights, bits::lights_auto, bits::tempr, bits::status_req>;
+
+    std::uint8_t device = 0;
+    std::uint8_t ac_auto = 0;
+    std::uint8_t fan = 0;
+    std::uint8_t heater = 0;
+    std::uint8_t cooler = 0;
+    std::uint8_t lights = 0;
+    std::uint8_t lights_auto = 0;
+    std::uint8_t tempr = 0;
+    std::uint8_t status_req = 0;
+
+    static constexpr Aux unpack(const std::uint8_t* p)
+    {
+        Aux v;
+        v.device = static_cast<std::uint8_t>((p[0] >> 0) & 0x01);
+        v.ac_auto = static_cast<std::uint8_t>((p[0] >> 1) & 0x01);
+        v.fan = static_cast<std::uint8_t>((p[0] >> 2) & 0x01);
+        v.heater = static_cast<std::uint8_t>((p[0] >> 3) & 0x01);
+        v.cooler = static_cast<std::uint8_t>((p[0] >> 4) & 0x01);
+        v.lights = static_cast<std::uint8_t>((p[0] >> 5) & 0x01);
+        v.lights_auto = static_cast<std::uint8_t>((p[0] >> 6) & 0x01);
+        v.tempr = static_cast<std::uint8_t>((p[1] >> 0) & 0x7F);
+        v.status_req = static_cast<std::uint8_t>((p[1] >> 7) & 0x01);
+        return v;
+    }
+
+    constexpr void pack(std::uint8_t* p) const
+    {
+        p[0] = static_cast<std::uint8_t>(((device & 0x01) << 0) | ((ac_auto & 0x01) << 1) | ((fan & 0x01) << 2) | ((heater & 0x01) << 3) | ((cooler & 0x01) << 4) | ((lights & 0x01) << 5) | ((lights_auto & 0x01) << 6));
+        p[1] = static_cast<std::uint8_t>(((tempr & 0x7F) << 0) | ((status_req & 0x01) << 7));
+    }
+};
+
+// ---------- sample ----------
+
+struct Sample {
+    static constexpr std::size_t size = 2;
+    static constexpr std::array<Field, 2> fields{{
+        {"tempr", 0, 0, 0x7F},
+        {"humid", 1, 0, 0x7F},
+    }};
+
+    struct bits {
+        using tempr = shs::BitField<0, 0, 7>;
+        using humid = shs::BitField<1, 0, 7>;
+    };
+    using layout = shs::Layout<2, bits::tempr, bits::humid>;
+
+    std::uint8_t tempr = 0;
+    std::uint8_t humid = 0;
+
+    static constexpr Sample unpack(const std::uint8_t* p)
+    {
+        Sample v;
+        v.tempr = static_cast<std::uint8_t>((p[0] >> 0) & 0x7F);
+        v.humid = static_cast<std::uint8_t>((p[1] >> 0) & 0x7F);
+        return v;
+    }
+
+    constexpr void pack(std::uint8_t* p) const
+    {
+        p[0] = static_cast<std::uint8_t>(((tempr & 0x7F) << 0));
+        p[1] = static_cast<std::uint8_t>(((humid & 0x7F) << 0));
+    }
+};
+
+// ---------- rule ----------
+
+struct Rule {
+    static constexpr std::size_t size = 4;
+    static constexpr std::array<Field, 5> fields{{
+        {"cmp", 0, 3, 0x03},
+        {"src", 0, 5, 0x07},
+        {"operand", 1, 0, 0xFF},
+        {"action", 2, 4, 0x0F},
+        {"arg", 3, 0, 0xFF},
+    }};
+
+    struct bits {
+        using cmp = shs::BitField<0, 3, 2>;
+        using src = shs::BitField<0, 5, 3>;
+        using operand = shs::BitField<1, 0, 8>;
+        using action = shs::BitField<2, 4, 4>;
+        using arg = shs::BitField<3, 0, 8>;
+    };
+    using layout = shs::Layout<4, bits::cmp, bits::src, bits::operand, bits::action, bits::arg>;
+
+    std::uint8_t cmp = 0;
+    std::uint8_t src = 0;
+    std::uint8_t operand = 0;
+    std::uint8_t action = 0;
+    std::uint8_t arg = 0;
+
+    static constexpr Rule unpack(const std::uint8_t* p)
+    {
+        Rule v;
+        v.cmp = static_cast<std::uint8_t>((p[0] >> 3) & 0x03);
+        v.src = static_cast<std::uint8_t>((p[0] >> 5) & 0x07);
+        v.operand = static_cast<std::uint8_t>((p[1] >> 0) & 0xFF);
+        v.action = static_cast<std::uint8_t>((p[2] >> 4) & 0x0F);
+        v.arg = static_cast<std::uint8_t>((p[3] >> 0) & 0xFF);
+        return v;
+    }
+
+    constexpr void pack(std::uint8_t* p) const
+    {
+        p[0] = static_cast<std::uint8_t>(((cmp & 0x03) << 3) | ((src & 0x07) << 5));
+        p[1] = static_cast<std::uint8_t>(((operand & 0xFF) << 0));
+        p[2] = static_cast<std::uint8_t>(((action & 0x0F) << 4));
+        p[3] = static_cast<std::uint8_t>(((arg & 0xFF) << 0));
+    }
+};
+
+// ---------- zone_map ----------
+
+struct ZoneMap {
+    static constexpr std::size_t size = 1;
+    static constexpr std::array<Field, 2> fields{{
+        {"weight", 0, 0, 0x0F},
+        {"zone", 0, 4, 0x03},
+    }};
+
+    struct bits {
+        using weight = shs::BitField<0, 0, 4>;
+        using zone = shs::BitField<0, 4, 2>;
+    };
+    using layout = shs::Layout<1, bits::weight, bits::zone>;
+
+    std::uint8_t weight = 0;
+    std::uint8_t zone = 0;
+
+    static constexpr ZoneMap unpack(const std::uint8_t* p)
+    {
+        ZoneMap v;
+        v.weight = static_cast<std::uint8_t>((p[0] >> 0) & 0x0F);
+        v.zone = static_cast<std::uint8_t>((p[0] >> 4) & 0x03);
+        return v;
+    }
+
+    constexpr void pack(std::uint8_t* p) const
+    {
+        p[0] = static_cast<std::uint8_t>(((weight & 0x0F) << 0) | ((zone & 0x03) << 4));
+    }
+};
+
+// ---------- telemetry ----------
+
+struct Telemetry {
+    static constexpr std::size_t size = 16;
+    static constexpr std::array<Field, 17> fields{{
+        {"polls_lo", 0, 0, 0xFF},
+        {"polls_hi", 1, 0, 0xFF},
+        {"samples_lo", 2, 0, 0xFF},
+        {"samples_hi", 3, 0, 0xFF},
+        {"timeouts_lo", 4, 0, 0xFF},
+        {"timeouts_hi", 5, 0, 0xFF},
+        {"spin_lo", 6, 0, 0xFF},
+        {"spin_hi", 7, 0, 0xFF},
+        {"poll_interval", 8, 0, 0xFF},
+        {"dups", 9, 0, 0xFF},
+        {"stack_free_lo", 10, 0, 0xFF},
+        {"stack_free_hi", 11, 0, 0xFF},
+        {"reset_reason", 12, 0, 0xFF},
+        {"reset_info", 13, 0, 0xFF},
+        {"resets", 14, 0, 0xFF},
+        {"lcd_faults", 15, 0, 0x7F},
+        {"lcd_offline", 15, 7, 0x01},
+    }};
+
+    struct bits {
+        using polls_lo = shs::BitField<0, 0, 8>;
+        using polls_hi = shs::BitField<1, 0, 8>;
+        using samples_lo = shs::BitField<2, 0, 8>;
+        using samples_hi = shs::BitField<3, 0, 8>;
+        using timeouts_lo = shs::BitField<4, 0, 8>;
+        using timeouts_hi = shs::BitField<5, 0, 8>;
+        using spin_lo = shs::BitField<6, 0, 8>;
+        using spin_hi = shs::BitField<7, 0, 8>;
+        using poll_interval = shs::BitField<8, 0, 8>;
+        using dups = shs::BitField<9, 0, 8>;
+        using stack_free_lo = shs::BitField<10, 0, 8>;
+        using stack_free_hi = shs::BitField<11, 0, 8>;
+        using reset_reason = shs::BitField<12, 0, 8>;
+        using reset_info = shs::BitField<13, 0, 8>;
+        using resets = shs::BitField<14, 0, 8>;
+        using lcd_faults = shs::BitField<15, 0, 7>;
+        using lcd_offline = shs::BitField<15, 7, 1>;
+    };
+    using layout = shs::Layout<16, bits::polls_lo, bits::polls_hi, bits::samples_lo, bits::samples_hi, bits::timeouts_lo, bits::timeouts_hi, bits::spin_lo, bits::spin_hi, bits::poll_interval, bits::dups, bits::stack_free_lo, bits::stack_free_hi, bits::reset_reason, bits::reset_info, bits::resets, bits::lcd_faults, bits::lcd_offline>;
+
+    std::uint8_t polls_lo = 0;
+    std::uint8_t polls_hi = 0;
+    std::uint8_t samples_lo = 0;
+    std::uint8_t samples_hi = 0;
+    std::uint8_t timeouts_lo = 0;
+    std::uint8_t timeouts_hi = 0;
+    std::uint8_t spin_lo = 0;
+    std::uint8_t spin_hi = 0;
+    std::uint8_t poll_interval = 0;
+    std::uint8_t dups = 0;
+    std::uint8_t stack_free_lo = 0;
+    std::uint8_t stack_free_hi = 0;
+    std::uint8_t reset_reason = 0;
+    std::uint8_t reset_info = 0;
+    std::uint8_t resets = 0;
+    std::uint8_t lcd_faults = 0;
+    std::uint8_t lcd_offline = 0;
+
+    static constexpr Telemetry unpack(const std::uint8_t* p)
+    {
+        Telemetry v;
+        v.polls_lo = static_cast<std::uint8_t>((p[0] >> 0) & 0xFF);
+        v.polls_hi = static_cast<std::uint8_t>((p[1] >> 0) & 0xFF);
+        v.samples_lo = static_cast<std::uint8_t>((p[2] >> 0) & 0xFF);
+        v.samples_hi = static_cast<std::uint8_t>((p[3] >> 0) & 0xFF);
+        v.timeouts_lo = static_cast<std::uint8_t>((p[4] >> 0) & 0xFF);
+        v.timeouts_hi = static_cast<std::uint8_t>((p[5] >> 0) & 0xFF);
+        v.spin_lo = static_cast<std::uint8_t>((p[6] >> 0) & 0xFF);
+        v.spin_hi = static_cast<std::uint8_t>((p[7] >> 0) & 0xFF);
+        v.poll_interval = static_cast<std::uint8_t>((p[8] >> 0) & 0xFF);
+        v.dups = static_cast<std::uint8_t>((p[9] >> 0) & 0xFF);
+        v.stack_free_lo = static_cast<std::uint8_t>((p[10] >> 0) & 0xFF);
+        v.stack_free_hi = static_cast<std::uint8_t>((p[11] >> 0) & 0xFF);
+        v.reset_reason = static_cast<std::uint8_t>((p[12] >> 0) & 0xFF);
+        v.reset_info = static_cast<std::uint8_t>((p[13] >> 0) & 0xFF);
+        v.resets = static_cast<std::uint8_t>((p[14] >> 0) & 0xFF);
+        v.lcd_faults = static_cast<std::uint8_t>((p[15] >> 0) & 0x7F);
+        v.lcd_offline = static_cast<std::uint8_t>((p[15] >> 7) & 0x01);
+        return v;
+    }
+
+    constexpr void pack(std::uint8_t* p) const
+    {
+        p[0] = static_cast<std::uint8_t>(((polls_lo & 0xFF) << 0));
+        p[1] = static_cast<std::uint8_t>(((polls_hi & 0xFF) << 0));
+        p[2] = static_cast<std::uint8_t>(((samples_lo & 0xFF) << 0));
+        p[3] = static_cast<std::uint8_t>(((samples_hi & 0xFF) << 0));
+        p[4] = static_cast<std::uint8_t>(((timeouts_lo & 0xFF) << 0));
+        p[5] = static_cast<std::uint8_t>(((timeouts_hi & 0xFF) << 0));
+        p[6] = static_cast<std::uint8_t>(((spin_lo & 0xFF) << 0));
+        p[7] = static_cast<std::uint8_t>(((spin_hi & 0xFF) << 0));
+        p[8] = static_cast<std::uint8_t>(((poll_interval & 0xFF) << 0));
+        p[9] = static_cast<std::uint8_t>(((dups & 0xFF) << 0));
+        p[10] = static_cast<std::uint8_t>(((stack_free_lo & 0xFF) << 0));
+        p[11] = static_cast<std::uint8_t>(((stack_free_hi & 0xFF) << 0));
+        p[12] = static_cast<std::uint8_t>(((reset_reason & 0xFF) << 0));
+        p[13] = static_cast<std::uint8_t>(((reset_info & 0xFF) << 0));
+        p[14] = static_cast<std::uint8_t>(((resets & 0xFF) << 0));
+        p[15] = static_cast<std::uint8_t>(((lcd_faults & 0x7F) << 0) | ((lcd_offline & 0x01) << 7));
+    }
+};
+
+// ---------- sensors ----------
+
+struct Sensors {
+    static constexpr std::size_t size = 1;
+    static constexpr std::array<Field, 3> fields{{
+        {"stale", 0, 0, 0x0F},
+        {"hold", 0, 4, 0x01},
+        {"shutdown", 0, 5, 0x01},
+    }};
+
+    struct bits {
+        using stale = shs::BitField<0, 0, 4>;
+        using hold = shs::BitField<0, 4, 1>;
+        using shutdown = shs::BitField<0, 5, 1>;
+    };
+    using layout = shs::Layout<1, bits::stale, bits::hold, bits::shutdown>;
+
+    std::uint8_t stale = 0;
+    std::uint8_t hold = 0;
+    std::uint8_t shutdown = 0;
+
+    static constexpr Sensors unpack(const std::uint8_t* p)
+    {
+        Sensors v;
+        v.stale = static_cast<std::uint8_t>((p[0] >> 0) & 0x0F);
+        v.hold = static_cast<std::uint8_t>((p[0] >> 4) & 0x01);
+        v.shutdown = static_cast<std::uint8_t>((p[0] >> 5) & 0x01);
+        return v;
+    }
+
+    constexpr void pack(std::uint8_t* p) const
+    {
+        p[0] = static_cast<std::uint8_t>(((stale & 0x0F) << 0) | ((hold & 0x01) << 4) | ((shutdown & 0x01) << 5));
+    }
+};
+
+// ---------- settings_check ----------
+
+struct SettingsCheck {
+    static constexpr std::size_t size = 2;
+    static constexpr std::array<Field, 2> fields{{
+        {"sum_a", 0, 0, 0xFF},
+        {"sum_b", 1, 0, 0xFF},
+    }};
+
+    struct bits {
+        using sum_a = shs::BitField<0, 0, 8>;
+        using sum_b = shs::BitField<1, 0, 8>;
+    };
+    using layout = shs::Layout<2, bits::sum_a, bits::sum_b>;
+
+    std::uint8_t sum_a = 0;
+    std::uint8_t sum_b = 0;
+
+    static constexpr SettingsCheck unpack(const std::uint8_t* p)
+    {
+        SettingsCheck v;
+        v.sum_a = static_cast<std::uint8_t>((p[0] >> 0) & 0xFF);
+        v.sum_b = static_cast<std::uint8_t>((p[1] >> 0) & 0xFF);
+        return v;
+    }
+
+    constexpr void pack(std::uint8_t* p) const
+    {
+        p[0] = static_cast<std::uint8_t>(((sum_a & 0xFF) << 0));
+        p[1] = static_cast<std::uint8_t>(((sum_b & 0xFF) << 0));
+    }
+};
+
+// ---------- FRAMES ----------
+
+inline constexpr std::uint8_t imp_hdr = 0xA9;
+
+struct ImpStateFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x65}};
+    static constexpr std::size_t fixed = 3;    // Payload bytes before any repeats
+    static constexpr std::size_t state = 0;
+};
+
+struct ImpSceneFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x66}};
+    static constexpr std::size_t fixed = 1;    // Payload bytes before any repeats
+    static constexpr std::size_t scene = 0;
+};
+
+struct ImpSceneSetFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x67}};
+    static constexpr std::size_t fixed = 4;    // Payload bytes before any repeats
+    static constexpr std::size_t scene = 0;
+    static constexpr std::size_t state = 1;
+};
+
+struct ImpRuleSetFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x68}};
+    static constexpr std::size_t fixed = 5;    // Payload bytes before any repeats
+    static constexpr std::size_t index = 0;
+    static constexpr std::size_t rule = 1;
+};
+
+struct ImpClockFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x69}};
+    static constexpr std::size_t fixed = 2;    // Payload bytes before any repeats
+    static constexpr std::size_t hour = 0;
+    static constexpr std::size_t minute = 1;
+};
+
+struct ImpZoneSetFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x6A}};
+    static constexpr std::size_t fixed = 2;    // Payload bytes before any repeats
+    static constexpr std::size_t node = 0;
+    static constexpr std::size_t zone_map = 1;
+};
+
+struct ImpTelemetryFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x6B}};
+    static constexpr std::size_t fixed = 0;    // Payload bytes before any repeats
+};
+
+struct ImpCommandIdFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x6C}};
+    static constexpr std::size_t fixed = 1;    // Payload bytes before any repeats
+    static constexpr std::size_t id = 0;
+};
+
+struct ImpSettingsGetFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x6D}};
+    static constexpr std::size_t fixed = 0;    // Payload bytes before any repeats
+};
+
+struct ImpSettingsPutFrame {
+    static constexpr std::array<std::uint8_t, 2> header{{0xA9, 0x6E}};
+    static constexpr std::size_t fixed = 3;    // Payload bytes before any repeats
+    static constexpr std::size_t size = 0;
+    static constexpr std::size_t settings_check = 1;
+    static constexpr std::size_t image = 3;
+    static constexpr std::size_t repeat = 1;  // Bytes per image, times size
+};
+
+struct ImpStatusFrame {
+    static constexpr std::array<std::uint8_t, 0> header{{}};
+    static constexpr std::size_t fixed = 4;    // Payload bytes before any repeats
+    static constexpr std::size_t state = 0;
+    static constexpr std::size_t sensors = 3;
+};
+
+struct ImpSensorsFrame {
+    static constexpr std::array<std::uint8_t, 1> header{{0xAD}};
+    static constexpr std::size_t fixed = 1;    // Payload bytes before any repeats
+    static constexpr std::size_t sensors = 0;
+};
+
+struct ImpReportFrame {
+    static constexpr std::array<std::uint8_t, 0> header{{}};
+    static constexpr std::size_t fixed = 16;    // Payload bytes before any repeats
+    static constexpr std::size_t telemetry = 0;
+};
+
+struct ImpAckFrame {
+    static constexpr std::array<std::uint8_t, 1> header{{0xAC}};
+    static constexpr std::size_t fixed = 1;    // Payload bytes before any repeats
+    static constexpr std::size_t id = 0;
+};
+
+struct ImpSettingsFrame {
+    static constexpr std::array<std::uint8_t, 0> header{{}};
+    static constexpr std::size_t fixed = 3;    // Payload bytes before any repeats
+    static constexpr std::size_t size = 0;
+    static constexpr std::size_t settings_check = 1;
+    static constexpr std::size_t image = 3;
+    static constexpr std::size_t repeat = 1;  // Bytes per image, times size
+};
+
+struct AuxCommandFrame {
+    static constexpr std::array<std::uint8_t, 0> header{{}};
+    static constexpr std::size_t fixed = 2;    // Payload bytes before any repeats
+    static constexpr std::size_t aux = 0;
+};
+
+struct XbeePollFrame {
+    static constexpr std::array<std::uint8_t, 1> header{{0xE4}};
+    static constexpr std::size_t fixed = 2;    // Payload bytes before any repeats
+    static constexpr std::size_t node = 0;
+    static constexpr std::size_t ack = 1;
+};
+
+struct XbeeBatchFrame {
+    static constexpr std::array<std::uint8_t, 1> header{{0xE5}};
+    static constexpr std::size_t fixed = 3;    // Payload bytes before any repeats
+    static constexpr std::size_t node = 0;
+    static constexpr std::size_t count = 1;
+    static constexpr std::size_t seq = 2;
+    static constexpr std::size_t samples = 3;
+    static constexpr std::size_t repeat = 2;  // Bytes per samples, times count
+};
+
+struct XbeeLegacyFrame {
+    static constexpr std::array<std::uint8_t, 1> header{{0xE3}};
+    static constexpr std::size_t fixed = 2;    // Payload bytes before any repeats
+    static constexpr std::size_t sample = 0;
+};
+
+struct XbeeStateFrame {
+    static constexpr std::array<std::uint8_t, 1> header{{0xD4}};
+    static constexpr std::size_t fixed = 3;    // Payload bytes before any repeats
+    static constexpr std::size_t state = 0;
+};
+
+}  // namespace shs::proto
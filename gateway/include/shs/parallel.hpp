@@ -0,0 +1,67 @@
+// parallel.hpp - The gateway pipeline spread over a work-stealing thread pool.
+//
+// Devices are split into shards, each with its own Gateway, arena and Strand. When a
+// connection has bytes to read its shard's strand drains it through parse, update and
+// publish, so one device's frames are always handled in order and by one worker at a time,
+// while different shards run on whichever workers are free. There are several shards per
+// worker so that stealing can even out busy and quiet homes.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "shs/pipeline.hpp"
+#include "shs/thread_pool.hpp"
+
+namespace shs {
+
+// A controller connection served by a ParallelGateway. The source must outlive it.
+class Connection {
+public:
+    Connection(std::uint32_t device, Source& source) : link(device), source(source) {}
+
+    Link link;
+    Source& source;
+
+private:
+    friend class ParallelGateway;
+
+    void* shard_ = nullptr;
+};
+
+class ParallelGateway {
+public:
+    // shards = 0 picks four per pool worker.
+    ParallelGateway(std::size_t devices, ThreadPool& pool, std::size_t shards = 0);
+    ~ParallelGateway();
+
+    // Subscribers are called from the shard strands: concurrently for devices in different
+    // shards, and in order for any one device.
+    void subscribe(Subscriber& s);
+
+    // The connection has bytes to read. Reads them on the device's shard until the source
+    // has nothing more.
+    void readable(Connection& c);
+
+    // Wait until every readable connection has been drained.
+    void wait() { pool_.wait_idle(); }
+
+    std::size_t shards() const { return shards_.size(); }
+
+    // Totals over all shards. Only meaningful after wait().
+    Gateway::Stats stats() const;
+    const DeviceState& state(std::uint32_t device) const;
+
+private:
+    struct Shard;
+
+    static void drain(void* conn);
+
+    ThreadPool& pool_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace shs
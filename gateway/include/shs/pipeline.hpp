@@ -0,0 +1,148 @@
+// pipeline.hpp - The gateway's parse, state update and publish stages.
+//
+// Bytes from a controller's serial line or TCP connection are read straight into an arena.
+// parse() finds the frames in them and returns views of their payloads, update() compares
+// each payload with the device's last known state and returns deltas that still point at the
+// received bytes, and publish() hands the deltas to every subscriber. Nothing is copied
+// between stages, and the arena is reset once the batch has been published, so subscribers
+// that keep a delta must copy it.
+
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "shs/arena.hpp"
+#include "shs/scan.hpp"
+
+namespace shs {
+
+constexpr std::size_t max_payload = 3;   // Largest payload of the frames the gateway reads
+
+// A frame's payload, still in the receive buffer.
+struct FrameView {
+    std::uint32_t device;
+    FrameKind kind;
+    std::span<const std::uint8_t> payload;
+};
+
+// A payload that differs from the device's last one of the same kind.
+struct StateDelta {
+    std::uint32_t device;
+    FrameKind kind;
+    std::uint8_t changed;   // Bit n set if payload byte n changed; all set the first time
+    std::span<const std::uint8_t> payload;
+};
+
+class Subscriber {
+public:
+    virtual ~Subscriber() = default;
+
+    // Called once per batch. The deltas and their payloads are valid only during the call.
+    virtual void publish(std::span<const StateDelta> deltas) = 0;
+};
+
+// Last payload of each kind received from one device.
+struct DeviceState {
+    std::array<std::array<std::uint8_t, max_payload>, frame_kinds> payload{};
+    std::uint8_t seen = 0;   // Bit per FrameKind received at least once
+};
+
+// Where a connection's bytes come from: a serial port, a socket or a replayed capture.
+class Source {
+public:
+    virtual ~Source() = default;
+
+    // Read up to buf.size() bytes. Returns the bytes read, 0 at end of file, or -1 if
+    // nothing is available yet.
+    virtual std::ptrdiff_t read(std::span<std::uint8_t> buf) = 0;
+};
+
+// A serial port or socket descriptor, which the caller keeps open.
+class FdSource : public Source {
+public:
+    explicit FdSource(int fd) : fd_(fd) {}
+
+    std::ptrdiff_t read(std::span<std::uint8_t> buf) override;
+
+private:
+    int fd_;
+};
+
+// One controller's connection. Holds the start of a frame split across reads.
+class Link {
+public:
+    explicit Link(std::uint32_t device) : device_(device) {}
+
+    std::uint32_t device() const { return device_; }
+
+private:
+    friend class Gateway;
+
+    std::uint32_t device_;
+    std::array<std::uint8_t, proto::ImpStateFrame::header.size() + proto::ImpStateFrame::fixed - 1>
+        carry_{};   // Longest frame less one byte
+    std::size_t carried_ = 0;
+};
+
+class Gateway {
+public:
+    struct Stats {
+        std::uint64_t bytes = 0;
+        std::uint64_t frames = 0;
+        std::uint64_t invalid = 0;   // Header bytes not followed by a valid frame
+        std::uint64_t deltas = 0;
+        std::uint64_t batches = 0;
+    };
+
+    // Devices are numbered from 0 to devices - 1; read_size is the most one read takes, and
+    // std::invalid_argument is thrown if a read that size cannot be parsed within one of the
+    // pool's blocks.
+    // A gateway can serve one shard of the devices, those with device % shards == shard.
+    Gateway(std::size_t devices, BlockPool& pool, std::size_t read_size = 4096,
+            std::size_t shard = 0, std::size_t shards = 1);
+
+    void subscribe(Subscriber& s) { subscribers_.push_back(&s); }
+
+    // Run one read through every stage. fill(std::span<std::uint8_t>) writes up to the span's
+    // size into it and returns the bytes written, as read(2) would.
+    template <typename Fill>
+        requires std::invocable<Fill&, std::span<std::uint8_t>>
+    std::size_t receive(Link& link, Fill&& fill)
+    {
+        std::span<std::uint8_t> buf = begin_read(link);
+        std::size_t n = fill(buf.subspan(link.carried_, read_size_));
+        run(link, buf.first(link.carried_ + n));
+        return n;
+    }
+
+    // Run one read from source through every stage. Returns what Source::read() returned.
+    std::ptrdiff_t receive(Link& link, Source& source);
+
+    // The stages, in order. parse() consumes link's carried bytes, which must start "bytes".
+    std::span<FrameView> parse(Link& link, std::span<const std::uint8_t> bytes);
+    std::span<StateDelta> update(std::span<const FrameView> frames);
+    void publish(std::span<const StateDelta> deltas);
+
+    const DeviceState& state(std::uint32_t device) const { return devices_.at(slot(device)); }
+    const Stats& stats() const { return stats_; }
+
+private:
+    std::size_t slot(std::uint32_t device) const { return device / shards_; }
+    std::span<std::uint8_t> begin_read(Link& link);
+    void run(Link& link, std::span<const std::uint8_t> bytes);
+
+    Arena arena_;
+    std::size_t read_size_;
+    std::size_t shard_;
+    std::size_t shards_;
+    std::vector<DeviceState> devices_;
+    std::vector<Subscriber*> subscribers_;
+    Stats stats_;
+};
+
+}  // namespace shs
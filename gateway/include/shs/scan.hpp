@@ -0,0 +1,94 @@
+// scan.hpp - Find and validate frames in recorded serial captures.
+//
+// A capture is the raw byte stream seen on the controller's serial lines. Three frames are
+// recognised: Imp state commands (0xA9 0x65), legacy sensor samples (0xE3) and controller
+// state broadcasts (0xD4). Header bytes can also appear inside payloads, so a header only
+// counts if the bytes after it form a valid frame; scanning then resumes after that frame.
+//
+// The vector scans classify 64 byte blocks into header masks with AVX2 or SSE2 compares, then
+// accept each block's frames from its masks at once, walking positions one by one only where
+// frames overlap. Accepted payloads are packed back to back per frame type so decode_batch()
+// (shs/codec.hpp) can split them into columns.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "shs/codec.hpp"
+#include "shs/frames.hpp"
+
+namespace shs {
+
+enum class FrameKind : std::uint8_t { imp_state, xbee_legacy, xbee_state };
+
+constexpr std::size_t frame_kinds = 3;
+
+// Header and payload bytes of each kind of frame.
+constexpr std::size_t header_size(FrameKind k)
+{
+    return k == FrameKind::imp_state     ? proto::ImpStateFrame::header.size()
+           : k == FrameKind::xbee_legacy ? proto::XbeeLegacyFrame::header.size()
+                                         : proto::XbeeStateFrame::header.size();
+}
+
+constexpr std::size_t payload_size(FrameKind k)
+{
+    return k == FrameKind::imp_state     ? proto::ImpStateFrame::fixed
+           : k == FrameKind::xbee_legacy ? proto::XbeeLegacyFrame::fixed
+                                         : proto::XbeeStateFrame::fixed;
+}
+
+// Result of looking for a frame at one position.
+struct FrameMatch {
+    FrameKind kind;
+    std::ptrdiff_t len;   // Frame length; 0 if none starts here, -1 if more bytes are needed
+    bool header;          // The position holds a header, whether or not its frame is valid
+};
+
+// Check whether a valid frame starts at p, given avail bytes from p on.
+FrameMatch match_frame(const std::uint8_t* p, std::size_t avail);
+
+// Frames found in a capture, grouped by kind.
+struct Capture {
+    struct Frames {
+        std::vector<std::uint64_t> offset;   // Capture offset of each frame's first header byte
+        std::vector<std::uint8_t> payload;   // Payloads back to back
+    };
+
+    std::array<Frames, frame_kinds> frames;
+    std::uint64_t invalid = 0;   // Header bytes not followed by a valid frame
+
+    Frames& operator[](FrameKind k) { return frames[static_cast<std::size_t>(k)]; }
+    const Frames& operator[](FrameKind k) const { return frames[static_cast<std::size_t>(k)]; }
+
+    std::size_t count(FrameKind k) const { return (*this)[k].offset.size(); }
+    void clear();
+};
+
+// Scan len bytes that start at capture offset "base", appending every frame found to out.
+// Returns the bytes consumed: scanning stops at a header whose frame runs past the end, and
+// the caller passes those bytes again with the rest of the capture.
+std::size_t scan_capture(const std::uint8_t* data, std::size_t len, std::uint64_t base,
+                         Capture& out, Isa isa = best_isa());
+
+// Scans a capture delivered in chunks of any size, carrying frames split across chunks.
+class CaptureReader {
+public:
+    explicit CaptureReader(Capture& out, Isa isa = best_isa()) : out_(out), isa_(isa) {}
+
+    void feed(const std::uint8_t* data, std::size_t len);
+
+    // Flush the carried bytes at the end of the capture. A frame cut off there is invalid.
+    void finish();
+
+private:
+    Capture& out_;
+    Isa isa_;
+    std::uint64_t offset_ = 0;        // Capture offset of carry_[0]
+    std::vector<std::uint8_t> carry_;
+};
+
+}  // namespace shs
@@ -0,0 +1,98 @@
+// thread_pool.hpp - Work-stealing thread pool and strands for the gateway's stages.
+//
+// Each worker keeps its own task deque: it pushes and pops at the back, so related work stays
+// on one core while it is hot, and idle workers steal from the front of the others. A Strand
+// runs the tasks posted to it one at a time and in order on whichever worker is free, which
+// is how the gateway keeps each device's frames in order without a thread per device.
+//
+// Tasks are a function pointer and an argument, so submitting one never allocates.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace shs {
+
+struct Task {
+    void (*fn)(void*);
+    void* arg;
+};
+
+class ThreadPool {
+public:
+    struct Stats {
+        std::uint64_t executed = 0;
+        std::uint64_t stolen = 0;
+    };
+
+    explicit ThreadPool(std::size_t threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const { return workers_.size(); }
+
+    // From a worker the task goes on that worker's deque, to run next, or with "defer" after
+    // everything already there. From any other thread the deques are filled in turn.
+    void submit(Task t, bool defer = false);
+
+    // Block until every submitted task, and every task those submitted, has finished.
+    void wait_idle();
+
+    Stats stats() const;
+
+private:
+    struct Worker {
+        std::mutex m;
+        std::deque<Task> q;
+        std::atomic<std::uint64_t> executed{0};
+        std::atomic<std::uint64_t> stolen{0};
+        std::thread thread;
+    };
+
+    void run(std::size_t self);
+    bool pop(std::size_t self, Task& t);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<std::size_t> next_{0};      // Deque for the next outside submit
+    std::atomic<std::int64_t> pending_{0};  // Tasks submitted and not yet finished
+    std::atomic<std::int64_t> queued_{0};   // Tasks sitting in a deque
+    bool stop_ = false;
+
+    std::mutex sleep_m_;
+    std::condition_variable work_cv_;
+    std::condition_variable idle_cv_;
+};
+
+class Strand {
+public:
+    explicit Strand(ThreadPool& pool) : pool_(pool) {}
+
+    Strand(const Strand&) = delete;
+    Strand& operator=(const Strand&) = delete;
+
+    // Run t after every task posted before it, and never alongside another of this strand.
+    void post(Task t);
+
+private:
+    static void run(void* self);
+
+    // Tasks run per turn on a worker before the strand yields it to other work.
+    static constexpr int turn = 64;
+
+    ThreadPool& pool_;
+    std::mutex m_;
+    std::deque<Task> q_;
+    bool scheduled_ = false;
+};
+
+}  // namespace shs
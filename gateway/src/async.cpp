@@ -0,0 +1,317 @@
+// async.cpp - Coroutine serial I/O for controller connections on a single-threaded reactor.
+
+#include "shs/async.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace shs {
+
+namespace {
+
+[[noreturn]] void fail(const char* what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Runs a spawned task to completion and then frees itself.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+Detached run_detached(Task<void> task, std::size_t& live, std::exception_ptr& error)
+{
+    try {
+        co_await task;
+    } catch (...) {
+        if (!error) error = std::current_exception();
+    }
+    live--;
+}
+
+std::span<const std::uint8_t> header_of(FrameKind k)
+{
+    switch (k) {
+    case FrameKind::imp_state:
+        return proto::ImpStateFrame::header;
+    case FrameKind::xbee_legacy:
+        return proto::XbeeLegacyFrame::header;
+    default:
+        return proto::XbeeStateFrame::header;
+    }
+}
+
+}  // namespace
+
+// ---------- REACTOR ----------
+
+Reactor::Reactor()
+{
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) fail("reactor: epoll_create1");
+}
+
+Reactor::~Reactor()
+{
+    ::close(epoll_fd_);
+}
+
+void Reactor::spawn(Task<void> task)
+{
+    live_++;
+    run_detached(std::move(task), live_, error_);
+}
+
+void Reactor::run()
+{
+    epoll_event events[256];
+    while (live_) {
+        fire_timers();
+        if (!live_) break;
+
+        int n = ::epoll_wait(epoll_fd_, events, 256, next_timeout());
+        stats_.polls++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fail("reactor: epoll_wait");
+        }
+        batch_ = events;
+        batch_len_ = n;
+        for (int i = 0; i < n; i++) {
+            if (auto* ch = static_cast<Channel*>(events[i].data.ptr)) ch->events(events[i].events);
+        }
+        batch_ = nullptr;
+        batch_len_ = 0;
+    }
+    if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+}
+
+void Reactor::arm(Waiter& w, Clock::time_point deadline)
+{
+    w.timer = next_timer_++;
+    w.timed_out = false;
+    timers_.push({deadline, w.timer});
+    armed_.emplace(w.timer, &w);
+}
+
+void Reactor::wake(Waiter& w)
+{
+    if (w.timer) {
+        armed_.erase(w.timer);   // Its heap entry is skipped when it comes up
+        w.timer = 0;
+    }
+    stats_.resumes++;
+    w.h.resume();
+}
+
+void Reactor::fire_timers()
+{
+    Clock::time_point now = Clock::now();
+    while (!timers_.empty() && timers_.top().deadline <= now) {
+        std::uint64_t id = timers_.top().id;
+        timers_.pop();
+        auto it = armed_.find(id);
+        if (it == armed_.end()) continue;
+        Waiter& w = *it->second;
+        armed_.erase(it);
+        w.timer = 0;
+        w.timed_out = true;
+        stats_.timeouts++;
+        stats_.resumes++;
+        w.h.resume();
+    }
+}
+
+int Reactor::next_timeout()
+{
+    while (!timers_.empty() && !armed_.contains(timers_.top().id)) timers_.pop();
+    if (timers_.empty()) return -1;
+    auto wait = timers_.top().deadline - Clock::now();
+    if (wait <= Clock::duration::zero()) return 0;
+    // Round up, so the timer has passed when epoll_wait returns.
+    return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(wait).count());
+}
+
+void Reactor::forget(Channel* ch)
+{
+    for (int i = 0; i < batch_len_; i++) {
+        if (batch_[i].data.ptr == ch) batch_[i].data.ptr = nullptr;
+    }
+}
+
+// ---------- CHANNEL ----------
+
+Channel::Channel(Reactor& reactor, int fd) : reactor_(reactor), fd_(fd)
+{
+    int flags = ::fcntl(fd_, F_GETFL);
+    if (flags < 0 || ::fcntl(fd_, F_SETFL, flags | O_NONBLOCK) < 0) fail("channel: fcntl");
+    struct stat st;
+    socket_ = ::fstat(fd_, &st) == 0 && S_ISSOCK(st.st_mode);
+
+    // Edge-triggered: the channel reads and writes until EAGAIN before it waits.
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = this;
+    if (::epoll_ctl(reactor_.epoll_fd_, EPOLL_CTL_ADD, fd_, &ev) < 0) fail("channel: epoll_ctl");
+}
+
+Channel::~Channel()
+{
+    ::epoll_ctl(reactor_.epoll_fd_, EPOLL_CTL_DEL, fd_, nullptr);
+    reactor_.forget(this);
+    ::close(fd_);
+}
+
+void Channel::Ready::await_suspend(std::coroutine_handle<> h)
+{
+    w.h = h;
+    slot = &w;
+    if (deadline) ch.reactor_.arm(w, *deadline);
+}
+
+void Channel::events(std::uint32_t ev)
+{
+    Reactor::Waiter* r = nullptr;
+    Reactor::Waiter* w = nullptr;
+    if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        can_read_ = true;
+        r = std::exchange(reader_, nullptr);
+    }
+    if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+        can_write_ = true;
+        w = std::exchange(writer_, nullptr);
+    }
+    // The channel may be gone once either has run.
+    if (r) reactor_.wake(*r);
+    if (w) reactor_.wake(*w);
+}
+
+void Channel::fill()
+{
+    if (head_ == in_.size()) {
+        in_.clear();
+        head_ = 0;
+    } else if (head_ >= 4096) {
+        in_.erase(in_.begin(), in_.begin() + static_cast<std::ptrdiff_t>(head_));
+        head_ = 0;
+    }
+
+    std::uint8_t buf[4096];
+    for (;;) {
+        ssize_t n = ::read(fd_, buf, sizeof buf);
+        if (n > 0) {
+            in_.insert(in_.end(), buf, buf + n);
+            continue;
+        }
+        if (n == 0) {
+            eof_ = true;
+            return;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            can_read_ = false;
+            return;
+        }
+        if (errno == EIO) {   // A pty whose other side has closed
+            eof_ = true;
+            return;
+        }
+        fail("channel: read");
+    }
+}
+
+void Channel::discard()
+{
+    if (can_read_) fill();
+    head_ = in_.size();
+}
+
+Task<std::optional<Frame>> Channel::read_frame(Duration timeout)
+{
+    auto deadline = Reactor::Clock::now() + timeout;
+    for (;;) {
+        // Skip to the next header whose frame is valid, as the scanner does.
+        while (head_ < in_.size()) {
+            FrameMatch m = match_frame(in_.data() + head_, in_.size() - head_);
+            if (m.len > 0) {
+                Frame f{m.kind};
+                const std::uint8_t* payload = in_.data() + head_ + header_size(m.kind);
+                std::copy_n(payload, payload_size(m.kind), f.payload.begin());
+                head_ += static_cast<std::size_t>(m.len);
+                co_return f;
+            }
+            if (m.len < 0) break;
+            head_++;
+        }
+        if (eof_) co_return std::nullopt;
+        if (can_read_) {
+            fill();
+            continue;
+        }
+        if (!co_await readable(deadline)) co_return std::nullopt;
+    }
+}
+
+Task<std::size_t> Channel::read_reply(std::span<std::uint8_t> out, Duration timeout)
+{
+    auto deadline = Reactor::Clock::now() + timeout;
+    std::size_t got = 0;
+    for (;;) {
+        std::size_t n = std::min(out.size() - got, in_.size() - head_);
+        std::copy_n(in_.data() + head_, n, out.data() + got);
+        head_ += n;
+        got += n;
+        if (got == out.size() || eof_) co_return got;
+        if (can_read_) {
+            fill();
+            continue;
+        }
+        if (!co_await readable(deadline)) co_return got;
+    }
+}
+
+Task<void> Channel::write(std::span<const std::uint8_t> bytes)
+{
+    std::size_t off = 0;
+    while (off < bytes.size()) {
+        ssize_t n = socket_ ? ::send(fd_, bytes.data() + off, bytes.size() - off, MSG_NOSIGNAL)
+                            : ::write(fd_, bytes.data() + off, bytes.size() - off);
+        if (n >= 0) {
+            off += static_cast<std::size_t>(n);
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) fail("channel: write");
+        can_write_ = false;
+        co_await writable();
+    }
+}
+
+Task<void> Channel::write_frame(FrameKind kind, std::span<const std::uint8_t> payload)
+{
+    if (payload.size() != payload_size(kind)) {
+        throw std::invalid_argument("channel: payload size does not match frame kind");
+    }
+    std::array<std::uint8_t, 2 + max_payload> buf;
+    std::span<const std::uint8_t> header = header_of(kind);
+    std::copy(header.begin(), header.end(), buf.begin());
+    std::copy(payload.begin(), payload.end(), buf.begin() + header.size());
+    co_await write(std::span(buf.data(), header.size() + payload.size()));
+}
+
+}  // namespace shs
@@ -0,0 +1,445 @@
+// fanout.cpp - Fan device state changes out to app viewers over loopback long-poll HTTP.
+
+#include "shs/fanout.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace shs {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+[[noreturn]] void fail(const char* what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+std::shared_ptr<const std::string> plain(int status, const char* reason)
+{
+    return std::make_shared<const std::string>(
+        "HTTP/1.1 " + std::to_string(status) + " " + reason +
+        "\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n");
+}
+
+const std::shared_ptr<const std::string>& timed_out()
+{
+    static const auto r = plain(204, "No Content");
+    return r;
+}
+
+const std::shared_ptr<const std::string>& not_found()
+{
+    static const auto r = plain(404, "Not Found");
+    return r;
+}
+
+const std::shared_ptr<const std::string>& bad_request()
+{
+    static const auto r = plain(400, "Bad Request");
+    return r;
+}
+
+template <std::size_t N>
+void render_fields(std::string& out, const char* name, const std::array<proto::Field, N>& fields,
+                   const std::uint8_t* payload)
+{
+    out += ",\"";
+    out += name;
+    out += "\":{";
+    for (std::size_t i = 0; i < N; i++) {
+        if (i) out += ',';
+        out += '"';
+        out += fields[i].name;
+        out += "\":";
+        out += std::to_string(proto::get(payload, fields[i]));
+    }
+    out += '}';
+}
+
+}  // namespace
+
+// ---------- STATE FEED ----------
+
+StateFeed::StateFeed(std::size_t devices) : slots_(devices)
+{
+    notify_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notify_fd_ < 0) fail("fanout: eventfd");
+}
+
+StateFeed::~StateFeed()
+{
+    ::close(notify_fd_);
+}
+
+void StateFeed::publish(std::span<const StateDelta> deltas)
+{
+    // Deltas arrive grouped by device; render each device once, after its last delta.
+    for (std::size_t i = 0; i < deltas.size(); i++) {
+        const StateDelta& d = deltas[i];
+        if (d.device >= slots_.size()) continue;
+        Slot& slot = slots_[d.device];
+        auto k = static_cast<std::size_t>(d.kind);
+        std::copy(d.payload.begin(), d.payload.end(), slot.state.payload[k].begin());
+        slot.state.seen |= static_cast<std::uint8_t>(1u << k);
+
+        if (i + 1 < deltas.size() && deltas[i + 1].device == d.device) continue;
+
+        std::uint64_t version;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            version = slot.snap.version + 1;
+        }
+        auto response = render(d.device, slot, version);
+        rendered_.fetch_add(1, std::memory_order_relaxed);
+
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            slot.snap.version = version;
+            slot.snap.response = std::move(response);
+            wake = changed_.empty();
+            changed_.push_back(d.device);
+        }
+        if (wake) {
+            std::uint64_t one = 1;
+            if (::write(notify_fd_, &one, sizeof one) < 0 && errno != EAGAIN) fail("fanout: notify");
+        }
+    }
+}
+
+std::shared_ptr<const std::string> StateFeed::render(std::uint32_t device, const Slot& slot,
+                                                     std::uint64_t version) const
+{
+    std::string body = "{\"device\":" + std::to_string(device) +
+                       ",\"version\":" + std::to_string(version);
+    const DeviceState& s = slot.state;
+    auto seen = [&s](FrameKind k) { return s.seen & (1u << static_cast<unsigned>(k)); };
+    auto payload = [&s](FrameKind k) { return s.payload[static_cast<std::size_t>(k)].data(); };
+
+    // The last command the Imp sent, the controller's own state, and the last sensor sample.
+    if (seen(FrameKind::imp_state)) {
+        render_fields(body, "command", proto::State::fields, payload(FrameKind::imp_state));
+    }
+    if (seen(FrameKind::xbee_state)) {
+        render_fields(body, "state", proto::State::fields, payload(FrameKind::xbee_state));
+    }
+    if (seen(FrameKind::xbee_legacy)) {
+        render_fields(body, "sample", proto::Sample::fields, payload(FrameKind::xbee_legacy));
+    }
+    body += "}\n";
+
+    auto response = std::make_shared<std::string>();
+    response->reserve(body.size() + 128);
+    *response += "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: ";
+    *response += std::to_string(body.size());
+    *response += "\r\nConnection: keep-alive\r\n\r\n";
+    *response += body;
+    return response;
+}
+
+StateFeed::Snapshot StateFeed::latest(std::uint32_t device) const
+{
+    std::lock_guard<std::mutex> lock(m_);
+    return slots_.at(device).snap;
+}
+
+void StateFeed::take_changed(std::vector<std::uint32_t>& out)
+{
+    std::uint64_t count;
+    if (::read(notify_fd_, &count, sizeof count) < 0 && errno != EAGAIN) fail("fanout: notify");
+
+    std::lock_guard<std::mutex> lock(m_);
+    out.insert(out.end(), changed_.begin(), changed_.end());
+    changed_.clear();
+}
+
+// ---------- LONG-POLL SERVER ----------
+
+struct LongPollServer::Client {
+    int fd;
+    std::string in;
+    std::deque<std::pair<std::shared_ptr<const std::string>, std::size_t>> out;
+    bool writing = false;   // Waiting for the socket to take more output
+    bool parked = false;
+    std::uint32_t device = 0;
+    std::uint64_t since = 0;
+    Clock::time_point deadline;
+};
+
+LongPollServer::LongPollServer(StateFeed& feed, std::uint16_t port, int timeout_s)
+    : feed_(feed), timeout_s_(timeout_s), waiting_(feed.devices())
+{
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) fail("fanout: socket");
+    int on = 1;
+    ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0) fail("fanout: bind");
+    if (::listen(listen_fd_, SOMAXCONN) < 0) fail("fanout: listen");
+    socklen_t len = sizeof addr;
+    ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+
+    stop_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (stop_fd_ < 0 || epoll_fd_ < 0) fail("fanout: epoll");
+    for (int fd : {listen_fd_, feed_.notify_fd(), stop_fd_}) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) fail("fanout: epoll_ctl");
+    }
+
+    thread_ = std::thread([this] { run(); });
+}
+
+LongPollServer::~LongPollServer()
+{
+    std::uint64_t one = 1;
+    if (::write(stop_fd_, &one, sizeof one) < 0) {
+        // The thread still stops at its next wake-up
+    }
+    thread_.join();
+    for (auto& c : clients_) {
+        if (c) ::close(c->fd);
+    }
+    ::close(epoll_fd_);
+    ::close(stop_fd_);
+    ::close(listen_fd_);
+}
+
+LongPollServer::Stats LongPollServer::stats() const
+{
+    return {connections_.load(), responses_.load(), shared_.load()};
+}
+
+void LongPollServer::run()
+{
+    epoll_event events[256];
+    std::vector<std::uint32_t> changed;
+    Clock::time_point next_expire = Clock::now() + std::chrono::seconds(1);
+
+    for (;;) {
+        int n = ::epoll_wait(epoll_fd_, events, 256, 1000);
+        if (n < 0 && errno != EINTR) fail("fanout: epoll_wait");
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == stop_fd_) return;
+            if (fd == listen_fd_) {
+                accept_clients();
+            } else if (fd == feed_.notify_fd()) {
+                changed.clear();
+                feed_.take_changed(changed);
+                for (std::uint32_t d : changed) wake_device(d);
+            } else if (fd < static_cast<int>(clients_.size()) && clients_[fd]) {
+                Client& c = *clients_[fd];
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    close(c);
+                    continue;
+                }
+                if ((events[i].events & EPOLLOUT) && !flush(c)) continue;
+                if (events[i].events & EPOLLIN) read_request(c);
+            }
+        }
+
+        if (Clock::now() >= next_expire) {
+            expire();
+            next_expire = Clock::now() + std::chrono::seconds(1);
+        }
+    }
+}
+
+void LongPollServer::accept_clients()
+{
+    for (;;) {
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+            if (errno == EMFILE || errno == ENFILE) return;   // Retried on the next wake-up
+            fail("fanout: accept");
+        }
+        if (fd >= static_cast<int>(clients_.size())) clients_.resize(fd + 1);
+        clients_[fd] = std::make_unique<Client>();
+        clients_[fd]->fd = fd;
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) fail("fanout: epoll_ctl");
+        connections_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void LongPollServer::read_request(Client& c)
+{
+    char buf[4096];
+    for (;;) {
+        ssize_t n = ::recv(c.fd, buf, sizeof buf, 0);
+        if (n > 0) {
+            c.in.append(buf, static_cast<std::size_t>(n));
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0 && errno == EINTR) continue;
+        close(c);   // Closed by the viewer, or failed
+        return;
+    }
+
+    // One request at a time: a parked viewer's next request waits in c.in.
+    while (!c.parked) {
+        std::size_t end = c.in.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            if (c.in.size() > 8192) close(c);
+            return;
+        }
+        std::string_view line(c.in.data(), c.in.find("\r\n"));
+
+        // GET /state/<device>[?since=<version>] HTTP/1.1
+        std::uint32_t device = 0;
+        std::uint64_t since = 0;
+        bool ok = line.starts_with("GET /state/");
+        if (ok) {
+            line.remove_prefix(11);
+            auto r = std::from_chars(line.data(), line.data() + line.size(), device);
+            ok = r.ec == std::errc();
+            line.remove_prefix(static_cast<std::size_t>(r.ptr - line.data()));
+            if (ok && line.starts_with("?since=")) {
+                line.remove_prefix(7);
+                ok = std::from_chars(line.data(), line.data() + line.size(), since).ec == std::errc();
+            }
+        }
+        c.in.erase(0, end + 4);
+
+        if (!ok) {
+            if (!send(c, bad_request())) return;
+        } else if (device >= feed_.devices()) {
+            if (!send(c, not_found())) return;
+        } else {
+            answer(c, device, since);
+            if (!clients_[c.fd]) return;
+        }
+    }
+}
+
+void LongPollServer::answer(Client& c, std::uint32_t device, std::uint64_t since)
+{
+    StateFeed::Snapshot snap = feed_.latest(device);
+    if (snap.version > since) {
+        shared_.fetch_add(1, std::memory_order_relaxed);
+        send(c, std::move(snap.response));
+        return;
+    }
+    c.parked = true;
+    c.device = device;
+    c.since = since;
+    c.deadline = Clock::now() + std::chrono::seconds(timeout_s_);
+    waiting_[device].push_back(c.fd);
+}
+
+bool LongPollServer::send(Client& c, std::shared_ptr<const std::string> response)
+{
+    responses_.fetch_add(1, std::memory_order_relaxed);
+    c.out.emplace_back(std::move(response), 0);
+    return flush(c);
+}
+
+bool LongPollServer::flush(Client& c)
+{
+    while (!c.out.empty()) {
+        auto& [buf, off] = c.out.front();
+        ssize_t n = ::send(c.fd, buf->data() + off, buf->size() - off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                close(c);
+                return false;
+            }
+            break;
+        }
+        off += static_cast<std::size_t>(n);
+        if (off == buf->size()) c.out.pop_front();
+    }
+
+    bool writing = !c.out.empty();
+    if (writing != c.writing) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | (writing ? EPOLLOUT : 0u);
+        ev.data.fd = c.fd;
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &ev);
+        c.writing = writing;
+    }
+    return true;
+}
+
+void LongPollServer::close(Client& c)
+{
+    int fd = c.fd;
+    if (c.parked) {
+        auto& w = waiting_[c.device];
+        w.erase(std::remove(w.begin(), w.end(), fd), w.end());
+    }
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    clients_[fd].reset();
+}
+
+void LongPollServer::wake_device(std::uint32_t device)
+{
+    if (device >= waiting_.size() || waiting_[device].empty()) return;
+    StateFeed::Snapshot snap = feed_.latest(device);
+
+    std::vector<int> parked;
+    parked.swap(waiting_[device]);
+    for (int fd : parked) {
+        Client& c = *clients_[fd];
+        if (snap.version <= c.since) {
+            waiting_[device].push_back(fd);
+            continue;
+        }
+        // Every viewer of the device gets the same buffer.
+        c.parked = false;
+        shared_.fetch_add(1, std::memory_order_relaxed);
+        if (send(c, snap.response)) read_request(c);
+    }
+}
+
+void LongPollServer::expire()
+{
+    Clock::time_point now = Clock::now();
+    for (auto& w : waiting_) {
+        std::vector<int> parked;
+        parked.swap(w);
+        for (int fd : parked) {
+            Client& c = *clients_[fd];
+            if (now < c.deadline) {
+                w.push_back(fd);
+                continue;
+            }
+            c.parked = false;
+            if (send(c, timed_out())) read_request(c);
+        }
+    }
+}
+
+}  // namespace shs
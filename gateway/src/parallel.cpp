@@ -0,0 +1,71 @@
+// parallel.cpp - The gateway pipeline spread over a work-stealing thread pool.
+
+#include "shs/parallel.hpp"
+
+namespace shs {
+
+struct ParallelGateway::Shard {
+    Shard(std::size_t devices, ThreadPool& pool, std::size_t index, std::size_t count)
+        : gateway(devices, blocks, 4096, index, count), strand(pool)
+    {
+    }
+
+    BlockPool blocks;
+    Gateway gateway;
+    Strand strand;
+};
+
+ParallelGateway::ParallelGateway(std::size_t devices, ThreadPool& pool, std::size_t shards)
+    : pool_(pool)
+{
+    if (shards == 0) shards = 4 * pool.size();
+    for (std::size_t i = 0; i < shards; i++) {
+        shards_.push_back(std::make_unique<Shard>(devices, pool, i, shards));
+    }
+}
+
+ParallelGateway::~ParallelGateway()
+{
+    wait();
+}
+
+void ParallelGateway::subscribe(Subscriber& s)
+{
+    for (auto& shard : shards_) shard->gateway.subscribe(s);
+}
+
+void ParallelGateway::readable(Connection& c)
+{
+    Shard& shard = *shards_[c.link.device() % shards_.size()];
+    if (!c.shard_) c.shard_ = &shard;   // Set once, before the first drain can read it
+    shard.strand.post({&ParallelGateway::drain, &c});
+}
+
+void ParallelGateway::drain(void* conn)
+{
+    auto* c = static_cast<Connection*>(conn);
+    auto* shard = static_cast<Shard*>(c->shard_);
+    while (shard->gateway.receive(c->link, c->source) > 0) {
+    }
+}
+
+Gateway::Stats ParallelGateway::stats() const
+{
+    Gateway::Stats total;
+    for (const auto& shard : shards_) {
+        const Gateway::Stats& s = shard->gateway.stats();
+        total.bytes += s.bytes;
+        total.frames += s.frames;
+        total.invalid += s.invalid;
+        total.deltas += s.deltas;
+        total.batches += s.batches;
+    }
+    return total;
+}
+
+const DeviceState& ParallelGateway::state(std::uint32_t device) const
+{
+    return shards_[device % shards_.size()]->gateway.state(device);
+}
+
+}  // namespace shs
@@ -0,0 +1,140 @@
+// pipeline.cpp - The gateway's parse, state update and publish stages.
+
+#include "shs/pipeline.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <unistd.h>
+
+namespace shs {
+
+namespace {
+
+constexpr std::size_t shortest_frame = proto::XbeeLegacyFrame::header.size() +
+                                       proto::XbeeLegacyFrame::fixed;
+
+}  // namespace
+
+std::ptrdiff_t FdSource::read(std::span<std::uint8_t> buf)
+{
+    ssize_t n = ::read(fd_, buf.data(), buf.size());
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return -1;
+        throw std::system_error(errno, std::generic_category(), "gateway: read");
+    }
+    return n;
+}
+
+Gateway::Gateway(std::size_t devices, BlockPool& pool, std::size_t read_size, std::size_t shard,
+                 std::size_t shards)
+    : arena_(pool), read_size_(read_size), shard_(shard), shards_(shards),
+      devices_((devices + shards - 1 - shard) / shards)
+{
+    // Each array one read takes from the arena must fit in a block: the bytes, behind a carried
+    // frame start, then a view and at most one delta for every frame they could hold.
+    std::size_t bytes = sizeof(Link::carry_) + read_size;
+    std::size_t records = (bytes / shortest_frame + 1) *
+                          std::max(sizeof(FrameView), sizeof(StateDelta));
+    if (bytes > pool.block_size() || records > pool.block_size()) {
+        throw std::invalid_argument("gateway: read size too large for the pool's blocks");
+    }
+}
+
+std::span<std::uint8_t> Gateway::begin_read(Link& link)
+{
+    if (link.device_ % shards_ != shard_ || slot(link.device_) >= devices_.size()) {
+        throw std::out_of_range("gateway: device not served here");
+    }
+
+    // A frame split across reads is the only thing copied: its start goes ahead of the new bytes.
+    std::span<std::uint8_t> buf = arena_.reserve(link.carried_ + read_size_);
+    std::memcpy(buf.data(), link.carry_.data(), link.carried_);
+    return buf;
+}
+
+void Gateway::run(Link& link, std::span<const std::uint8_t> bytes)
+{
+    arena_.commit(bytes.size());
+    publish(update(parse(link, bytes)));
+    arena_.reset();
+    stats_.batches++;
+}
+
+std::ptrdiff_t Gateway::receive(Link& link, Source& source)
+{
+    std::span<std::uint8_t> buf = begin_read(link);
+    std::ptrdiff_t n = source.read(buf.subspan(link.carried_, read_size_));
+    if (n > 0) run(link, buf.first(link.carried_ + static_cast<std::size_t>(n)));
+    return n;
+}
+
+std::span<FrameView> Gateway::parse(Link& link, std::span<const std::uint8_t> bytes)
+{
+    FrameView* views = arena_.alloc_array<FrameView>(bytes.size() / shortest_frame + 1);
+    std::size_t count = 0;
+
+    stats_.bytes += bytes.size() - link.carried_;
+    link.carried_ = 0;
+
+    std::size_t pos = 0;
+    while (pos < bytes.size()) {
+        FrameMatch m = match_frame(bytes.data() + pos, bytes.size() - pos);
+        if (m.len < 0) {
+            // Keep the start of the frame for the next read.
+            link.carried_ = bytes.size() - pos;
+            std::memcpy(link.carry_.data(), bytes.data() + pos, link.carried_);
+            break;
+        }
+        if (m.len == 0) {
+            if (m.header) stats_.invalid++;
+            pos++;
+            continue;
+        }
+        new (views + count++) FrameView{link.device_, m.kind,
+                                        bytes.subspan(pos + header_size(m.kind), payload_size(m.kind))};
+        pos += static_cast<std::size_t>(m.len);
+    }
+
+    stats_.frames += count;
+    return {views, count};
+}
+
+std::span<StateDelta> Gateway::update(std::span<const FrameView> frames)
+{
+    StateDelta* deltas = arena_.alloc_array<StateDelta>(frames.size());
+    std::size_t count = 0;
+
+    for (const FrameView& f : frames) {
+        DeviceState& d = devices_[slot(f.device)];
+        auto k = static_cast<std::size_t>(f.kind);
+        std::uint8_t* last = d.payload[k].data();
+
+        std::uint8_t changed = 0;
+        for (std::size_t i = 0; i < f.payload.size(); i++) {
+            changed |= static_cast<std::uint8_t>((last[i] != f.payload[i]) << i);
+        }
+        if (!(d.seen & (1u << k))) {
+            changed = static_cast<std::uint8_t>((1u << f.payload.size()) - 1);
+            d.seen |= static_cast<std::uint8_t>(1u << k);
+        }
+        if (!changed) continue;
+
+        std::memcpy(last, f.payload.data(), f.payload.size());
+        new (deltas + count++) StateDelta{f.device, f.kind, changed, f.payload};
+    }
+
+    stats_.deltas += count;
+    return {deltas, count};
+}
+
+void Gateway::publish(std::span<const StateDelta> deltas)
+{
+    if (deltas.empty()) return;
+    for (Subscriber* s : subscribers_) s->publish(deltas);
+}
+
+}  // namespace shs
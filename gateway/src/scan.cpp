@@ -0,0 +1,479 @@
+// scan.cpp - Find and validate frames in recorded serial captures.
+
+#include "shs/scan.hpp"
+
+#include <cstring>
+#include <type_traits>
+
+#include "shs/frames.hpp"
+
+namespace shs {
+
+namespace {
+
+using proto::Sample;
+using proto::State;
+
+constexpr std::uint8_t humid_max = 100;   // Humidity is a percentage
+
+// Bytes needed to decide whether a frame starts at a header byte.
+constexpr std::size_t longest_frame =
+    proto::ImpStateFrame::header.size() + proto::ImpStateFrame::fixed;
+
+enum Try : std::ptrdiff_t { need_more = -1, invalid = 0 };
+
+template <typename Frame>
+constexpr std::size_t frame_len()
+{
+    return Frame::header.size() + Frame::fixed;
+}
+
+// Check for a frame of type Frame at p. Returns its length, invalid, or need_more if fewer
+// than the frame's length is available.
+template <typename Frame>
+inline std::ptrdiff_t try_frame(const std::uint8_t* p, std::size_t avail)
+{
+    if (avail < frame_len<Frame>()) return need_more;
+    for (std::size_t i = 0; i < Frame::header.size(); i++) {
+        if (p[i] != Frame::header[i]) return invalid;
+    }
+
+    const std::uint8_t* payload = p + Frame::header.size();
+    if constexpr (std::is_same_v<Frame, proto::XbeeLegacyFrame>) {
+        // Readings are 7 bits so they never look like a timeout (0xFF).
+        if ((payload[0] | payload[1]) & 0x80) return invalid;
+        if (get<Sample::bits::humid>(payload) > humid_max) return invalid;
+    } else {
+        if (get<State::bits::humid>(payload) > humid_max) return invalid;
+        // The controller never sends the status request bit.
+        if (std::is_same_v<Frame, proto::XbeeStateFrame> && get<State::bits::status_req>(payload))
+            return invalid;
+    }
+    return frame_len<Frame>();
+}
+
+template <typename Frame>
+inline void append(Capture::Frames& f, const std::uint8_t* p, std::uint64_t offset)
+{
+    f.offset.push_back(offset);
+    std::size_t end = f.payload.size();
+    f.payload.resize(end + Frame::fixed);
+    std::memcpy(f.payload.data() + end, p + Frame::header.size(), Frame::fixed);
+}
+
+// Check for a frame at p and store it. Returns its length, invalid, or need_more.
+inline std::ptrdiff_t match(const std::uint8_t* p, std::size_t avail, std::uint64_t offset,
+                            Capture& out)
+{
+    FrameMatch m = match_frame(p, avail);
+    switch (m.len > 0 ? m.kind : FrameKind(frame_kinds)) {
+    case FrameKind::imp_state:
+        append<proto::ImpStateFrame>(out[FrameKind::imp_state], p, offset);
+        break;
+    case FrameKind::xbee_legacy:
+        append<proto::XbeeLegacyFrame>(out[FrameKind::xbee_legacy], p, offset);
+        break;
+    case FrameKind::xbee_state:
+        append<proto::XbeeStateFrame>(out[FrameKind::xbee_state], p, offset);
+        break;
+    default:
+        if (m.len == invalid && m.header) out.invalid++;
+        break;
+    }
+    return m.len;
+}
+
+// Byte at a time state machine; also finishes the tail of the vector scans.
+std::size_t scan_scalar(const std::uint8_t* data, std::size_t pos, std::size_t len,
+                        std::uint64_t base, Capture& out)
+{
+    while (pos < len) {
+        std::ptrdiff_t n = match(data + pos, len - pos, base + pos, out);
+        if (n == need_more) return pos;
+        pos += n > 0 ? static_cast<std::size_t>(n) : 1;
+    }
+    return pos;
+}
+
+#ifdef SHS_X86
+
+// Offsets from a header byte of the payload bytes the vector kernels check.
+constexpr std::size_t imp_humid = proto::ImpStateFrame::header.size() +
+                                  proto::ImpStateFrame::state + State::bits::humid::byte;
+constexpr std::size_t legacy_tempr = proto::XbeeLegacyFrame::header.size() +
+                                     proto::XbeeLegacyFrame::sample + Sample::bits::tempr::byte;
+constexpr std::size_t legacy_humid = proto::XbeeLegacyFrame::header.size() +
+                                     proto::XbeeLegacyFrame::sample + Sample::bits::humid::byte;
+constexpr std::size_t state_req = proto::XbeeStateFrame::header.size() +
+                                  proto::XbeeStateFrame::state + State::bits::status_req::byte;
+constexpr std::size_t state_humid = proto::XbeeStateFrame::header.size() +
+                                    proto::XbeeStateFrame::state + State::bits::humid::byte;
+
+// Bytes read past the end of a block: every frame starting in it is complete.
+constexpr std::size_t block_over = longest_frame - 1;
+
+// The vector scans run in two passes over up to pass_blocks blocks of 64 bytes at a time.
+// The first classifies every position of a block into header masks, one bit per byte; the
+// second accepts the valid frames from the masks a block at a time and stages them.
+constexpr std::size_t block = 64;
+constexpr std::size_t pass_blocks = 64;
+
+// Header positions of 16 or 32 bytes, as the compare kernels return them.
+struct LaneMasks {
+    std::uint32_t header;   // Every header, valid or not
+    std::uint32_t imp;      // Valid frames of each kind
+    std::uint32_t legacy;
+    std::uint32_t state;
+};
+
+// Header positions of one 64 byte block.
+struct BlockMasks {
+    std::uint64_t header;
+    std::uint64_t imp;
+    std::uint64_t legacy;
+    std::uint64_t state;
+};
+
+// Bytes of a block after each frame start in "starts" that the frame covers, and the bytes of
+// the next block it covers.
+template <typename Frame>
+constexpr std::uint64_t inside(std::uint64_t starts)
+{
+    std::uint64_t c = 0;
+    for (std::size_t k = 1; k < frame_len<Frame>(); k++) c |= starts << k;
+    return c;
+}
+
+template <typename Frame>
+constexpr std::uint64_t carried(std::uint64_t starts)
+{
+    std::uint64_t c = 0;
+    for (std::size_t k = 1; k < frame_len<Frame>(); k++) c |= starts >> (block - k);
+    return c;
+}
+
+// Frames accepted by the vector scans are staged on the stack and appended to the capture in
+// bulk; growing the vectors a frame at a time costs more than finding the frames.
+template <typename Frame>
+struct Staged {
+    static constexpr std::size_t cap = 256;
+
+    std::uint64_t offset[cap];
+    std::uint8_t payload[cap * Frame::fixed];
+    std::size_t n = 0;
+
+    void add(std::uint64_t bits, const std::uint8_t* p, std::uint64_t base)
+    {
+        for (; bits; bits &= bits - 1) {
+            unsigned j = static_cast<unsigned>(__builtin_ctzll(bits));
+            offset[n] = base + j;
+            std::memcpy(payload + n * Frame::fixed, p + j + Frame::header.size(), Frame::fixed);
+            n++;
+        }
+    }
+
+    void flush(Capture::Frames& f)
+    {
+        f.offset.insert(f.offset.end(), offset, offset + n);
+        f.payload.insert(f.payload.end(), payload, payload + n * Frame::fixed);
+        n = 0;
+    }
+};
+
+struct Staging {
+    Staged<proto::ImpStateFrame> imp;
+    Staged<proto::XbeeLegacyFrame> legacy;
+    Staged<proto::XbeeStateFrame> state;
+
+    // Make room for one more block.
+    void reserve(Capture& out)
+    {
+        if (imp.n + block > imp.cap) imp.flush(out[FrameKind::imp_state]);
+        if (legacy.n + block > legacy.cap) legacy.flush(out[FrameKind::xbee_legacy]);
+        if (state.n + block > state.cap) state.flush(out[FrameKind::xbee_state]);
+    }
+
+    void flush(Capture& out)
+    {
+        imp.flush(out[FrameKind::imp_state]);
+        legacy.flush(out[FrameKind::xbee_legacy]);
+        state.flush(out[FrameKind::xbee_state]);
+    }
+};
+
+// Frames to accept in a block whose valid frames overlap, walked one by one in capture order:
+// a frame starting inside one already accepted, or inside "covered", is skipped.
+inline std::uint64_t take_overlapping(const BlockMasks& m, std::uint64_t covered)
+{
+    std::uint64_t taken = 0;
+    for (std::uint64_t bits = (m.imp | m.legacy | m.state) & ~covered; bits; bits &= bits - 1) {
+        unsigned j = static_cast<unsigned>(__builtin_ctzll(bits));
+        if ((covered >> j) & 1) continue;
+        // Frame lengths: Imp state 5, XBee state 4, legacy sample 3.
+        unsigned len = frame_len<proto::XbeeStateFrame>() + ((m.imp >> j) & 1) -
+                       ((m.legacy >> j) & 1);
+        taken |= std::uint64_t(1) << j;
+        covered |= ((std::uint64_t(1) << len) - 1) << j;
+    }
+    return taken;
+}
+
+// Second pass: accept the valid frames of "n" classified blocks from "at" on in capture order,
+// and count the headers left over as invalid. "carry" holds the bytes at the start of the
+// next block that accepted frames cover.
+void take_blocks(const BlockMasks* masks, std::size_t n, const std::uint8_t* data,
+                 std::size_t at, std::uint64_t& carry, std::uint64_t base, Staging& st,
+                 Capture& out)
+{
+    using proto::ImpStateFrame;
+    using proto::XbeeLegacyFrame;
+    using proto::XbeeStateFrame;
+
+    for (std::size_t b = 0; b < n; b++, at += block) {
+        const BlockMasks& m = masks[b];
+        if (!(m.header | carry)) continue;
+
+        // Frames rarely overlap: then every valid frame not covered from the last block is
+        // accepted at once, and only a block with a frame inside another is walked.
+        std::uint64_t valid = m.imp | m.legacy | m.state;
+        std::uint64_t within = inside<ImpStateFrame>(m.imp) | inside<XbeeLegacyFrame>(m.legacy) |
+                               inside<XbeeStateFrame>(m.state);
+        std::uint64_t taken = (valid & within) ? take_overlapping(m, carry) : valid & ~carry;
+
+        std::uint64_t imp = taken & m.imp, legacy = taken & m.legacy, state = taken & m.state;
+        std::uint64_t covered = carry | taken | inside<ImpStateFrame>(imp) |
+                                inside<XbeeLegacyFrame>(legacy) | inside<XbeeStateFrame>(state);
+        carry = carried<ImpStateFrame>(imp) | carried<XbeeLegacyFrame>(legacy) |
+                carried<XbeeStateFrame>(state);
+        out.invalid += static_cast<unsigned>(__builtin_popcountll(m.header & ~valid & ~covered));
+
+        st.reserve(out);
+        const std::uint8_t* p = data + at;
+        st.imp.add(imp, p, base + at);
+        st.legacy.add(legacy, p, base + at);
+        st.state.add(state, p, base + at);
+    }
+}
+
+// Blocks the next pass can classify from "at" on, with every frame starting in them complete.
+inline std::size_t pass_size(std::size_t at, std::size_t len)
+{
+    std::size_t n = len >= at + block_over ? (len - at - block_over) / block : 0;
+    return n < pass_blocks ? n : pass_blocks;
+}
+
+// Where the scalar scan takes over after the blocks ending at "at".
+inline std::size_t resume_at(std::size_t at, std::uint64_t carry)
+{
+    return at + (carry ? block - static_cast<std::size_t>(__builtin_clzll(carry)) : 0);
+}
+
+// The same checks as try_frame(), for 16 header positions at once.
+__attribute__((target("sse2"))) inline LaneMasks block_sse2(const std::uint8_t* p)
+{
+    const __m128i low7 = _mm_set1_epi8(0x7F);
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(humid_max));
+    const __m128i none = _mm_set1_epi8(-1);
+    auto load = [p](std::size_t off) __attribute__((target("sse2"))) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + off));
+    };
+
+    __m128i v = load(0);
+    __m128i imp = _mm_and_si128(
+        _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(proto::ImpStateFrame::header[0]))),
+        _mm_cmpeq_epi8(load(1), _mm_set1_epi8(static_cast<char>(proto::ImpStateFrame::header[1]))));
+    __m128i legacy =
+        _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(proto::XbeeLegacyFrame::header[0])));
+    __m128i state =
+        _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(proto::XbeeStateFrame::header[0])));
+
+    // Humidity at most humid_max, and 7 bit readings or a clear status request bit.
+    __m128i h = _mm_and_si128(load(imp_humid), low7);
+    __m128i imp_ok = _mm_cmpeq_epi8(_mm_min_epu8(h, limit), h);
+    h = load(legacy_humid);
+    __m128i legacy_ok = _mm_and_si128(_mm_cmpeq_epi8(_mm_min_epu8(h, limit), h),
+                                      _mm_cmpgt_epi8(load(legacy_tempr), none));
+    h = _mm_and_si128(load(state_humid), low7);
+    __m128i state_ok = _mm_and_si128(_mm_cmpeq_epi8(_mm_min_epu8(h, limit), h),
+                                     _mm_cmpgt_epi8(load(state_req), none));
+
+    auto mask = [](__m128i m) __attribute__((target("sse2"))) {
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(m));
+    };
+    return {
+        mask(_mm_or_si128(imp, _mm_or_si128(legacy, state))),
+        mask(_mm_and_si128(imp, imp_ok)),
+        mask(_mm_and_si128(legacy, legacy_ok)),
+        mask(_mm_and_si128(state, state_ok)),
+    };
+}
+
+// As block_sse2(), for 32 header positions.
+__attribute__((target("avx2"))) inline LaneMasks block_avx2(const std::uint8_t* p)
+{
+    const __m256i low7 = _mm256_set1_epi8(0x7F);
+    const __m256i limit = _mm256_set1_epi8(static_cast<char>(humid_max));
+    const __m256i none = _mm256_set1_epi8(-1);
+    auto load = [p](std::size_t off) __attribute__((target("avx2"))) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + off));
+    };
+
+    __m256i v = load(0);
+    __m256i imp = _mm256_and_si256(
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(proto::ImpStateFrame::header[0]))),
+        _mm256_cmpeq_epi8(load(1),
+                          _mm256_set1_epi8(static_cast<char>(proto::ImpStateFrame::header[1]))));
+    __m256i legacy =
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(proto::XbeeLegacyFrame::header[0])));
+    __m256i state =
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(proto::XbeeStateFrame::header[0])));
+
+    __m256i h = _mm256_and_si256(load(imp_humid), low7);
+    __m256i imp_ok = _mm256_cmpeq_epi8(_mm256_min_epu8(h, limit), h);
+    h = load(legacy_humid);
+    __m256i legacy_ok = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(h, limit), h),
+                                         _mm256_cmpgt_epi8(load(legacy_tempr), none));
+    h = _mm256_and_si256(load(state_humid), low7);
+    __m256i state_ok = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(h, limit), h),
+                                        _mm256_cmpgt_epi8(load(state_req), none));
+
+    auto mask = [](__m256i m) __attribute__((target("avx2"))) {
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(m));
+    };
+    return {
+        mask(_mm256_or_si256(imp, _mm256_or_si256(legacy, state))),
+        mask(_mm256_and_si256(imp, imp_ok)),
+        mask(_mm256_and_si256(legacy, legacy_ok)),
+        mask(_mm256_and_si256(state, state_ok)),
+    };
+}
+
+__attribute__((target("sse2"))) std::size_t scan_sse2(const std::uint8_t* data, std::size_t len,
+                                                      std::uint64_t base, Capture& out)
+{
+    BlockMasks masks[pass_blocks];
+    Staging st;
+    std::uint64_t carry = 0;
+    std::size_t at = 0;
+    for (std::size_t n; (n = pass_size(at, len)) != 0; at += n * block) {
+        for (std::size_t b = 0; b < n; b++) {
+            const std::uint8_t* p = data + at + b * block;
+            LaneMasks l[4] = {block_sse2(p), block_sse2(p + 16), block_sse2(p + 32),
+                              block_sse2(p + 48)};
+            auto join = [&l](std::uint32_t LaneMasks::*f) {
+                return std::uint64_t(l[0].*f) | std::uint64_t(l[1].*f) << 16 |
+                       std::uint64_t(l[2].*f) << 32 | std::uint64_t(l[3].*f) << 48;
+            };
+            masks[b] = {join(&LaneMasks::header), join(&LaneMasks::imp),
+                        join(&LaneMasks::legacy), join(&LaneMasks::state)};
+        }
+        take_blocks(masks, n, data, at, carry, base, st, out);
+    }
+    st.flush(out);
+    return scan_scalar(data, resume_at(at, carry), len, base, out);
+}
+
+__attribute__((target("avx2"))) std::size_t scan_avx2(const std::uint8_t* data, std::size_t len,
+                                                      std::uint64_t base, Capture& out)
+{
+    BlockMasks masks[pass_blocks];
+    Staging st;
+    std::uint64_t carry = 0;
+    std::size_t at = 0;
+    for (std::size_t n; (n = pass_size(at, len)) != 0; at += n * block) {
+        for (std::size_t b = 0; b < n; b++) {
+            const std::uint8_t* p = data + at + b * block;
+            LaneMasks lo = block_avx2(p), hi = block_avx2(p + 32);
+            masks[b] = {lo.header | std::uint64_t(hi.header) << 32,
+                        lo.imp | std::uint64_t(hi.imp) << 32,
+                        lo.legacy | std::uint64_t(hi.legacy) << 32,
+                        lo.state | std::uint64_t(hi.state) << 32};
+        }
+        take_blocks(masks, n, data, at, carry, base, st, out);
+    }
+    st.flush(out);
+    return scan_scalar(data, resume_at(at, carry), len, base, out);
+}
+
+#endif  // SHS_X86
+
+}  // namespace
+
+void Capture::clear()
+{
+    for (Frames& f : frames) {
+        f.offset.clear();
+        f.payload.clear();
+    }
+    invalid = 0;
+}
+
+FrameMatch match_frame(const std::uint8_t* p, std::size_t avail)
+{
+    switch (p[0]) {
+    case proto::ImpStateFrame::header[0]:
+        // 0xA9 starts every Imp frame; only state commands are kept.
+        if (avail < 2) return {FrameKind::imp_state, need_more, true};
+        if (p[1] != proto::ImpStateFrame::header[1]) return {FrameKind::imp_state, invalid, false};
+        return {FrameKind::imp_state, try_frame<proto::ImpStateFrame>(p, avail), true};
+    case proto::XbeeLegacyFrame::header[0]:
+        return {FrameKind::xbee_legacy, try_frame<proto::XbeeLegacyFrame>(p, avail), true};
+    case proto::XbeeStateFrame::header[0]:
+        return {FrameKind::xbee_state, try_frame<proto::XbeeStateFrame>(p, avail), true};
+    default:
+        return {FrameKind::imp_state, invalid, false};
+    }
+}
+
+std::size_t scan_capture(const std::uint8_t* data, std::size_t len, std::uint64_t base,
+                         Capture& out, Isa isa)
+{
+#ifdef SHS_X86
+    if (isa == Isa::avx2) return scan_avx2(data, len, base, out);
+    if (isa == Isa::ssse3) return scan_sse2(data, len, base, out);
+#endif
+    (void) isa;
+    return scan_scalar(data, 0, len, base, out);
+}
+
+void CaptureReader::feed(const std::uint8_t* data, std::size_t len)
+{
+    std::size_t start = 0;   // Where scanning of "data" resumes
+
+    if (!carry_.empty()) {
+        // Finish the carried frame with enough new bytes to decide it, then continue in data.
+        std::size_t kept = carry_.size();
+        std::size_t take = len < longest_frame ? len : longest_frame;
+        carry_.insert(carry_.end(), data, data + take);
+        std::size_t used = scan_capture(carry_.data(), carry_.size(), offset_, out_, isa_);
+        if (used < kept) {
+            carry_.erase(carry_.begin(), carry_.begin() + static_cast<std::ptrdiff_t>(used));
+            offset_ += used;
+            return;   // Still not enough bytes; everything new is in carry_
+        }
+        start = used - kept;
+        offset_ += kept;
+        carry_.clear();
+    }
+
+    std::size_t used = start + scan_capture(data + start, len - start, offset_ + start, out_, isa_);
+    carry_.assign(data + used, data + len);
+    offset_ += used;
+}
+
+void CaptureReader::finish()
+{
+    // Whatever is left starts with a header whose frame was cut off.
+    std::size_t pos = 0;
+    while (pos < carry_.size()) {
+        pos += scan_capture(carry_.data() + pos, carry_.size() - pos, offset_ + pos, out_, isa_);
+        if (pos < carry_.size()) {
+            out_.invalid++;
+            pos++;
+        }
+    }
+    offset_ += carry_.size();
+    carry_.clear();
+}
+
+}  // namespace shs
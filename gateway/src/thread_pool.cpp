@@ -0,0 +1,154 @@
+// thread_pool.cpp - Work-stealing thread pool and strands for the gateway's stages.
+
+#include "shs/thread_pool.hpp"
+
+namespace shs {
+
+namespace {
+
+// Index of the pool worker running on this thread, if any.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local std::size_t current_worker = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(std::size_t threads)
+{
+    if (threads == 0) threads = 1;
+    for (std::size_t i = 0; i < threads; i++) workers_.push_back(std::make_unique<Worker>());
+    for (std::size_t i = 0; i < threads; i++) {
+        workers_[i]->thread = std::thread([this, i] { run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait_idle();
+    {
+        std::lock_guard<std::mutex> lock(sleep_m_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& w : workers_) w->thread.join();
+}
+
+void ThreadPool::submit(Task t, bool defer)
+{
+    bool local = current_pool == this;
+    std::size_t target =
+        local ? current_worker : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    {
+        // The owner pops from the back and thieves take from the front.
+        std::lock_guard<std::mutex> lock(workers_[target]->m);
+        if (local && defer) {
+            workers_[target]->q.push_front(t);
+        } else {
+            workers_[target]->q.push_back(t);
+        }
+    }
+    queued_.fetch_add(1, std::memory_order_release);
+
+    // Taking the lock orders this wake-up after a worker's last check of queued_.
+    { std::lock_guard<std::mutex> lock(sleep_m_); }
+    work_cv_.notify_one();
+}
+
+bool ThreadPool::pop(std::size_t self, Task& t)
+{
+    {
+        Worker& w = *workers_[self];
+        std::lock_guard<std::mutex> lock(w.m);
+        if (!w.q.empty()) {
+            t = w.q.back();
+            w.q.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another worker, starting after this one so thieves spread out.
+    for (std::size_t i = 1; i < workers_.size(); i++) {
+        Worker& v = *workers_[(self + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(v.m);
+        if (!v.q.empty()) {
+            t = v.q.front();
+            v.q.pop_front();
+            workers_[self]->stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(std::size_t self)
+{
+    current_pool = this;
+    current_worker = self;
+
+    for (;;) {
+        Task t;
+        if (pop(self, t)) {
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            t.fn(t.arg);
+            workers_[self]->executed.fetch_add(1, std::memory_order_relaxed);
+            if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(sleep_m_);
+                idle_cv_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_m_);
+        work_cv_.wait(lock, [this] { return stop_ || queued_.load(std::memory_order_acquire) > 0; });
+        if (stop_) return;
+    }
+}
+
+void ThreadPool::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(sleep_m_);
+    idle_cv_.wait(lock, [this] { return pending_.load(std::memory_order_acquire) == 0; });
+}
+
+ThreadPool::Stats ThreadPool::stats() const
+{
+    Stats s;
+    for (const auto& w : workers_) {
+        s.executed += w->executed.load(std::memory_order_relaxed);
+        s.stolen += w->stolen.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+void Strand::post(Task t)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        q_.push_back(t);
+        if (scheduled_) return;
+        scheduled_ = true;
+    }
+    pool_.submit({&Strand::run, this});
+}
+
+void Strand::run(void* self)
+{
+    auto* s = static_cast<Strand*>(self);
+    for (int n = 0; n < turn; n++) {
+        Task t;
+        {
+            std::lock_guard<std::mutex> lock(s->m_);
+            if (s->q_.empty()) {
+                s->scheduled_ = false;
+                return;
+            }
+            t = s->q_.front();
+            s->q_.pop_front();
+        }
+        t.fn(t.arg);
+    }
+    // Still busy: let the worker's other tasks run first.
+    s->pool_.submit({&Strand::run, s}, true);
+}
+
+}  // namespace shs
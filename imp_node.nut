@@ -3,7 +3,254 @@
 // Imp Code - Squirrel
 
 
+// BEGIN GENERATED FRAMES - Generated by tools/gen_codec.py from protocol/frames.schema. Do not edit.
+
+const IMP_HDR = 0xA9;
+const IMP_STATE = 0x65;
+const IMP_SCENE = 0x66;
+const IMP_SCENE_SET = 0x67;
+const IMP_RULE_SET = 0x68;
+const IMP_CLOCK = 0x69;
+const IMP_ZONE_SET = 0x6A;
+const IMP_TELEMETRY = 0x6B;
+const IMP_COMMAND_ID = 0x6C;
+const IMP_SETTINGS_GET = 0x6D;
+const IMP_SETTINGS_PUT = 0x6E;
+const IMP_SENSORS = 0xAD;
+const IMP_ACK = 0xAC;
+const XBEE_POLL = 0xE4;
+const XBEE_BATCH = 0xE5;
+const XBEE_LEGACY = 0xE3;
+const XBEE_STATE = 0xD4;
+
+// Frame payloads: <FRAME>_LEN bytes before any repeated item, <FRAME>_<ITEM> offsets
+const IMP_STATE_LEN = 3;
+const IMP_STATE_STATE = 0;
+const IMP_SCENE_LEN = 1;
+const IMP_SCENE_SCENE = 0;
+const IMP_SCENE_SET_LEN = 4;
+const IMP_SCENE_SET_SCENE = 0;
+const IMP_SCENE_SET_STATE = 1;
+const IMP_RULE_SET_LEN = 5;
+const IMP_RULE_SET_INDEX = 0;
+const IMP_RULE_SET_RULE = 1;
+const IMP_CLOCK_LEN = 2;
+const IMP_CLOCK_HOUR = 0;
+const IMP_CLOCK_MINUTE = 1;
+const IMP_ZONE_SET_LEN = 2;
+const IMP_ZONE_SET_NODE = 0;
+const IMP_ZONE_SET_ZONE_MAP = 1;
+const IMP_TELEMETRY_LEN = 0;
+const IMP_COMMAND_ID_LEN = 1;
+const IMP_COMMAND_ID_ID = 0;
+const IMP_SETTINGS_GET_LEN = 0;
+const IMP_SETTINGS_PUT_LEN = 3;
+const IMP_SETTINGS_PUT_SIZE = 0;
+const IMP_SETTINGS_PUT_SETTINGS_CHECK = 1;
+const IMP_SETTINGS_PUT_IMAGE = 3;
+const IMP_STATUS_LEN = 4;
+const IMP_STATUS_STATE = 0;
+const IMP_STATUS_SENSORS = 3;
+const IMP_SENSORS_LEN = 1;
+const IMP_SENSORS_SENSORS = 0;
+const IMP_REPORT_LEN = 16;
+const IMP_REPORT_TELEMETRY = 0;
+const IMP_ACK_LEN = 1;
+const IMP_ACK_ID = 0;
+const IMP_SETTINGS_LEN = 3;
+const IMP_SETTINGS_SIZE = 0;
+const IMP_SETTINGS_SETTINGS_CHECK = 1;
+const IMP_SETTINGS_IMAGE = 3;
+const AUX_COMMAND_LEN = 2;
+const AUX_COMMAND_AUX = 0;
+const XBEE_POLL_LEN = 2;
+const XBEE_POLL_NODE = 0;
+const XBEE_POLL_ACK = 1;
+const XBEE_BATCH_LEN = 3;
+const XBEE_BATCH_NODE = 0;
+const XBEE_BATCH_COUNT = 1;
+const XBEE_BATCH_SEQ = 2;
+const XBEE_BATCH_SAMPLES = 3;
+const XBEE_LEGACY_LEN = 2;
+const XBEE_LEGACY_SAMPLE = 0;
+const XBEE_STATE_LEN = 3;
+const XBEE_STATE_STATE = 0;
+
+// Field tables: name -> [byte, shift, mask]
+const STATE_SIZE = 3;
+STATE_FIELDS <- {
+    call_cool = [0, 0, 0x01],
+    ac_auto = [0, 1, 0x01],
+    fan = [0, 2, 0x01],
+    heater = [0, 3, 0x01],
+    cooler = [0, 4, 0x01],
+    lights = [0, 5, 0x01],
+    lights_auto = [0, 6, 0x01],
+    call_heat = [0, 7, 0x01],
+    tempr = [1, 0, 0x7F],
+    status_req = [1, 7, 0x01],
+    humid = [2, 0, 0x7F],
+    humid_on = [2, 7, 0x01],
+};
+const AUX_SIZE = 2;
+AUX_FIELDS <- {
+    device = [0, 0, 0x01],
+    ac_auto = [0, 1, 0x01],
+    fan = [0, 2, 0x01],
+    heater = [0, 3, 0x01],
+    cooler = [0, 4, 0x01],
+    lights = [0, 5, 0x01],
+    lights_auto = [0, 6, 0x01],
+    tempr = [1, 0, 0x7F],
+    status_req = [1, 7, 0x01],
+};
+const SAMPLE_SIZE = 2;
+SAMPLE_FIELDS <- {
+    tempr = [0, 0, 0x7F],
+    humid = [1, 0, 0x7F],
+};
+const RULE_SIZE = 4;
+RULE_FIELDS <- {
+    cmp = [0, 3, 0x03],
+    src = [0, 5, 0x07],
+    operand = [1, 0, 0xFF],
+    action = [2, 4, 0x0F],
+    arg = [3, 0, 0xFF],
+};
+const ZONE_MAP_SIZE = 1;
+ZONE_MAP_FIELDS <- {
+    weight = [0, 0, 0x0F],
+    zone = [0, 4, 0x03],
+};
+const TELEMETRY_SIZE = 16;
+TELEMETRY_FIELDS <- {
+    polls_lo = [0, 0, 0xFF],
+    polls_hi = [1, 0, 0xFF],
+    samples_lo = [2, 0, 0xFF],
+    samples_hi = [3, 0, 0xFF],
+    timeouts_lo = [4, 0, 0xFF],
+    timeouts_hi = [5, 0, 0xFF],
+    spin_lo = [6, 0, 0xFF],
+    spin_hi = [7, 0, 0xFF],
+    poll_interval = [8, 0, 0xFF],
+    dups = [9, 0, 0xFF],
+    stack_free_lo = [10, 0, 0xFF],
+    stack_free_hi = [11, 0, 0xFF],
+    reset_reason = [12, 0, 0xFF],
+    reset_info = [13, 0, 0xFF],
+    resets = [14, 0, 0xFF],
+    lcd_faults = [15, 0, 0x7F],
+    lcd_offline = [15, 7, 0x01],
+};
+const SENSORS_SIZE = 1;
+SENSORS_FIELDS <- {
+    stale = [0, 0, 0x0F],
+    hold = [0, 4, 0x01],
+    shutdown = [0, 5, 0x01],
+};
+const SETTINGS_CHECK_SIZE = 2;
+SETTINGS_CHECK_FIELDS <- {
+    sum_a = [0, 0, 0xFF],
+    sum_b = [1, 0, 0xFF],
+};
+
+// layoutUnpack() reads every field of a layout from blob b at offset into a table.
+function layoutUnpack(fields, b, offset)
+{
+    local t = {};
+    foreach (name, f in fields) t[name] <- (b[offset + f[0]] >> f[1]) & f[2];
+    return t;
+}
+
+// layoutPack() writes the fields present in table t into a new blob of the layout's size.
+function layoutPack(fields, size, t)
+{
+    local b = blob(size);
+    for (local i = 0; i < size; i++) b[i] = 0;
+    foreach (name, f in fields) {
+        if (name in t) b[f[0]] = b[f[0]] | ((t[name] & f[2]) << f[1]);
+    }
+    return b;
+}
+
+// frameBlob() builds a frame from its header bytes and an array of payload bytes or blobs.
+function frameBlob(header, payload)
+{
+    local b = blob();
+    foreach (h in header) b.writen(h, 'b');
+    foreach (p in payload) {
+        if (typeof p == "blob") b.writeblob(p);
+        else b.writen(p, 'b');
+    }
+    return b;
+}
+
+// END GENERATED FRAMES
+
+const STATUS_FRESH = 10;    // Seconds a cached state frame still answers status requests, as
+                            //  long as STATE_POLL: an older one may have missed a change
+const STATUS_WAIT = 2;      // Seconds to wait for the controller to answer a status request
+const STATE_POLL = 10;      // Seconds between status requests that keep the cache current
+const CLIENT_IDLE = 300;    // Seconds after the agent's last status request that polling stops
+const CMD_RETRY = 1;        // Seconds to wait for the controller to acknowledge a command
+const CMD_TRIES = 3;        // Times a command is written before it is given up
+const SETTINGS_WAIT = 5;    // Seconds to wait for the controller to send its settings image
+
+// ---------- DIAGNOSTICS ----------
+
+// server.log() is a network transmission on the Imp, so the data path only counts events.
+//  The counts go to the agent once every DIAG_PERIOD seconds, and the agent logs the summary.
+//  Messages are logged only at or below the level the agent sets, and the same message at
+//  most once every "every" times it happens within a period.
+const LOG_ERROR = 0;
+const LOG_WARN = 1;
+const LOG_INFO = 2;
+const LOG_DEBUG = 3;
+const DIAG_PERIOD = 300;
+
+local logLevel = LOG_WARN;
+local diagCounts = {};      // Events since the last summary
+local diagSeen = {};        // Times each message key came up since the last summary
+
+// diagCount() adds n to the count of event "name".
+function diagCount(name, n = 1)
+{
+    if (name in diagCounts) diagCounts[name] += n;
+    else diagCounts[name] <- n;
+}
+
+// diagLog() logs msg if "level" is enabled and it is the first, or every "every"th, time
+//  "key" came up this period. Dropped messages are counted.
+function diagLog(level, key, msg, every = 1)
+{
+    if (level > logLevel) return;
+    local n = (key in diagSeen) ? diagSeen[key] : 0;
+    diagSeen[key] <- n + 1;
+    if (n % every != 0) {
+        diagCount("log_dropped");
+        return;
+    }
+    if (level == LOG_ERROR) server.error(msg);
+    else server.log(msg);
+}
+
+// diagSummary() sends the period's counts to the agent and starts a new period.
+function diagSummary()
+{
+    imp.wakeup(DIAG_PERIOD, diagSummary);
+    if (diagCounts.len() == 0) return;
+    agent.send("impDiag", diagCounts);
+    diagCounts = {};
+    diagSeen = {};
+}
+
 local haveNewData=0;
+local reply = null;         // Frame being collected from the controller: { buf, size, done }
+local stateCache = null;    // Last state frame from the controller: { packet, time }
+local sensorStatus = 0;     // Last sensor status from the controller, a SENSORS_SIZE byte
+local pending = {};         // Commands not yet acknowledged, by command ID: { frame, tries }
+local statusAsked = null;   // When the agent last asked for the status, for pollStatus()
+local polling = false;      // pollStatus() is scheduled
 atmel <- hardware.uart57;
 function initUart()
 {
@@ -13,32 +260,291 @@ function initUart()
     atmel.configure(9600, 8, PARITY_NONE, 1, NO_CTSRTS, serialRead);
 }
 
+// writeFrame() writes an Imp frame with ID "id" and the given payload items to the controller.
+function writeFrame(id, payload)
+{
+    local frame = frameBlob([IMP_HDR, id], payload);
+    atmel.write(frame);
+    diagCount("tx_frames");
+    diagCount("tx_bytes", frame.len());
+}
+
+// writeCommand() writes frame "frameId" behind a command ID prefix and resends it every
+//  CMD_RETRY seconds until the controller acknowledges "id". The controller applies an ID only
+//  once, so a resend whose first copy did arrive is acknowledged but not repeated.
+function writeCommand(id, frameId, payload)
+{
+    local frame = frameBlob([IMP_HDR, IMP_COMMAND_ID, id, IMP_HDR, frameId], payload);
+    pending[id] <- { frame = frame, tries = 0 };
+    resendCommand(id);
+}
+
+// resendCommand() writes pending command "id" again, or gives it up after CMD_TRIES writes.
+function resendCommand(id)
+{
+    if (!(id in pending)) return;
+    local cmd = pending[id];
+    if (cmd.tries == CMD_TRIES) {
+        delete pending[id];
+        diagCount("cmd_lost");
+        diagLog(LOG_WARN, "cmd_lost", "Controller did not acknowledge command " + id, 10);
+        return;
+    }
+    if (cmd.tries > 0) diagCount("cmd_retries");
+    cmd.tries++;
+    atmel.write(cmd.frame);
+    diagCount("tx_frames");
+    diagCount("tx_bytes", cmd.frame.len());
+    imp.wakeup(CMD_RETRY, function() { resendCommand(id); });
+}
+
+// commandAcked() stops resending the command the controller acknowledged, and asks for the
+//  state the command left behind.
+function commandAcked(ack)
+{
+    local id = ack[IMP_ACK_ID];
+    if (id in pending) {
+        delete pending[id];
+        agent.send("impAck", id);
+        askStatus();
+    } else {
+        diagCount("cmd_late_acks");
+    }
+}
+
+// collect() makes the next "size" bytes from the controller a frame, handed to done() as a blob.
+function collect(size, done)
+{
+    reply = { buf = blob(), size = size, done = done };
+}
+
 // serialRead() will be called whenever serial data is passed to the imp. It
-//  will read the data in, and send it out to the agent.
+//  will read the data in, and send it out to the agent. The controller steers its transmit
+//  line to the Imp or the XBee, so the state broadcasts it sends the sensors never arrive
+//  here; the state comes only as the reply to a status request from askStatus().
+//  Everything goes to the agent as raw bytes in a blob; the agent decodes the fields.
 function serialRead()
 {
-    server.log("Imp reading data");
-    local c = atmel.read(); // Read serial char into variable c
-    local t = atmel.read();
+    if (reply == null) {
+        local c = atmel.read(); // Read serial char into variable c
+        if (c < 0) return;
+        diagCount("rx_bytes");
+        if (c == IMP_SENSORS) {
+            collect(SENSORS_SIZE, cacheSensors);
+        } else if (c == IMP_ACK) {
+            collect(IMP_ACK_LEN, commandAcked);
+        } else {
+            // Anything else is passed on as it came.
+            local data = blob();
+            do data.writen(c, 'b'); while ((c = atmel.read()) >= 0);
+            agent.send("impSerialIn", data);
+            diagCount("rx_bytes", data.len() - 1);
+            diagCount("rx_unframed");
+            diagLog(LOG_DEBUG, "unframed", "Unframed data from the controller", 10);
+            return;
+        }
+    }
+    
+    local c;
+    while (reply.buf.len() < reply.size && (c = atmel.read()) >= 0) {
+        diagCount("rx_bytes");
+        if ("sensors" in reply) {
+            // The status byte of a sensor frame that came ahead of the reply
+            delete reply.sensors;
+            local status = blob(SENSORS_SIZE);
+            status.writen(c, 'b');
+            cacheSensors(status);
+        } else if (reply.buf.len() == 0 && ("status" in reply) && c == IMP_SENSORS) {
+            reply.sensors <- true;
+            diagCount("status_sensors_skipped");
+        } else {
+            reply.buf.writen(c, 'b');
+        }
+    }
+    if (reply.buf.len() < reply.size) return;
     
-    local dataString = c.tostring() + t.tostring();
-    server.log(dataString);
+    local done = reply.done;
+    local buf = reply.buf;
+    reply = null;
+    done(buf);
+    serialRead();   // More may have arrived behind this frame
+}
+
+// cacheState() keeps the state the controller sent in reply to a status request, with the time
+//  it came, and passes it on to the agent if it changed or "force" is set.
+function cacheState(packet, force = false)
+{
+    local changed = stateCache == null;
+    for (local i = 0; !changed && i < STATE_SIZE; i++) changed = stateCache.packet[i] != packet[i];
+    diagCount(changed ? "state_changed" : "state_same");
+    stateCache = { packet = packet, time = time() };
+    if (force || changed) pushState();
+}
+
+// cacheSensors() keeps the sensor status the controller sends behind each state broadcast, and
+//  passes a change on to the agent at once: it decides whether the state can be trusted.
+function cacheSensors(status)
+{
+    if (status[0] == sensorStatus) return;
+    sensorStatus = status[0];
+    diagCount("sensors_changed");
+    if (stateCache != null) pushState();
+}
+
+// pushState() sends the agent the cached state packet and sensor status, followed by the age of
+//  the state in seconds, 16 bits low byte first.
+function pushState()
+{
+    local msg = blob(STATE_SIZE + SENSORS_SIZE + 2);
+    msg.writeblob(stateCache.packet);
+    msg.writen(sensorStatus, 'b');
+    msg.writen(time() - stateCache.time, 'w');
+    agent.send("impState", msg);
+}
+
+// askStatus() asks the controller for its state and sensor status, and caches the reply.
+//  "force" passes the reply on to the agent even if the state did not change; if no reply
+//  comes then, the stale copy is sent. Nothing is asked while another reply is expected.
+//  The reply has no header, but a sensor frame the controller sends after a poll can come
+//  ahead of it: one is taken as such, since a state packet never starts with IMP_SENSORS (it
+//  would call for heat and cooling at once).
+function askStatus(force = false)
+{
+    if (reply != null) return;
     
-    agent.send("impSerialIn", dataString);
+    diagCount("status_asked");
+    collect(STATE_SIZE + SENSORS_SIZE, function(status) {
+        sensorStatus = status[STATE_SIZE];
+        cacheState(status.readblob(STATE_SIZE), force);
+    });
+    reply.status <- true;
+    local ask = reply;
+    writeFrame(IMP_STATE, [layoutPack(STATE_FIELDS, STATE_SIZE, { status_req = 1 })]);
+    imp.wakeup(STATUS_WAIT, function() {
+        if (reply != ask) return;
+        reply = null;
+        diagCount("status_timeouts");
+        diagLog(LOG_WARN, "status_timeout", "Controller did not answer a status request", 10);
+        if (force && stateCache != null) pushState();
+    });
+}
+
+// pollStatus() asks for the state every STATE_POLL seconds, so changes made at the controller
+//  itself (its buttons, rules, scenes) reach the cache and the agent too. It stops once the
+//  agent has not asked for the status for CLIENT_IDLE seconds, leaving the UART to commands.
+function pollStatus()
+{
+    if (statusAsked == null || time() - statusAsked > CLIENT_IDLE) {
+        polling = false;
+        return;
+    }
+    imp.wakeup(STATE_POLL, pollStatus);
+    askStatus();
+}
+
+// requestStatus() answers a status request from the cache while it is fresh. Otherwise it asks
+//  the controller, whose reply refreshes the cache. Either way it keeps pollStatus() going.
+function requestStatus(unused) {
+    statusAsked = time();
+    if (!polling) {
+        polling = true;
+        imp.wakeup(STATE_POLL, pollStatus);
+    }
+    if (stateCache != null && time() - stateCache.time <= STATUS_FRESH) {
+        diagCount("status_cached");
+        pushState();
+        return;
+    }
+    askStatus(true);
+}
+
+// The agent sends each command as a blob holding its command ID followed by the frame's
+//  payload laid out as in frames.schema; the Imp adds the headers and writes it out unchanged.
+
+// commandHandler() returns a handler that writes the agent's command as frame "frameId". In
+//  the handlers below, data[] is the payload that follows the command ID.
+function commandHandler(frameId)
+{
+    return function(data) {
+        data.seek(1);
+        writeCommand(data[0], frameId, [data.readblob(data.len() - 1)]);
+    };
+}
+
+// sendCommand() sets the controller's state to the STATE_SIZE byte packet in "packet".
+local sendCommand = commandHandler(IMP_STATE);
+
+// sendScene() asks the controller to apply the scene stored in slot data[0]. The whole scene
+//  goes out as one frame; the settings themselves live in the controller's EEPROM.
+local sendScene = commandHandler(IMP_SCENE);
+
+// storeScene() programs scene slot data[0] with the state packet in data[1..3].
+local storeScene = commandHandler(IMP_SCENE_SET);
+
+// storeRule() programs automation rule slot data[0] with the 4 rule bytes in data[1..4].
+local storeRule = commandHandler(IMP_RULE_SET);
+
+// setClock() sets the controller's time of day, used by time based rules: data[0] is the hour
+//  and data[1] the minute.
+local setClock = commandHandler(IMP_CLOCK);
+
+// setZone() maps sensor node data[0] to a zone and weight: data[1] = zone << 4 | weight.
+local setZone = commandHandler(IMP_ZONE_SET);
+
+// restoreSettings() writes a whole settings image to the controller: data[] is the size byte,
+//  the check bytes and the image, as the agent had them from "impSettings".
+local restoreSettings = commandHandler(IMP_SETTINGS_PUT);
+
+// requestTelemetry() asks the controller for its telemetry counters. The reply is the next
+//  TELEMETRY_SIZE bytes from the controller.
+function requestTelemetry(unused) {
+    if (reply != null) return;
+    collect(TELEMETRY_SIZE, sendReport);
+    writeFrame(IMP_TELEMETRY, []);
 }
 
-function sendCommand(command) {
-    atmel.write(command.tostring());
-    server.log("Imp sending data:");
-    server.log(command.tostring());
+// requestSettings() asks the controller for its settings image. The reply is a size byte and
+//  the check bytes, then "size" image bytes; all of it goes to the agent, which verifies it.
+function requestSettings(unused) {
+    if (reply != null) return;
+    local ask = {};     // Marks both parts of this reply, for the timeout
+    collect(1 + SETTINGS_CHECK_SIZE, function(head) {
+        collect(head[0], function(image) {
+            head.seek(0, 'e');
+            head.writeblob(image);
+            agent.send("impSettings", head);
+        });
+        reply.ask <- ask;
+    });
+    reply.ask <- ask;
+    writeFrame(IMP_SETTINGS_GET, []);
+    imp.wakeup(SETTINGS_WAIT, function() {
+        if (reply == null || !("ask" in reply) || reply.ask != ask) return;
+        reply = null;
+        diagCount("settings_timeouts");
+        diagLog(LOG_WARN, "settings_timeout", "Controller did not send its settings", 10);
+    });
+}
+
+// sendReport() passes the telemetry reply to the agent as it came.
+function sendReport(report)
+{
+    agent.send("impTelemetry", report);
 }
 
 // agent.on("dataToSerial") will be called whenever the agent passes data labeled
 //  "dataToSerial" over to the device. This data should be sent out the serial
-//  port, to the Arduino.
-agent.on("dataToSerial", function(c)
+//  port, to the controller.
+agent.on("dataToSerial", function(data)
 {
-    arduino.write(c.tostring()); // Write the data out the serial port.
+    atmel.write(data); // Write the blob out the serial port.
+    diagCount("tx_bytes", data.len());
+});
+
+// agent.on("logLevel") sets which diagnostic messages are logged (LOG_ERROR to LOG_DEBUG).
+agent.on("logLevel", function(level)
+{
+    logLevel = level;
 });
 
 
@@ -46,10 +552,25 @@ agent.on("dataToSerial", function(c)
 // Setup //
 server.log("Serial Pipeline Open!"); // A warm greeting to indicate we've begun
 initUart(); // Initialize the LEDs
+imp.wakeup(DIAG_PERIOD, diagSummary);
+askStatus();
 
 //send command to uart
 agent.on("command", sendCommand);
 
+//scene activation and storage
+agent.on("scene", sendScene);
+agent.on("sceneStore", storeScene);
+
+//automation rules and the clock they run on
+agent.on("rule", storeRule);
+agent.on("clock", setClock);
+agent.on("zone", setZone);
+agent.on("telemetry", requestTelemetry);
+agent.on("status", requestStatus);
+agent.on("settings", requestSettings);
+agent.on("settingsRestore", restoreSettings);
+
 ///EOF
 
 
@@ -0,0 +1,288 @@
+/*************************************************************
+ *       shs_frames.h - Frame layouts shared by the AVR firmware.
+ *
+ *       Generated by tools/gen_codec.py from protocol/frames.schema. Do not edit.
+ *
+ *       <layout>_<field>(p) reads a field from a payload at p, <layout>_set_<field>(p, v)
+ *       writes one, and <LAYOUT>_<FIELD>_MASK is the field's bits within its byte.
+ *************************************************************/
+
+#ifndef SHS_FRAMES_H
+#define SHS_FRAMES_H
+
+#include <stdint.h>
+
+// ---------- PAYLOAD LAYOUTS ----------
+
+#define STATE_SIZE                       3
+#define STATE_CALL_COOL_MASK             0x01
+#define STATE_AC_AUTO_MASK               0x02
+#define STATE_FAN_MASK                   0x04
+#define STATE_HEATER_MASK                0x08
+#define STATE_COOLER_MASK                0x10
+#define STATE_LIGHTS_MASK                0x20
+#define STATE_LIGHTS_AUTO_MASK           0x40
+#define STATE_CALL_HEAT_MASK             0x80
+#define STATE_TEMPR_MASK                 0x7F
+#define STATE_STATUS_REQ_MASK            0x80
+#define STATE_HUMID_MASK                 0x7F
+#define STATE_HUMID_ON_MASK              0x80
+
+static inline uint8_t state_call_cool(const uint8_t * p) { return p[0] & 0x01; }
+static inline uint8_t state_ac_auto(const uint8_t * p) { return (p[0] >> 1) & 0x01; }
+static inline uint8_t state_fan(const uint8_t * p) { return (p[0] >> 2) & 0x01; }
+static inline uint8_t state_heater(const uint8_t * p) { return (p[0] >> 3) & 0x01; }
+static inline uint8_t state_cooler(const uint8_t * p) { return (p[0] >> 4) & 0x01; }
+static inline uint8_t state_lights(const uint8_t * p) { return (p[0] >> 5) & 0x01; }
+static inline uint8_t state_lights_auto(const uint8_t * p) { return (p[0] >> 6) & 0x01; }
+static inline uint8_t state_call_heat(const uint8_t * p) { return (p[0] >> 7) & 0x01; }
+static inline uint8_t state_tempr(const uint8_t * p) { return p[1] & 0x7F; }
+static inline uint8_t state_status_req(const uint8_t * p) { return (p[1] >> 7) & 0x01; }
+static inline uint8_t state_humid(const uint8_t * p) { return p[2] & 0x7F; }
+static inline uint8_t state_humid_on(const uint8_t * p) { return (p[2] >> 7) & 0x01; }
+static inline void state_set_call_cool(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xFE) | ((v << 0) & 0x01)); }
+static inline void state_set_ac_auto(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xFD) | ((v << 1) & 0x02)); }
+static inline void state_set_fan(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xFB) | ((v << 2) & 0x04)); }
+static inline void state_set_heater(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xF7) | ((v << 3) & 0x08)); }
+static inline void state_set_cooler(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xEF) | ((v << 4) & 0x10)); }
+static inline void state_set_lights(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xDF) | ((v << 5) & 0x20)); }
+static inline void state_set_lights_auto(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xBF) | ((v << 6) & 0x40)); }
+static inline void state_set_call_heat(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0x7F) | ((v << 7) & 0x80)); }
+static inline void state_set_tempr(uint8_t * p, uint8_t v) { p[1] = (uint8_t) ((p[1] & 0x80) | ((v << 0) & 0x7F)); }
+static inline void state_set_status_req(uint8_t * p, uint8_t v) { p[1] = (uint8_t) ((p[1] & 0x7F) | ((v << 7) & 0x80)); }
+static inline void state_set_humid(uint8_t * p, uint8_t v) { p[2] = (uint8_t) ((p[2] & 0x80) | ((v << 0) & 0x7F)); }
+static inline void state_set_humid_on(uint8_t * p, uint8_t v) { p[2] = (uint8_t) ((p[2] & 0x7F) | ((v << 7) & 0x80)); }
+
+#define AUX_SIZE                         2
+#define AUX_DEVICE_MASK                  0x01
+#define AUX_AC_AUTO_MASK                 0x02
+#define AUX_FAN_MASK                     0x04
+#define AUX_HEATER_MASK                  0x08
+#define AUX_COOLER_MASK                  0x10
+#define AUX_LIGHTS_MASK                  0x20
+#define AUX_LIGHTS_AUTO_MASK             0x40
+#define AUX_TEMPR_MASK                   0x7F
+#define AUX_STATUS_REQ_MASK              0x80
+
+static inline uint8_t aux_device(const uint8_t * p) { return p[0] & 0x01; }
+static inline uint8_t aux_ac_auto(const uint8_t * p) { return (p[0] >> 1) & 0x01; }
+static inline uint8_t aux_fan(const uint8_t * p) { return (p[0] >> 2) & 0x01; }
+static inline uint8_t aux_heater(const uint8_t * p) { return (p[0] >> 3) & 0x01; }
+static inline uint8_t aux_cooler(const uint8_t * p) { return (p[0] >> 4) & 0x01; }
+static inline uint8_t aux_lights(const uint8_t * p) { return (p[0] >> 5) & 0x01; }
+static inline uint8_t aux_lights_auto(const uint8_t * p) { return (p[0] >> 6) & 0x01; }
+static inline uint8_t aux_tempr(const uint8_t * p) { return p[1] & 0x7F; }
+static inline uint8_t aux_status_req(const uint8_t * p) { return (p[1] >> 7) & 0x01; }
+static inline void aux_set_device(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xFE) | ((v << 0) & 0x01)); }
+static inline void aux_set_ac_auto(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xFD) | ((v << 1) & 0x02)); }
+static inline void aux_set_fan(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xFB) | ((v << 2) & 0x04)); }
+static inline void aux_set_heater(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xF7) | ((v << 3) & 0x08)); }
+static inline void aux_set_cooler(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xEF) | ((v << 4) & 0x10)); }
+static inline void aux_set_lights(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xDF) | ((v << 5) & 0x20)); }
+static inline void aux_set_lights_auto(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xBF) | ((v << 6) & 0x40)); }
+static inline void aux_set_tempr(uint8_t * p, uint8_t v) { p[1] = (uint8_t) ((p[1] & 0x80) | ((v << 0) & 0x7F)); }
+static inline void aux_set_status_req(uint8_t * p, uint8_t v) { p[1] = (uint8_t) ((p[1] & 0x7F) | ((v << 7) & 0x80)); }
+
+#define SAMPLE_SIZE                      2
+#define SAMPLE_TEMPR_MASK                0x7F
+#define SAMPLE_HUMID_MASK                0x7F
+
+static inline uint8_t sample_tempr(const uint8_t * p) { return p[0] & 0x7F; }
+static inline uint8_t sample_humid(const uint8_t * p) { return p[1] & 0x7F; }
+static inline void sample_set_tempr(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0x80) | ((v << 0) & 0x7F)); }
+static inline void sample_set_humid(uint8_t * p, uint8_t v) { p[1] = (uint8_t) ((p[1] & 0x80) | ((v << 0) & 0x7F)); }
+
+#define RULE_SIZE                        4
+#define RULE_CMP_MASK                    0x18
+#define RULE_SRC_MASK                    0xE0
+#define RULE_OPERAND_MASK                0xFF
+#define RULE_ACTION_MASK                 0xF0
+#define RULE_ARG_MASK                    0xFF
+
+static inline uint8_t rule_cmp(const uint8_t * p) { return (p[0] >> 3) & 0x03; }
+static inline uint8_t rule_src(const uint8_t * p) { return (p[0] >> 5) & 0x07; }
+static inline uint8_t rule_operand(const uint8_t * p) { return p[1]; }
+static inline uint8_t rule_action(const uint8_t * p) { return (p[2] >> 4) & 0x0F; }
+static inline uint8_t rule_arg(const uint8_t * p) { return p[3]; }
+static inline void rule_set_cmp(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xE7) | ((v << 3) & 0x18)); }
+static inline void rule_set_src(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0x1F) | ((v << 5) & 0xE0)); }
+static inline void rule_set_operand(uint8_t * p, uint8_t v) { p[1] = v; }
+static inline void rule_set_action(uint8_t * p, uint8_t v) { p[2] = (uint8_t) ((p[2] & 0x0F) | ((v << 4) & 0xF0)); }
+static inline void rule_set_arg(uint8_t * p, uint8_t v) { p[3] = v; }
+
+#define ZONE_MAP_SIZE                    1
+#define ZONE_MAP_WEIGHT_MASK             0x0F
+#define ZONE_MAP_ZONE_MASK               0x30
+
+static inline uint8_t zone_map_weight(const uint8_t * p) { return p[0] & 0x0F; }
+static inline uint8_t zone_map_zone(const uint8_t * p) { return (p[0] >> 4) & 0x03; }
+static inline void zone_map_set_weight(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xF0) | ((v << 0) & 0x0F)); }
+static inline void zone_map_set_zone(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xCF) | ((v << 4) & 0x30)); }
+
+#define TELEMETRY_SIZE                   16
+#define TELEMETRY_POLLS_LO_MASK          0xFF
+#define TELEMETRY_POLLS_HI_MASK          0xFF
+#define TELEMETRY_SAMPLES_LO_MASK        0xFF
+#define TELEMETRY_SAMPLES_HI_MASK        0xFF
+#define TELEMETRY_TIMEOUTS_LO_MASK       0xFF
+#define TELEMETRY_TIMEOUTS_HI_MASK       0xFF
+#define TELEMETRY_SPIN_LO_MASK           0xFF
+#define TELEMETRY_SPIN_HI_MASK           0xFF
+#define TELEMETRY_POLL_INTERVAL_MASK     0xFF
+#define TELEMETRY_DUPS_MASK              0xFF
+#define TELEMETRY_STACK_FREE_LO_MASK     0xFF
+#define TELEMETRY_STACK_FREE_HI_MASK     0xFF
+#define TELEMETRY_RESET_REASON_MASK      0xFF
+#define TELEMETRY_RESET_INFO_MASK        0xFF
+#define TELEMETRY_RESETS_MASK            0xFF
+#define TELEMETRY_LCD_FAULTS_MASK        0x7F
+#define TELEMETRY_LCD_OFFLINE_MASK       0x80
+
+static inline uint8_t telemetry_polls_lo(const uint8_t * p) { return p[0]; }
+static inline uint8_t telemetry_polls_hi(const uint8_t * p) { return p[1]; }
+static inline uint8_t telemetry_samples_lo(const uint8_t * p) { return p[2]; }
+static inline uint8_t telemetry_samples_hi(const uint8_t * p) { return p[3]; }
+static inline uint8_t telemetry_timeouts_lo(const uint8_t * p) { return p[4]; }
+static inline uint8_t telemetry_timeouts_hi(const uint8_t * p) { return p[5]; }
+static inline uint8_t telemetry_spin_lo(const uint8_t * p) { return p[6]; }
+static inline uint8_t telemetry_spin_hi(const uint8_t * p) { return p[7]; }
+static inline uint8_t telemetry_poll_interval(const uint8_t * p) { return p[8]; }
+static inline uint8_t telemetry_dups(const uint8_t * p) { return p[9]; }
+static inline uint8_t telemetry_stack_free_lo(const uint8_t * p) { return p[10]; }
+static inline uint8_t telemetry_stack_free_hi(const uint8_t * p) { return p[11]; }
+static inline uint8_t telemetry_reset_reason(const uint8_t * p) { return p[12]; }
+static inline uint8_t telemetry_reset_info(const uint8_t * p) { return p[13]; }
+static inline uint8_t telemetry_resets(const uint8_t * p) { return p[14]; }
+static inline uint8_t telemetry_lcd_faults(const uint8_t * p) { return p[15] & 0x7F; }
+static inline uint8_t telemetry_lcd_offline(const uint8_t * p) { return (p[15] >> 7) & 0x01; }
+static inline void telemetry_set_polls_lo(uint8_t * p, uint8_t v) { p[0] = v; }
+static inline void telemetry_set_polls_hi(uint8_t * p, uint8_t v) { p[1] = v; }
+static inline void telemetry_set_samples_lo(uint8_t * p, uint8_t v) { p[2] = v; }
+static inline void telemetry_set_samples_hi(uint8_t * p, uint8_t v) { p[3] = v; }
+static inline void telemetry_set_timeouts_lo(uint8_t * p, uint8_t v) { p[4] = v; }
+static inline void telemetry_set_timeouts_hi(uint8_t * p, uint8_t v) { p[5] = v; }
+static inline void telemetry_set_spin_lo(uint8_t * p, uint8_t v) { p[6] = v; }
+static inline void telemetry_set_spin_hi(uint8_t * p, uint8_t v) { p[7] = v; }
+static inline void telemetry_set_poll_interval(uint8_t * p, uint8_t v) { p[8] = v; }
+static inline void telemetry_set_dups(uint8_t * p, uint8_t v) { p[9] = v; }
+static inline void telemetry_set_stack_free_lo(uint8_t * p, uint8_t v) { p[10] = v; }
+static inline void telemetry_set_stack_free_hi(uint8_t * p, uint8_t v) { p[11] = v; }
+static inline void telemetry_set_reset_reason(uint8_t * p, uint8_t v) { p[12] = v; }
+static inline void telemetry_set_reset_info(uint8_t * p, uint8_t v) { p[13] = v; }
+static inline void telemetry_set_resets(uint8_t * p, uint8_t v) { p[14] = v; }
+static inline void telemetry_set_lcd_faults(uint8_t * p, uint8_t v) { p[15] = (uint8_t) ((p[15] & 0x80) | ((v << 0) & 0x7F)); }
+static inline void telemetry_set_lcd_offline(uint8_t * p, uint8_t v) { p[15] = (uint8_t) ((p[15] & 0x7F) | ((v << 7) & 0x80)); }
+
+#define SENSORS_SIZE                     1
+#define SENSORS_STALE_MASK               0x0F
+#define SENSORS_HOLD_MASK                0x10
+#define SENSORS_SHUTDOWN_MASK            0x20
+
+static inline uint8_t sensors_stale(const uint8_t * p) { return p[0] & 0x0F; }
+static inline uint8_t sensors_hold(const uint8_t * p) { return (p[0] >> 4) & 0x01; }
+static inline uint8_t sensors_shutdown(const uint8_t * p) { return (p[0] >> 5) & 0x01; }
+static inline void sensors_set_stale(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xF0) | ((v << 0) & 0x0F)); }
+static inline void sensors_set_hold(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xEF) | ((v << 4) & 0x10)); }
+static inline void sensors_set_shutdown(uint8_t * p, uint8_t v) { p[0] = (uint8_t) ((p[0] & 0xDF) | ((v << 5) & 0x20)); }
+
+#define SETTINGS_CHECK_SIZE              2
+#define SETTINGS_CHECK_SUM_A_MASK        0xFF
+#define SETTINGS_CHECK_SUM_B_MASK        0xFF
+
+static inline uint8_t settings_check_sum_a(const uint8_t * p) { return p[0]; }
+static inline uint8_t settings_check_sum_b(const uint8_t * p) { return p[1]; }
+static inline void settings_check_set_sum_a(uint8_t * p, uint8_t v) { p[0] = v; }
+static inline void settings_check_set_sum_b(uint8_t * p, uint8_t v) { p[1] = v; }
+
+// ---------- FRAMES ----------
+
+#define IMP_HDR                          0xA9
+
+#define IMP_STATE                        0x65
+#define IMP_STATE_LEN                    3
+#define IMP_STATE_STATE                  0
+
+#define IMP_SCENE                        0x66
+#define IMP_SCENE_LEN                    1
+#define IMP_SCENE_SCENE                  0
+
+#define IMP_SCENE_SET                    0x67
+#define IMP_SCENE_SET_LEN                4
+#define IMP_SCENE_SET_SCENE              0
+#define IMP_SCENE_SET_STATE              1
+
+#define IMP_RULE_SET                     0x68
+#define IMP_RULE_SET_LEN                 5
+#define IMP_RULE_SET_INDEX               0
+#define IMP_RULE_SET_RULE                1
+
+#define IMP_CLOCK                        0x69
+#define IMP_CLOCK_LEN                    2
+#define IMP_CLOCK_HOUR                   0
+#define IMP_CLOCK_MINUTE                 1
+
+#define IMP_ZONE_SET                     0x6A
+#define IMP_ZONE_SET_LEN                 2
+#define IMP_ZONE_SET_NODE                0
+#define IMP_ZONE_SET_ZONE_MAP            1
+
+#define IMP_TELEMETRY                    0x6B
+#define IMP_TELEMETRY_LEN                0
+
+#define IMP_COMMAND_ID                   0x6C
+#define IMP_COMMAND_ID_LEN               1
+#define IMP_COMMAND_ID_ID                0
+
+#define IMP_SETTINGS_GET                 0x6D
+#define IMP_SETTINGS_GET_LEN             0
+
+#define IMP_SETTINGS_PUT                 0x6E
+#define IMP_SETTINGS_PUT_LEN             3
+#define IMP_SETTINGS_PUT_SIZE            0
+#define IMP_SETTINGS_PUT_SETTINGS_CHECK  1
+#define IMP_SETTINGS_PUT_IMAGE           3
+
+#define IMP_STATUS_LEN                   4
+#define IMP_STATUS_STATE                 0
+#define IMP_STATUS_SENSORS               3
+
+#define IMP_SENSORS                      0xAD
+#define IMP_SENSORS_LEN                  1
+#define IMP_SENSORS_SENSORS              0
+
+#define IMP_REPORT_LEN                   16
+#define IMP_REPORT_TELEMETRY             0
+
+#define IMP_ACK                          0xAC
+#define IMP_ACK_LEN                      1
+#define IMP_ACK_ID                       0
+
+#define IMP_SETTINGS_LEN                 3
+#define IMP_SETTINGS_SIZE                0
+#define IMP_SETTINGS_SETTINGS_CHECK      1
+#define IMP_SETTINGS_IMAGE               3
+
+#define AUX_COMMAND_LEN                  2
+#define AUX_COMMAND_AUX                  0
+
+#define XBEE_POLL                        0xE4
+#define XBEE_POLL_LEN                    2
+#define XBEE_POLL_NODE                   0
+#define XBEE_POLL_ACK                    1
+
+#define XBEE_BATCH                       0xE5
+#define XBEE_BATCH_LEN                   3
+#define XBEE_BATCH_NODE                  0
+#define XBEE_BATCH_COUNT                 1
+#define XBEE_BATCH_SEQ                   2
+#define XBEE_BATCH_SAMPLES               3
+
+#define XBEE_LEGACY                      0xE3
+#define XBEE_LEGACY_LEN                  2
+#define XBEE_LEGACY_SAMPLE               0
+
+#define XBEE_STATE                       0xD4
+#define XBEE_STATE_LEN                   3
+#define XBEE_STATE_STATE                 0
+
+#endif
@@ -1,54 +1,583 @@
 //
 // Back-end server for Smart Home System information communication to iPhone App through the cloud.
-// Imp Code - Squirrel
+// Agent Code - Squirrel
+//
+// Runs alongside imp_node.nut: HTTP requests from the app arrive here and are passed to the
+// device, which forwards them over the serial lines to the Atmel.
+
+
+// BEGIN GENERATED FRAMES - Generated by tools/gen_codec.py from protocol/frames.schema. Do not edit.
+
+const IMP_HDR = 0xA9;
+const IMP_STATE = 0x65;
+const IMP_SCENE = 0x66;
+const IMP_SCENE_SET = 0x67;
+const IMP_RULE_SET = 0x68;
+const IMP_CLOCK = 0x69;
+const IMP_ZONE_SET = 0x6A;
+const IMP_TELEMETRY = 0x6B;
+const IMP_COMMAND_ID = 0x6C;
+const IMP_SETTINGS_GET = 0x6D;
+const IMP_SETTINGS_PUT = 0x6E;
+const IMP_SENSORS = 0xAD;
+const IMP_ACK = 0xAC;
+const XBEE_POLL = 0xE4;
+const XBEE_BATCH = 0xE5;
+const XBEE_LEGACY = 0xE3;
+const XBEE_STATE = 0xD4;
+
+// Frame payloads: <FRAME>_LEN bytes before any repeated item, <FRAME>_<ITEM> offsets
+const IMP_STATE_LEN = 3;
+const IMP_STATE_STATE = 0;
+const IMP_SCENE_LEN = 1;
+const IMP_SCENE_SCENE = 0;
+const IMP_SCENE_SET_LEN = 4;
+const IMP_SCENE_SET_SCENE = 0;
+const IMP_SCENE_SET_STATE = 1;
+const IMP_RULE_SET_LEN = 5;
+const IMP_RULE_SET_INDEX = 0;
+const IMP_RULE_SET_RULE = 1;
+const IMP_CLOCK_LEN = 2;
+const IMP_CLOCK_HOUR = 0;
+const IMP_CLOCK_MINUTE = 1;
+const IMP_ZONE_SET_LEN = 2;
+const IMP_ZONE_SET_NODE = 0;
+const IMP_ZONE_SET_ZONE_MAP = 1;
+const IMP_TELEMETRY_LEN = 0;
+const IMP_COMMAND_ID_LEN = 1;
+const IMP_COMMAND_ID_ID = 0;
+const IMP_SETTINGS_GET_LEN = 0;
+const IMP_SETTINGS_PUT_LEN = 3;
+const IMP_SETTINGS_PUT_SIZE = 0;
+const IMP_SETTINGS_PUT_SETTINGS_CHECK = 1;
+const IMP_SETTINGS_PUT_IMAGE = 3;
+const IMP_STATUS_LEN = 4;
+const IMP_STATUS_STATE = 0;
+const IMP_STATUS_SENSORS = 3;
+const IMP_SENSORS_LEN = 1;
+const IMP_SENSORS_SENSORS = 0;
+const IMP_REPORT_LEN = 16;
+const IMP_REPORT_TELEMETRY = 0;
+const IMP_ACK_LEN = 1;
+const IMP_ACK_ID = 0;
+const IMP_SETTINGS_LEN = 3;
+const IMP_SETTINGS_SIZE = 0;
+const IMP_SETTINGS_SETTINGS_CHECK = 1;
+const IMP_SETTINGS_IMAGE = 3;
+const AUX_COMMAND_LEN = 2;
+const AUX_COMMAND_AUX = 0;
+const XBEE_POLL_LEN = 2;
+const XBEE_POLL_NODE = 0;
+const XBEE_POLL_ACK = 1;
+const XBEE_BATCH_LEN = 3;
+const XBEE_BATCH_NODE = 0;
+const XBEE_BATCH_COUNT = 1;
+const XBEE_BATCH_SEQ = 2;
+const XBEE_BATCH_SAMPLES = 3;
+const XBEE_LEGACY_LEN = 2;
+const XBEE_LEGACY_SAMPLE = 0;
+const XBEE_STATE_LEN = 3;
+const XBEE_STATE_STATE = 0;
+
+// Field tables: name -> [byte, shift, mask]
+const STATE_SIZE = 3;
+STATE_FIELDS <- {
+    call_cool = [0, 0, 0x01],
+    ac_auto = [0, 1, 0x01],
+    fan = [0, 2, 0x01],
+    heater = [0, 3, 0x01],
+    cooler = [0, 4, 0x01],
+    lights = [0, 5, 0x01],
+    lights_auto = [0, 6, 0x01],
+    call_heat = [0, 7, 0x01],
+    tempr = [1, 0, 0x7F],
+    status_req = [1, 7, 0x01],
+    humid = [2, 0, 0x7F],
+    humid_on = [2, 7, 0x01],
+};
+const AUX_SIZE = 2;
+AUX_FIELDS <- {
+    device = [0, 0, 0x01],
+    ac_auto = [0, 1, 0x01],
+    fan = [0, 2, 0x01],
+    heater = [0, 3, 0x01],
+    cooler = [0, 4, 0x01],
+    lights = [0, 5, 0x01],
+    lights_auto = [0, 6, 0x01],
+    tempr = [1, 0, 0x7F],
+    status_req = [1, 7, 0x01],
+};
+const SAMPLE_SIZE = 2;
+SAMPLE_FIELDS <- {
+    tempr = [0, 0, 0x7F],
+    humid = [1, 0, 0x7F],
+};
+const RULE_SIZE = 4;
+RULE_FIELDS <- {
+    cmp = [0, 3, 0x03],
+    src = [0, 5, 0x07],
+    operand = [1, 0, 0xFF],
+    action = [2, 4, 0x0F],
+    arg = [3, 0, 0xFF],
+};
+const ZONE_MAP_SIZE = 1;
+ZONE_MAP_FIELDS <- {
+    weight = [0, 0, 0x0F],
+    zone = [0, 4, 0x03],
+};
+const TELEMETRY_SIZE = 16;
+TELEMETRY_FIELDS <- {
+    polls_lo = [0, 0, 0xFF],
+    polls_hi = [1, 0, 0xFF],
+    samples_lo = [2, 0, 0xFF],
+    samples_hi = [3, 0, 0xFF],
+    timeouts_lo = [4, 0, 0xFF],
+    timeouts_hi = [5, 0, 0xFF],
+    spin_lo = [6, 0, 0xFF],
+    spin_hi = [7, 0, 0xFF],
+    poll_interval = [8, 0, 0xFF],
+    dups = [9, 0, 0xFF],
+    stack_free_lo = [10, 0, 0xFF],
+    stack_free_hi = [11, 0, 0xFF],
+    reset_reason = [12, 0, 0xFF],
+    reset_info = [13, 0, 0xFF],
+    resets = [14, 0, 0xFF],
+    lcd_faults = [15, 0, 0x7F],
+    lcd_offline = [15, 7, 0x01],
+};
+const SENSORS_SIZE = 1;
+SENSORS_FIELDS <- {
+    stale = [0, 0, 0x0F],
+    hold = [0, 4, 0x01],
+    shutdown = [0, 5, 0x01],
+};
+const SETTINGS_CHECK_SIZE = 2;
+SETTINGS_CHECK_FIELDS <- {
+    sum_a = [0, 0, 0xFF],
+    sum_b = [1, 0, 0xFF],
+};
+
+// layoutUnpack() reads every field of a layout from blob b at offset into a table.
+function layoutUnpack(fields, b, offset)
+{
+    local t = {};
+    foreach (name, f in fields) t[name] <- (b[offset + f[0]] >> f[1]) & f[2];
+    return t;
+}
+
+// layoutPack() writes the fields present in table t into a new blob of the layout's size.
+function layoutPack(fields, size, t)
+{
+    local b = blob(size);
+    for (local i = 0; i < size; i++) b[i] = 0;
+    foreach (name, f in fields) {
+        if (name in t) b[f[0]] = b[f[0]] | ((t[name] & f[2]) << f[1]);
+    }
+    return b;
+}
+
+// frameBlob() builds a frame from its header bytes and an array of payload bytes or blobs.
+function frameBlob(header, payload)
+{
+    local b = blob();
+    foreach (h in header) b.writen(h, 'b');
+    foreach (p in payload) {
+        if (typeof p == "blob") b.writeblob(p);
+        else b.writen(p, 'b');
+    }
+    return b;
+}
+
+// END GENERATED FRAMES
+
+const SCENE_COUNT = 8;      // Scene slots available in the controller's EEPROM
+const RULE_COUNT = 8;       // Automation rule slots available in the controller's EEPROM
+const SENSOR_NODES = 4;     // Sensor node addresses on the XBee network
+const ZONE_COUNT = 4;       // Heating zones the controller averages sensors into
+const CLOCK_SYNC = 3600;    // Seconds between time of day updates to the controller
+const STATUS_FRESH = 30;    // Seconds a state pushed by the device still answers ?status=1
+const STATUS_WAIT = 5;      // Seconds a status request waits for the device
+const TOKEN_KEEP = 60;      // Seconds an app's request token keeps its command ID
+const SETTINGS_WAIT = 8;    // Seconds a settings request waits for the device
+const SETTINGS_SIZE = 76;   // Bytes in the controller's settings image
+const RESTORE_WAIT = 5;     // Seconds a settings restore waits for the controller's acknowledgement
+
+// Names of the controller's reset reasons and watchdog tasks, as in its telemetry
+local resetReasons = ["power on", "reset pin", "brown-out", "watchdog", "corrupt data"];
+local watchdogTasks = ["ui", "imp", "xbee", "timer"];
 
+// Scene names are kept in the agent's persistent store; the controller only knows slot IDs.
+local settings = server.load();
+if (!("scenes" in settings)) settings.scenes <- {};
 
-local haveNewData=0;
-atmel <- hardware.uart57;
-function initUart()
+local lastTelemetry = null;
+local lastDiag = null;      // Last diagnostic summary from the device: { counts, time }
+local lastState = null;     // Last state pushed by the device: { state, sensors, seen }
+local statusWaiting = [];   // Responses to status requests waiting for the device
+local restoreWaiting = {};  // Responses to settings restores waiting for their command ID's ack
+local nextCommandId = 1;    // Command IDs run 1 to 254; the controller ignores 0 and 0xFF
+local commandTokens = {};   // App request token -> { id, time, acked }
+local settingsWaiting = []; // Responses to settings requests waiting for the device
+
+// sceneId() returns the slot a scene name is stored in, or allocates the next free slot.
+//  Returns null if all slots are taken.
+function sceneId(name, allocate)
 {
-    hardware.configure(UART_57);    // Using UART on pins 5 and 7
-    // 9600 baud works well, no parity, 1 stop bit, 8 data bits.
-    // Provide a callback function, serialRead, to be called when data comes in:
-    atmel.configure(9600, 8, PARITY_NONE, 1, NO_CTSRTS, serialRead);
+    if (name in settings.scenes) return settings.scenes[name];
+    if (!allocate) return null;
+
+    local used = array(SCENE_COUNT, false);
+    foreach (n, id in settings.scenes) used[id] = true;
+    for (local id = 0; id < SCENE_COUNT; id++) {
+        if (!used[id]) {
+            settings.scenes[name] <- id;
+            server.save(settings);
+            return id;
+        }
+    }
+    return null;
 }
 
-// serialRead() will be called whenever serial data is passed to the imp. It
-//  will read the data in, and send it out to the agent.
-function serialRead()
+// Commands go to the device as blobs holding a command ID and the payload laid out as in
+//  frames.schema, built with frameBlob(); the device adds the headers and writes them out.
+
+// hexBlob() converts a string of hex digit pairs to a blob of those bytes.
+function hexBlob(hex)
 {
-    server.log("Imp reading data");
-    local c = atmel.read(); // Read serial char into variable c
-    local t = atmel.read();
-    
-    local dataString = c.tostring() + t.tostring();
-    server.log(dataString);
-    
-    agent.send("impSerialIn", dataString);
+    local data = blob(hex.len() / 2);
+    for (local i = 0; i + 1 < hex.len(); i += 2) data.writen(hex.slice(i, i + 2).tointeger(16), 'b');
+    return data;
 }
 
-function sendCommand(command) {
-    atmel.write(command.tostring());
-    server.log("Imp sending data:");
-    server.log(command.tostring());
+// blobHex() is the inverse of hexBlob(), for logging.
+function blobHex(data)
+{
+    local hex = "";
+    foreach (b in data) hex += format("%02X", b);
+    return hex;
 }
 
-// agent.on("dataToSerial") will be called whenever the agent passes data labeled
-//  "dataToSerial" over to the device. This data should be sent out the serial
-//  port, to the Arduino.
-agent.on("dataToSerial", function(c)
+// sendCommand() sends the device a command "name" with the payload items given, behind a command
+//  ID. The device resends it until the controller acknowledges the ID, and the controller applies
+//  each ID once. An app that retries a request with the same "token" gets the same ID, so its
+//  retry is not repeated either; once the command is acknowledged it is not even sent again.
+//  Returns the command ID, or null if the command was already acknowledged.
+function sendCommand(name, payload, token = null)
 {
-    arduino.write(c.tostring()); // Write the data out the serial port.
+    local now = time();
+    local stale = [];
+    foreach (t, c in commandTokens) {
+        if (now - c.time > TOKEN_KEEP) stale.append(t);
+    }
+    foreach (t in stale) delete commandTokens[t];
+    local id;
+    if (token != null && token in commandTokens) {
+        if (commandTokens[token].acked) return null;
+        id = commandTokens[token].id;
+    } else {
+        id = nextCommandId;
+        nextCommandId = nextCommandId % 254 + 1;
+        if (token != null) commandTokens[token] <- { id = id, time = now, acked = false };
+    }
+    device.send(name, frameBlob([id], payload));
+    return id;
+}
+
+// The device passes on the controller's acknowledgements, so an app retry of a command that is
+//  already done can be answered here.
+device.on("impAck", function(id) {
+    foreach (t, c in commandTokens) {
+        if (c.id == id) c.acked = true;
+    }
+    if (id in restoreWaiting) {
+        foreach (response in restoreWaiting[id]) response.send(200, "OK");
+        delete restoreWaiting[id];
+    }
 });
 
+// settingsCheck() returns the Fletcher-16 check bytes of a settings image, as a
+//  SETTINGS_CHECK_SIZE byte blob.
+function settingsCheck(image)
+{
+    local a = 0, b = 0;
+    foreach (c in image) {
+        a = (a + c) % 255;
+        b = (b + a) % 255;
+    }
+    return layoutPack(SETTINGS_CHECK_FIELDS, SETTINGS_CHECK_SIZE, { sum_a = a, sum_b = b });
+}
 
+// answerSettings() replies to the waiting settings requests with "image" as hex (JSON), or with
+//  504 if it is null.
+function answerSettings(image)
+{
+    foreach (response in settingsWaiting) {
+        if (image == null) {
+            response.send(504, "No settings from the controller");
+        } else {
+            response.header("Content-Type", "application/json");
+            response.send(200, http.jsonencode({ size = image.len(), image = blobHex(image) }));
+        }
+    }
+    settingsWaiting = [];
+}
 
-// Setup //
-server.log("Serial Pipeline Open!"); // Indicate we've begun
-initUart(); // Initialize the LEDs
+// syncClock() keeps the controller's time of day (used by time based rules) current.
+function syncClock()
+{
+    local d = date();
+    sendCommand("clock", [d.hour, d.min]);
+    imp.wakeup(CLOCK_SYNC, syncClock);
+}
 
-//send command to uart
-agent.on("command", sendCommand);
+device.onconnect(function() {
+    syncClock();
+});
 
-///EOF
+// Other data read from the controller is only logged; status comes from "impState".
+device.on("impSerialIn", function(data) {
+    server.log("Controller: " + blobHex(data));
+});
+
+// answerStatus() replies with the last known state, the sensor status and the state's age in
+//  seconds, or 504 if the device has never sent one.
+function answerStatus(response)
+{
+    if (lastState == null) {
+        response.send(504, "No state from the controller");
+        return;
+    }
+    response.header("Content-Type", "application/json");
+    response.send(200, http.jsonencode({ state = lastState.state, sensors = lastState.sensors,
+                                         age = time() - lastState.seen }));
+}
+
+// The device pushes the controller's state when it changes, when its copy is old, and in
+//  answer to a status request; any status requests waiting for it are answered now. The blob is
+//  the state packet and the sensor status, followed by the state's age in seconds, 16 bits low
+//  byte first.
+device.on("impState", function(msg) {
+    local state = layoutUnpack(STATE_FIELDS, msg, 0);
+    local sensors = sensorReport(layoutUnpack(SENSORS_FIELDS, msg, STATE_SIZE));
+    msg.seek(STATE_SIZE + SENSORS_SIZE);
+    lastState = { state = state, sensors = sensors, seen = time() - msg.readn('w') };
+    foreach (response in statusWaiting) answerStatus(response);
+    statusWaiting = [];
+});
+
+// The controller's settings image: its size, check bytes and the image itself. An image whose
+//  check bytes do not agree is dropped, and the waiting requests time out.
+device.on("impSettings", function(msg) {
+    local head = 1 + SETTINGS_CHECK_SIZE;
+    if (msg.len() < head || msg.len() != head + msg[0]) return;
+    msg.seek(head);
+    local image = msg.readblob(msg[0]);
+    local check = settingsCheck(image);
+    if (check[0] != msg[1] || check[1] != msg[2]) {
+        server.error("Settings image failed its check");
+        return;
+    }
+    answerSettings(image);
+});
+
+// The device sends its event counts once a period instead of logging on the data path. They
+//  are logged here as one line and kept for the next telemetry request.
+device.on("impDiag", function(counts) {
+    local names = [];
+    foreach (name, n in counts) names.append(name);
+    names.sort();
+    local line = "Imp:";
+    foreach (name in names) line += " " + name + "=" + counts[name];
+    server.log(line);
+    lastDiag = { counts = counts, time = time() };
+});
 
+// sensorReport() describes the sensor status: the nodes whose readings are stale, and whether
+//  the thermostat is holding its call or shut down for want of fresh ones.
+function sensorReport(f)
+{
+    local stale = [];
+    for (local node = 0; f.stale >> node; node++) {
+        if (f.stale & (1 << node)) stale.append(node);
+    }
+    return { stale = stale, hold = f.hold == 1, shutdown = f.shutdown == 1 };
+}
+
+// resetReport() describes the controller's last reset: its reason, and for a watchdog reset the
+//  tasks that had not checked in (the first is the one that stalled) or for corrupt data the
+//  EEPROM cell.
+function resetReport(f)
+{
+    local reason = f.reset_reason < resetReasons.len() ? resetReasons[f.reset_reason] :
+                   "unknown " + f.reset_reason;
+    local report = { reason = reason, count = f.resets };
+    if (reason == "watchdog") {
+        report.tasks <- [];
+        foreach (i, name in watchdogTasks) {
+            if (f.reset_info & (1 << i)) report.tasks.append(name);
+        }
+    } else if (reason == "corrupt data") {
+        report.cell <- format("0x%02X", f.reset_info);
+    }
+    return report;
+}
+
+// Telemetry counters, held for the next telemetry request. Each 16 bit counter is put back
+//  together from its two bytes.
+device.on("impTelemetry", function(report) {
+    local f = layoutUnpack(TELEMETRY_FIELDS, report, 0);
+    lastTelemetry = {
+        polls = f.polls_lo | (f.polls_hi << 8),
+        samples = f.samples_lo | (f.samples_hi << 8),
+        timeouts = f.timeouts_lo | (f.timeouts_hi << 8),
+        spin = f.spin_lo | (f.spin_hi << 8),
+        poll_interval = f.poll_interval,
+        dups = f.dups,
+        stack_free = f.stack_free_lo | (f.stack_free_hi << 8),
+        reset = resetReport(f),
+        display = { offline = f.lcd_offline == 1, faults = f.lcd_faults }
+    };
+});
+
+// ?scene=name              ---   Apply a stored scene
+// ?scene=name&define=XXXXXX ---  Store the 3 byte state packet (hex) as scene "name"
+//                                (FFFFFF erases the scene and frees its name)
+// ?rule=n&code=XXXXXXXX    ---   Store 4 rule bytes (hex) in automation rule slot n
+//                                (FFFFFFFF erases the rule)
+// ?zone=z&node=n&weight=w  ---   Put sensor node n in zone z with weight w (0 removes it)
+// ?command=XXXXXX          ---   Set the controller's state to the 3 byte state packet (hex)
+// ?status=1                ---   Return the controller's state (JSON), asking the device only
+//                                if the last state it pushed is older than STATUS_FRESH
+// ?telemetry=1             ---   Return the last telemetry counters and Imp diagnostic summary
+//                                (JSON) and ask for fresh counters
+// ?loglevel=n              ---   Log Imp diagnostics up to level n (0 errors ... 3 debug)
+// ?settings=1              ---   Return the controller's whole settings image (set points,
+//                                scenes, rules, zone map) as hex (JSON), for backup
+// ?restore=XX...           ---   Write a settings image from ?settings=1 back to the controller,
+//                                answering once the controller acknowledges it, or 504 if it
+//                                does not within RESTORE_WAIT (it rejects a damaged image)
+//
+// Requests that change the controller take an optional &token=t. An app retrying a request with
+//  the same token within TOKEN_KEEP seconds has it applied at most once.
+http.onrequest(function(request, response) {
+    try {
+        local q = request.query;
+        local token = ("token" in q) ? q.token : null;
+
+        if ("scene" in q) {
+            local erase = ("define" in q) && q.define.toupper() == "FFFFFF";
+            local id = sceneId(q.scene, ("define" in q) && !erase);
+            if (id == null) {
+                response.send(404, "Unknown scene");
+                return;
+            }
+            if ("define" in q) {
+                local hex = q.define;
+                if (hex.len() != 6) {
+                    response.send(400, "Scene packet must be 6 hex digits");
+                    return;
+                }
+                sendCommand("sceneStore", [id, hexBlob(hex)], token);
+                if (erase) {
+                    delete settings.scenes[q.scene];
+                    server.save(settings);
+                }
+            } else {
+                sendCommand("scene", [id], token);
+            }
+            response.send(200, "OK");
+        } else if ("rule" in q) {
+            local id = q.rule.tointeger();
+            if (id < 0 || id >= RULE_COUNT || !("code" in q) || q.code.len() != 8) {
+                response.send(400, "Rule needs a slot below " + RULE_COUNT + " and 8 hex digits");
+                return;
+            }
+            sendCommand("rule", [id, hexBlob(q.code)], token);
+            response.send(200, "OK");
+        } else if ("zone" in q) {
+            local zone = q.zone.tointeger();
+            local node = ("node" in q) ? q.node.tointeger() : -1;
+            local weight = ("weight" in q) ? q.weight.tointeger() : 1;
+            if (zone < 0 || zone >= ZONE_COUNT || node < 0 || node >= SENSOR_NODES ||
+                weight < 0 || weight > 15) {
+                response.send(400, "Zone below " + ZONE_COUNT + ", node below " + SENSOR_NODES +
+                              ", weight 0 to 15");
+                return;
+            }
+            local map = layoutPack(ZONE_MAP_FIELDS, ZONE_MAP_SIZE, { zone = zone, weight = weight });
+            sendCommand("zone", [node, map], token);
+            response.send(200, "OK");
+        } else if ("command" in q) {
+            if (q.command.len() != 2 * STATE_SIZE) {
+                response.send(400, "Command must be " + 2 * STATE_SIZE + " hex digits");
+                return;
+            }
+            sendCommand("command", [hexBlob(q.command)], token);
+            response.send(200, "OK");
+        } else if ("status" in q) {
+            if (lastState != null && time() - lastState.seen <= STATUS_FRESH) {
+                answerStatus(response);
+                return;
+            }
+            statusWaiting.append(response);
+            if (statusWaiting.len() > 1) return;
+            device.send("status", 0);
+            imp.wakeup(STATUS_WAIT, function() {
+                foreach (r in statusWaiting) answerStatus(r);
+                statusWaiting = [];
+            });
+        } else if ("telemetry" in q) {
+            device.send("telemetry", 0);
+            local t = { controller = lastTelemetry, imp = null };
+            if (lastDiag != null) t.imp = { counts = lastDiag.counts, age = time() - lastDiag.time };
+            response.header("Content-Type", "application/json");
+            response.send(200, http.jsonencode(t));
+        } else if ("settings" in q) {
+            settingsWaiting.append(response);
+            if (settingsWaiting.len() > 1) return;
+            device.send("settings", 0);
+            imp.wakeup(SETTINGS_WAIT, function() {
+                answerSettings(null);
+            });
+        } else if ("restore" in q) {
+            local hex = q.restore;
+            if (hex.len() != 2 * SETTINGS_SIZE) {
+                response.send(400, "Settings image must be " + 2 * SETTINGS_SIZE +
+                              " hex digits, as from ?settings=1");
+                return;
+            }
+            local image = hexBlob(hex);
+            local id = sendCommand("settingsRestore", [image.len(), settingsCheck(image), image],
+                                   token);
+            if (id == null) {
+                response.send(200, "OK");
+                return;
+            }
+            if (!(id in restoreWaiting)) restoreWaiting[id] <- [];
+            restoreWaiting[id].append(response);
+            imp.wakeup(RESTORE_WAIT, function() {
+                if (!(id in restoreWaiting)) return;
+                local waiting = restoreWaiting[id];
+                local i = waiting.find(response);
+                if (i == null) return;
+                waiting.remove(i);
+                if (waiting.len() == 0) delete restoreWaiting[id];
+                response.send(504, "Controller did not acknowledge the settings image");
+            });
+        } else if ("loglevel" in q) {
+            local level = q.loglevel.tointeger();
+            if (level < 0 || level > 3) {
+                response.send(400, "Log level 0 to 3");
+                return;
+            }
+            device.send("logLevel", level);
+            response.send(200, "OK");
+        } else {
+            response.send(400, "No request");
+        }
+    } catch (ex) {
+        response.send(500, "Error: " + ex);
+    }
+});
+
+///EOF
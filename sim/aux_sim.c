@@ -0,0 +1,56 @@
+/*************************************************************
+ *       aux_sim.c - Run the auxiliary controller firmware on the host.
+ *
+ *       Sends it a heater command, which turns the lights off, then a status request, and
+ *       prints its answer and the light output.
+ *
+ *           shs_aux_sim
+ *************************************************************/
+
+#include <stdio.h>
+
+#include <avr/io.h>
+
+#include "protocol/shs_frames.h"
+#include "sim.h"
+
+// The firmware, built with -Dmain=firmware_main
+int firmware_main(void);
+
+static uint8_t out[64];
+static size_t out_len;
+
+static void peer(int src, uint8_t byte)
+{
+    (void) src;
+    if (out_len < sizeof out) out[out_len++] = byte;
+}
+
+static void boot(void)
+{
+    firmware_main();
+}
+
+int main(void)
+{
+    sim_reset(false);
+    sim_peer(peer);
+
+    // main() starts from its initial state each time it is entered, so the whole session is
+    // queued and run at once.
+    uint8_t cmd[AUX_SIZE] = { 0, 0 };
+    aux_set_device(cmd, 1);
+    aux_set_heater(cmd, 1);
+    aux_set_tempr(cmd, 70);
+    uint8_t ask[AUX_SIZE] = { 0, 0 };
+    aux_set_device(ask, 1);
+    aux_set_status_req(ask, 1);
+    sim_rx(SIM_IMP, cmd, sizeof cmd);
+    sim_rx(SIM_IMP, ask, sizeof ask);
+
+    sim_run(boot, 1000000);
+    printf("%8.3f s  lights %s  answer:", sim_now_us() / 1e6, (PORTC & (1 << PC0)) ? "on" : "off");
+    for (size_t i = 0; i < out_len; i++) printf(" %02X", out[i]);
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,165 @@
+/*************************************************************
+ *       bench_firmware.c - Main loop pass times of the system controller, in the simulator.
+ *
+ *       Runs single passes of sys_task() in a set of situations and reports the virtual time
+ *       each takes on the part (the firmware's own delays and waits, see sim/sim.h), the EEPROM
+ *       cells it writes, and the host time it takes to simulate. Code size comes from the
+ *       ELFs; the "bench" build target prints both.
+ *
+ *           shs_bench_firmware [passes per case]
+ *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "nodes.h"
+#include "protocol/shs_frames.h"
+#include "sim.h"
+
+// The firmware, built with -Dmain=firmware_main
+void sys_init(void);
+void sys_task(void);
+void sys_idle(void);
+extern volatile uint8_t sensor_wait;
+extern volatile uint8_t dirty;
+
+#define DIRTY_LCD       0x02    // As in atmega_sys_control.c
+
+static uint8_t state[STATE_SIZE];
+static uint8_t next_id = 1;
+
+static void setup_idle(void)
+{
+    sensor_wait = 255;
+}
+
+/*
+ imp_arrive - Let the Imp write the frame just handed to it and let that come down the line into
+ the receive ring, so the pass measured is the one that acts on it.
+ */
+static void imp_arrive(void)
+{
+    while (!sim_pending(SIM_IMP)) sim_delay_cycles(F_CPU / 10000);
+    while (sim_pending(SIM_IMP)) sim_delay_cycles(F_CPU / 10000);
+}
+
+static void setup_command(void)
+{
+    setup_idle();
+    state_set_tempr(state, 60 + next_id % 20);  // A new setpoint each time, so EEPROM changes
+    nodes_imp_send(IMP_STATE, state, sizeof state, next_id);
+    next_id = next_id % 254 + 1;
+    imp_arrive();
+}
+
+static void setup_repeat(void)
+{
+    setup_idle();
+    uint8_t id = next_id == 1 ? 254 : next_id - 1;     // The last command, sent again
+    nodes_imp_send(IMP_STATE, state, sizeof state, id);
+    imp_arrive();
+}
+
+static void setup_status(void)
+{
+    setup_idle();
+    uint8_t ask[STATE_SIZE] = { 0, 0, 0 };
+    state_set_status_req(ask, 1);
+    nodes_imp_send(IMP_STATE, ask, sizeof ask, 0);
+    imp_arrive();
+}
+
+static void setup_poll(void)
+{
+    sensor_wait = 0;
+    nodes_sensor(0, true, 68, 40);
+}
+
+static void setup_lost(void)
+{
+    sensor_wait = 0;
+    nodes_sensor(0, false, 0, 0);
+}
+
+static void setup_display(void)
+{
+    setup_idle();
+    dirty |= DIRTY_LCD;
+}
+
+static void setup_display_failed(void)
+{
+    setup_display();
+    sim_lcd_fail(true);
+}
+
+static const struct {
+    const char * name;
+    void (*setup)(void);
+} cases[] = {
+    { "idle", setup_idle },
+    { "display redraw", setup_display },
+    { "state command", setup_command },
+    { "repeated command", setup_repeat },
+    { "status request", setup_status },
+    { "sensor poll", setup_poll },
+    { "sensor poll, no reply", setup_lost },
+    { "redraw, display failed", setup_display_failed },     // Last: it leaves the display offline
+};
+
+static double host_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned long passes = argc > 1 ? strtoul(argv[1], NULL, 0) : 50;
+    if (passes == 0) passes = 1;
+
+    sim_reset(true);
+    nodes_reset();
+    nodes_sensor(0, true, 68, 40);
+    sys_init();
+    for (int i = 0; i < 20; i++) {  // Settle: first display, first polls
+        sys_task();
+        sys_idle();
+    }
+
+    state_set_heater(state, 1);
+    state_set_humid(state, 45);
+
+    printf("system controller, %lu passes per case, virtual time at F_CPU %lu Hz\n", passes,
+           (unsigned long) F_CPU);
+    printf("%-24s %10s %10s %10s %12s\n", "case", "mean us", "max us", "eeprom", "host ns");
+    for (size_t c = 0; c < sizeof cases / sizeof cases[0]; c++) {
+        uint64_t total = 0, worst = 0, writes = 0;
+        double host = 0;
+        for (unsigned long i = 0; i < passes; i++) {
+            sim_lcd_fail(false);
+            cases[c].setup();
+            uint64_t w0 = sim_stats.eeprom_writes;
+            uint64_t t0 = sim_now_us();
+            double h0 = host_ns();
+            sys_task();
+            host += host_ns() - h0;
+            uint64_t t = sim_now_us() - t0;
+            total += t;
+            if (t > worst) worst = t;
+            writes += sim_stats.eeprom_writes - w0;
+
+            // Let the pass's effects (a redraw, a broadcast) finish outside the measurement.
+            uint8_t drop[256];
+            while (nodes_imp_take(drop, sizeof drop)) {}
+            sensor_wait = 255;
+            sys_task();
+            while (nodes_imp_take(drop, sizeof drop)) {}
+        }
+        printf("%-24s %10.0f %10llu %10.2f %12.0f\n", cases[c].name, (double) total / passes,
+               (unsigned long long) worst, (double) writes / passes, host / passes);
+    }
+    return 0;
+}
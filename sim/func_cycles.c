@@ -0,0 +1,157 @@
+/*************************************************************
+ *       func_cycles.c - Cost of the system controller's hot functions, one at a time.
+ *
+ *       Boots the firmware in the simulator, then calls each function repeatedly and prints
+ *       one line per function:
+ *
+ *           <function> <calls> <cycles per call> <host ns per call>
+ *
+ *       Cycles are simulated CPU cycles spent in the firmware's delays and waits (serial,
+ *       LCD busy flag, EEPROM writes); they are exact and repeat from run to run. Host time is
+ *       the best of several rounds and covers the computation the simulator does not count.
+ *       tools/perf_report.py collects these lines into its report.
+ *
+ *           shs_func_cycles [calls]
+ *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "nodes.h"
+#include "protocol/shs_frames.h"
+#include "sim.h"
+
+#define ROUNDS          5
+
+// The firmware, built with -Dmain=firmware_main
+void sys_init(void);
+void sys_task(void);
+void sys_idle(void);
+void imp_poll(void);
+void xbee_poll(void);
+void var_config(void);
+void packet_config(void);
+void hvac_update(void);
+void rules_eval(void);
+bool sensor_sample(uint8_t, const uint8_t *);
+void tempr_config(uint8_t *, uint8_t *);
+void humid_config(uint8_t *, uint8_t *);
+void light_config(uint8_t *, uint8_t *);
+void strout(int, unsigned char *);
+void lcd_fmt(char *, const char *, ...);
+void telemetry_send(void);
+void settings_send(void);
+extern volatile uint8_t sensor_wait;
+extern volatile uint8_t rule_inputs;
+extern uint8_t edit_data[2];
+extern char str_0[];
+
+static unsigned long calls;
+static uint8_t sample[SAMPLE_SIZE];
+
+static void call_var_config(void) { var_config(); }
+static void call_packet_config(void) { packet_config(); }
+static void call_hvac_update(void) { hvac_update(); }
+static void call_tempr_config(void) { tempr_config(&edit_data[0], &edit_data[1]); }
+static void call_humid_config(void) { humid_config(&edit_data[0], &edit_data[1]); }
+static void call_light_config(void) { light_config(&edit_data[0], &edit_data[1]); }
+static void call_strout(void) { strout(0x00, (unsigned char *) str_0); }
+static void call_lcd_fmt(void) { lcd_fmt(str_0, "%S%3u/%u F", "Set: ", 68u, 72u); }
+static void call_telemetry_send(void) { telemetry_send(); }
+static void call_settings_send(void) { settings_send(); }
+
+static void call_rules_eval(void)
+{
+    rule_inputs = 0xFF;
+    rules_eval();
+}
+
+static void call_sensor_sample(void)
+{
+    // Alternate the reading, so every sample moves the averages.
+    sample_set_tempr(sample, sample_tempr(sample) == 68 ? 69 : 68);
+    sensor_sample(0, sample);
+}
+
+static void call_imp_poll(void)
+{
+    imp_poll();         // Nothing from the Imp: the receive ring is empty
+}
+
+static void call_xbee_poll(void)
+{
+    sensor_wait = 0;
+    xbee_poll();
+}
+
+static void call_sys_task(void)
+{
+    sensor_wait = 255;
+    sys_task();         // An idle pass
+}
+
+static const struct {
+    const char * name;
+    void (*call)(void);
+} funcs[] = {
+    { "var_config", call_var_config },
+    { "packet_config", call_packet_config },
+    { "hvac_update", call_hvac_update },
+    { "rules_eval", call_rules_eval },
+    { "sensor_sample", call_sensor_sample },
+    { "tempr_config", call_tempr_config },
+    { "humid_config", call_humid_config },
+    { "light_config", call_light_config },
+    { "lcd_fmt", call_lcd_fmt },
+    { "strout", call_strout },
+    { "telemetry_send", call_telemetry_send },
+    { "settings_send", call_settings_send },
+    { "imp_poll", call_imp_poll },
+    { "xbee_poll", call_xbee_poll },
+    { "sys_task", call_sys_task },
+};
+
+static double host_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char ** argv)
+{
+    calls = argc > 1 ? strtoul(argv[1], NULL, 0) : 200;
+    if (calls == 0) calls = 1;
+
+    sim_reset(true);
+    nodes_reset();
+    nodes_sensor(0, true, 68, 40);
+    sys_init();
+    for (int i = 0; i < 20; i++) {
+        sys_task();
+        sys_idle();
+    }
+    sample_set_tempr(sample, 68);
+    sample_set_humid(sample, 40);
+
+    printf("# function calls cycles host_ns\n");
+    for (size_t f = 0; f < sizeof funcs / sizeof funcs[0]; f++) {
+        uint64_t cycles = 0;
+        double best = 0;
+        for (int r = 0; r < ROUNDS; r++) {
+            uint64_t c0 = sim_cycles();
+            double h0 = host_ns();
+            for (unsigned long i = 0; i < calls; i++) funcs[f].call();
+            double host = host_ns() - h0;
+            cycles += sim_cycles() - c0;
+            if (r == 0 || host < best) best = host;
+
+            uint8_t drop[256];
+            while (nodes_imp_take(drop, sizeof drop)) {}
+        }
+        printf("%s %lu %llu %.0f\n", funcs[f].name, calls,
+               (unsigned long long) (cycles / ((uint64_t) calls * ROUNDS)), best / calls);
+    }
+    return 0;
+}
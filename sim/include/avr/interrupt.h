@@ -0,0 +1,16 @@
+/*************************************************************
+ *       avr/interrupt.h - Interrupt control for host builds of the firmware (see sim/sim.h).
+ *************************************************************/
+
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include "sim.h"
+
+#define sei()   sim_sei()
+#define cli()   sim_cli()
+
+// The simulator calls the handlers the firmware defines.
+#define ISR(vector)     void vector(void); void vector(void)
+
+#endif
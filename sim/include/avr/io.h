@@ -0,0 +1,71 @@
+/*************************************************************
+ *       avr/io.h - ATmega328 registers for host builds of the firmware (see sim/sim.h).
+ *************************************************************/
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+#include "sim.h"
+
+extern volatile uint8_t PINB, DDRB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t DDRD, PORTD;
+extern volatile uint8_t UCSR0C;
+extern volatile uint16_t UBRR0;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t OCR1A, TCNT1;
+extern volatile uint8_t MCUSR, WDTCSR;
+
+// Registers the firmware waits on are backed by the simulator.
+#define UCSR0A  (*sim_ucsr0a())
+#define UCSR0B  (*sim_ucsr0b())
+#define UDR0    (*sim_udr0())
+#define PORTB   (*sim_portb())
+#define PIND    (*sim_pind())
+
+#define PB0     0
+#define PB1     1
+#define PB2     2
+#define PB3     3
+#define PB4     4
+#define PB5     5
+#define PB6     6
+#define PB7     7
+#define PC0     0
+#define PC1     1
+#define PC2     2
+#define PC3     3
+#define PC4     4
+#define PC5     5
+#define DDC0    0
+
+// UCSR0A, UCSR0B, UCSR0C
+#define RXC0    7
+#define RXCIE0  7
+#define TXC0    6
+#define UDRE0   5
+#define RXEN0   4
+#define TXEN0   3
+#define USBS0   3
+#define UCSZ01  2
+#define UCSZ00  1
+
+// MCUSR, WDTCSR
+#define WDRF    3
+#define BORF    2
+#define EXTRF   1
+#define PORF    0
+#define WDIE    6
+#define WDCE    4
+#define WDE     3
+
+// TCCR1B, TIMSK1
+#define WGM12   3
+#define CS12    2
+#define CS11    1
+#define CS10    0
+#define OCIE1A  1
+
+#endif
@@ -0,0 +1,23 @@
+/*************************************************************
+ *       avr/pgmspace.h - Program memory access for host builds of the firmware (see sim/sim.h).
+ *
+ *       The host has one address space, so PROGMEM data is ordinary constant data. The _P
+ *       formatters take %S for a string in program memory, as avr-libc's do.
+ *************************************************************/
+
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROGMEM
+#define PGM_P               const char *
+#define PSTR(s)             (s)
+#define pgm_read_byte(p)    (*(const uint8_t *) (p))
+#define pgm_read_word(p)    (*(const uint16_t *) (p))
+
+int vsnprintf_P(char * s, size_t n, const char * fmt, va_list ap);
+
+#endif
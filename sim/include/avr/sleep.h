@@ -0,0 +1,18 @@
+/*************************************************************
+ *       avr/sleep.h - Sleep modes for host builds of the firmware (see sim/sim.h).
+ *************************************************************/
+
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+#include "sim.h"
+
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_PWR_DOWN     2
+
+#define set_sleep_mode(mode)    ((void) (mode))
+#define sleep_enable()          ((void) 0)
+#define sleep_disable()         ((void) 0)
+#define sleep_cpu()             sim_sleep()     // Until the next interrupt
+
+#endif
@@ -0,0 +1,15 @@
+/*************************************************************
+ *       util/delay.h - Busy-wait delays for host builds of the firmware (see sim/sim.h).
+ *
+ *       Delays move virtual time on; they take no host time.
+ *************************************************************/
+
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+#include "sim.h"
+
+#define _delay_us(us)   sim_delay_cycles((uint64_t) ((us) * (F_CPU / 1000000.0)))
+#define _delay_ms(ms)   sim_delay_cycles((uint64_t) ((ms) * (F_CPU / 1000.0)))
+
+#endif
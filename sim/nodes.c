@@ -0,0 +1,212 @@
+/*************************************************************
+ *       nodes.c - Simulated Imp and XBee sensor nodes for host runs of the system controller.
+ *************************************************************/
+
+#include "nodes.h"
+
+#include <string.h>
+
+#include "protocol/shs_frames.h"
+#include "sim.h"
+
+static struct {
+    bool alive;
+    uint8_t tempr, humid;
+    uint8_t seq;
+} sensors[NODES_MAX];
+
+static uint8_t poll[1 + XBEE_POLL_LEN];    // Poll frame being received by the nodes
+static size_t poll_len;
+static uint64_t polls;
+
+static uint8_t bcast[1 + XBEE_STATE_LEN];  // State broadcast being received by the nodes
+static size_t bcast_len;
+static uint8_t state[STATE_SIZE];           // Last one received, and when it changed
+static uint64_t state_at;
+
+static uint8_t imp_out[4096];
+static size_t imp_len;
+static uint8_t imp_frame;                   // IMP_SENSORS or IMP_ACK while its payload is due
+
+// Frames the Imp is to write. It writes each one IMP_WRITE_US after nodes_imp_send(), on its
+// own clock rather than the controller's tick, and a command again every IMP_RETRY_US until the
+// controller acknowledges it, as writeCommand() in imp_node.nut does.
+#define IMP_WRITE_US    30000               // Out of step with the controller's 50 ms tick
+#define IMP_RETRY_US    1000000             // CMD_RETRY
+#define IMP_TRIES       3                   // CMD_TRIES
+#define IMP_PENDING     8
+static struct {
+    size_t len;                             // 0 for a free slot
+    uint8_t frame[128];
+    uint8_t id;                             // Command ID, or 0 to write the frame once
+    uint8_t tries;                          // Writes so far
+    uint64_t due;                           // Virtual time of the next write, microseconds
+} pending[IMP_PENDING];
+static uint64_t imp_resends, imp_lost;
+
+static void imp_write(void);
+
+/*
+ imp_alarm - Set the simulator's alarm for the next write the Imp has pending, if any.
+ */
+static void imp_alarm(void)
+{
+    uint64_t due = 0;
+    for (int i = 0; i < IMP_PENDING; i++) {
+        if (pending[i].len && (!due || pending[i].due < due)) due = pending[i].due;
+    }
+    sim_alarm(due ? imp_write : NULL, due);
+}
+
+/*
+ imp_write - Write each frame that is due, and give a command up after IMP_TRIES writes.
+ */
+static void imp_write(void)
+{
+    uint64_t now = sim_now_us();
+    for (int i = 0; i < IMP_PENDING; i++) {
+        if (!pending[i].len || pending[i].due > now) continue;
+        if (pending[i].tries == IMP_TRIES) {
+            pending[i].len = 0;
+            imp_lost++;
+            continue;
+        }
+        if (pending[i].tries++) imp_resends++;
+        pending[i].due += IMP_RETRY_US;
+        sim_rx(SIM_IMP, pending[i].frame, pending[i].len);
+        if (!pending[i].id) pending[i].len = 0;
+    }
+    imp_alarm();
+}
+
+/*
+ peer - Take a byte the controller sent. The XBee side is scanned for state broadcasts, which
+ are kept, and polls; a poll for a live node is answered with a batch of one sample.
+ */
+static void peer(int src, uint8_t byte)
+{
+    if (src == SIM_IMP) {
+        if (imp_len < sizeof imp_out) imp_out[imp_len++] = byte;
+        // Follow the framed replies as serialRead() in imp_node.nut does: an acknowledged
+        // command is not sent again.
+        if (imp_frame == IMP_ACK) {
+            for (int i = 0; i < IMP_PENDING; i++) {
+                if (pending[i].id == byte) pending[i].len = 0;
+            }
+            imp_alarm();
+            imp_frame = 0;
+        } else if (imp_frame) {
+            imp_frame = 0;
+        } else if (byte == IMP_ACK || byte == IMP_SENSORS) {
+            imp_frame = byte;
+        }
+        return;
+    }
+    if (bcast_len > 0 || (poll_len == 0 && byte == XBEE_STATE)) {
+        bcast[bcast_len++] = byte;
+        if (bcast_len < sizeof bcast) return;
+        bcast_len = 0;
+        if (state_at == 0 || memcmp(state, bcast + 1 + XBEE_STATE_STATE, STATE_SIZE) != 0) {
+            memcpy(state, bcast + 1 + XBEE_STATE_STATE, STATE_SIZE);
+            state_at = sim_now_us();
+        }
+        return;
+    }
+    if (poll_len == 0 && byte != XBEE_POLL) return;
+    poll[poll_len++] = byte;
+    if (poll_len < sizeof poll) return;
+    poll_len = 0;
+    polls++;
+
+    uint8_t node = poll[1 + XBEE_POLL_NODE];
+    if (node >= NODES_MAX || !sensors[node].alive) return;
+    uint8_t reply[1 + XBEE_BATCH_LEN + SAMPLE_SIZE];
+    reply[0] = XBEE_BATCH;
+    reply[1 + XBEE_BATCH_NODE] = node;
+    reply[1 + XBEE_BATCH_COUNT] = 1;
+    reply[1 + XBEE_BATCH_SEQ] = sensors[node].seq;
+    uint8_t * s = reply + 1 + XBEE_BATCH_LEN;
+    s[0] = s[1] = 0;
+    sample_set_tempr(s, sensors[node].tempr);
+    sample_set_humid(s, sensors[node].humid);
+    sensors[node].seq = (sensors[node].seq + 1) & 0x7F;
+    sim_rx(SIM_XBEE, reply, sizeof reply);
+}
+
+void nodes_reset(void)
+{
+    memset(sensors, 0, sizeof sensors);
+    poll_len = 0;
+    polls = 0;
+    bcast_len = 0;
+    state_at = 0;
+    imp_len = 0;
+    imp_frame = 0;
+    memset(pending, 0, sizeof pending);
+    imp_resends = imp_lost = 0;
+    sim_alarm(NULL, 0);
+    sim_peer(peer);
+}
+
+void nodes_sensor(uint8_t node, bool alive, uint8_t tempr, uint8_t humid)
+{
+    sensors[node].alive = alive;
+    sensors[node].tempr = tempr;
+    sensors[node].humid = humid;
+}
+
+void nodes_imp_send(uint8_t frame, const uint8_t * payload, size_t n, uint8_t id)
+{
+    for (int i = 0; i < IMP_PENDING; i++) {
+        if (pending[i].len) continue;
+        uint8_t * p = pending[i].frame;
+        size_t len = 0;
+        if (id) {
+            p[len++] = IMP_HDR;
+            p[len++] = IMP_COMMAND_ID;
+            p[len++] = id;
+        }
+        p[len++] = IMP_HDR;
+        p[len++] = frame;
+        if (n > sizeof pending[i].frame - len) n = sizeof pending[i].frame - len;
+        memcpy(p + len, payload, n);
+        pending[i].len = len + n;
+        pending[i].id = id;
+        pending[i].tries = 0;
+        pending[i].due = sim_now_us() + IMP_WRITE_US;
+        imp_alarm();
+        return;
+    }
+}
+
+size_t nodes_imp_take(uint8_t * out, size_t max)
+{
+    sim_sync();
+    size_t n = imp_len < max ? imp_len : max;
+    memcpy(out, imp_out, n);
+    memmove(imp_out, imp_out + n, imp_len - n);
+    imp_len -= n;
+    return n;
+}
+
+uint64_t nodes_state(uint8_t * out)
+{
+    sim_sync();
+    memcpy(out, state, STATE_SIZE);
+    return state_at;
+}
+
+uint64_t nodes_polls(void)
+{
+    return polls;
+}
+
+uint64_t nodes_imp_resends(void)
+{
+    return imp_resends;
+}
+
+uint64_t nodes_imp_lost(void)
+{
+    return imp_lost;
+}
@@ -0,0 +1,48 @@
+/*************************************************************
+ *       nodes.h - Simulated Imp and XBee sensor nodes for host runs of the system controller.
+ *
+ *       nodes_reset() installs them as the simulator's serial peer. Sensor nodes answer every
+ *       poll with one fresh sample, as a node that samples between polls does, and keep the
+ *       last state broadcast for nodes_state(). Bytes the controller sends to the Imp are kept
+ *       for nodes_imp_take(). The Imp writes each frame shortly after nodes_imp_send(), out
+ *       of step with the controller's tick, heard or not, and a frame behind a command ID
+ *       again every second until the controller acknowledges it, three times at most, as
+ *       imp_node.nut does.
+ *************************************************************/
+
+#ifndef SIM_NODES_H
+#define SIM_NODES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NODES_MAX       4
+
+/* nodes_reset - Forget all state, with every sensor node silent, and become the serial peer. */
+void nodes_reset(void);
+
+/* nodes_sensor - Make sensor node "node" answer polls with the given reading, or stay silent. */
+void nodes_sensor(uint8_t node, bool alive, uint8_t tempr, uint8_t humid);
+
+/* nodes_imp_send - Have the Imp write a frame to the controller, behind command ID "id" if it is
+   not 0. */
+void nodes_imp_send(uint8_t frame, const uint8_t * payload, size_t n, uint8_t id);
+
+/* nodes_imp_take - Move up to "max" bytes the controller sent to the Imp into "out". */
+size_t nodes_imp_take(uint8_t * out, size_t max);
+
+/* nodes_state - Copy the last state packet broadcast to the sensor nodes into "state" and return the
+   virtual time in microseconds it first went out with these contents, or 0 if none has. */
+uint64_t nodes_state(uint8_t * state);
+
+/* nodes_polls - Polls the sensor nodes have received. */
+uint64_t nodes_polls(void);
+
+/* nodes_imp_resends - Commands the Imp has written again for want of an acknowledgement. */
+uint64_t nodes_imp_resends(void);
+
+/* nodes_imp_lost - Commands the Imp gave up on, never acknowledged. */
+uint64_t nodes_imp_lost(void);
+
+#endif
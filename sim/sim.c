@@ -0,0 +1,501 @@
+/*************************************************************
+ *       sim.c - Host simulation of the ATmega328 peripherals the controller firmware uses.
+ *
+ *       See sim.h. Built once per firmware target, with that target's F_CPU.
+ *************************************************************/
+
+#include "sim.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#define RX_QUEUE        4096
+
+// LCD wiring
+#define LCD_RS          0x10
+#define LCD_RW          0x08
+#define LCD_E           0x04
+#define LCD_DATA_B      0x03
+#define LCD_DATA_D      0xFC
+#define LCD_BUSY        0x80
+
+// ---------- REGISTERS ----------
+
+volatile uint8_t PINB, DDRB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t DDRD, PORTD;
+volatile uint8_t UCSR0C;
+volatile uint16_t UBRR0;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t OCR1A, TCNT1;
+volatile uint8_t MCUSR, WDTCSR;
+
+// Timer 1 compare, USART receive and watchdog handlers, if the firmware has them
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void USART_RX_vect(void) __attribute__((weak));
+void WDT_vect(void) __attribute__((weak));
+
+// ---------- STATE ----------
+
+uint8_t sim_eeprom[SIM_EEPROM_SIZE];
+struct sim_stats sim_stats;
+
+static uint64_t now;                // Cycles since reset
+static uint64_t next_tick;          // Cycle of the next timer 1 compare, 0 if not running
+static bool int_enabled;
+static bool in_isr;
+static bool mux;                    // PC0 selects the serial source
+
+static volatile uint8_t ucsr0a;
+static volatile uint8_t ucsr0b;
+
+// UDR0 holds UDR_READ | the received byte until the firmware writes it. A write stores the
+// byte itself (or a negative char), so the next access can tell a write from a read.
+#define UDR_READ        0x4000
+static volatile int16_t udr;
+static bool udr_used;               // UDR0 was accessed since the last sync
+static int udr_src;                 // Source selected at that access
+
+// Bytes head..live have reached the receiver; live..tail are still with the sender, and once
+// the line starts ("next" set) arrive one at a time at the line rate.
+static struct {
+    uint8_t buf[RX_QUEUE];
+    size_t head, live, tail;
+    uint64_t next;                  // Cycle the next byte arrives, 0 while the line is idle
+} rx[2];
+
+static void (*peer)(int, uint8_t);
+static bool in_peer;
+
+static void (*alarm_fn)(void);      // Set by sim_alarm(), cleared as it is called
+static uint64_t alarm_at;           // Cycle it is due
+
+static volatile uint8_t portb;
+static volatile uint8_t pind;
+static uint8_t lcd_e;               // LCD_E as of the last sync
+static uint64_t lcd_busy_until;     // Cycle the LCD's busy flag clears
+static bool lcd_failed;             // Busy flag stuck
+
+static uint64_t wdt_period;         // Watchdog timeout in cycles, 0 if it is stopped
+static uint64_t wdt_due;            // Cycle it times out
+
+static jmp_buf run_exit;
+static bool running;
+static uint64_t run_until;
+
+// ---------- CORE ----------
+
+static int src_selected(void)
+{
+    return (mux && (PORTC & (1 << PC0))) ? SIM_XBEE : SIM_IMP;
+}
+
+static size_t rx_len(int src)
+{
+    return rx[src].live - rx[src].head;
+}
+
+/*
+ byte_cycles - Cycles one 8N1 character takes on the line at the baud rate UBRR0 gives.
+ */
+static uint64_t byte_cycles(void)
+{
+    return 10 * 16 * ((uint64_t) UBRR0 + 1);
+}
+
+/*
+ rx_interrupt - Run the firmware's receive interrupt for each byte waiting in the receiver while
+ it is enabled and can be taken.
+ */
+static void rx_interrupt(void)
+{
+    while (USART_RX_vect && (ucsr0b & (1 << RXCIE0)) && (ucsr0b & (1 << RXEN0)) && int_enabled &&
+           !in_isr && rx_len(src_selected())) {
+        in_isr = true;
+        USART_RX_vect();
+        in_isr = false;
+        sim_sync();
+    }
+}
+
+/*
+ rx_flow - Take the bytes that have come down the line. One the receiver hears goes into its
+ buffer unless SIM_RX_FIFO bytes are already waiting there, when it is overrun and lost; one
+ that arrives with the receiver off or the other source selected is lost too.
+ */
+static void rx_flow(void)
+{
+    for (int src = 0; src < 2; src++) {
+        while (rx[src].next && rx[src].next <= now) {
+            bool heard = (ucsr0b & (1 << RXEN0)) && src_selected() == src;
+            if (heard && rx_len(src) < SIM_RX_FIFO) {
+                rx[src].live++;
+                rx_interrupt();
+            } else {
+                if (heard) sim_stats.overruns[src]++;
+                else sim_stats.dropped[src]++;
+                memmove(rx[src].buf + rx[src].live, rx[src].buf + rx[src].live + 1,
+                        rx[src].tail - rx[src].live - 1);
+                rx[src].tail--;
+            }
+            rx[src].next = rx[src].live < rx[src].tail ? rx[src].next + byte_cycles() : 0;
+        }
+    }
+}
+
+/*
+ timer_period - Cycles between timer 1 compare interrupts, or 0 if it is not running in CTC
+ mode with its interrupt enabled.
+ */
+static uint64_t timer_period(void)
+{
+    static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    uint16_t div = prescale[TCCR1B & 0x07];
+    if (!div || !(TCCR1B & (1 << WGM12)) || !(TIMSK1 & (1 << OCIE1A))) return 0;
+    return (uint64_t) (OCR1A + 1) * div;
+}
+
+/*
+ wdt_expire - The watchdog timed out: interrupt, or reset the part. A reset ends sim_run().
+ */
+static void wdt_expire(void)
+{
+    wdt_due = now + wdt_period;
+    if (WDTCSR & (1 << WDIE)) {
+        WDTCSR &= ~(1 << WDIE);
+        sim_stats.wdt_interrupts++;
+        if (WDT_vect && int_enabled && !in_isr) {
+            in_isr = true;
+            WDT_vect();
+            in_isr = false;
+        }
+        return;
+    }
+    sim_stats.wdt_resets++;
+    if (running) longjmp(run_exit, 1);
+}
+
+/*
+ advance - Move time on by "cycles", taking the timer interrupts and watchdog timeouts that fall
+ due, and leave sim_run() once its time is up.
+ */
+static void advance(uint64_t cycles)
+{
+    now += cycles;
+    rx_flow();
+    rx_interrupt();
+    uint64_t period = timer_period();
+    if (!period) {
+        next_tick = 0;
+    } else {
+        if (!next_tick) next_tick = now - cycles + period;
+        while (next_tick <= now && int_enabled && !in_isr) {
+            next_tick += period;
+            sim_stats.ticks++;
+            if (TIMER1_COMPA_vect) {
+                in_isr = true;
+                TIMER1_COMPA_vect();
+                in_isr = false;
+            }
+        }
+    }
+    while (wdt_period && wdt_due <= now) wdt_expire();
+    if (alarm_fn && alarm_at <= now) {
+        void (*fn)(void) = alarm_fn;
+        alarm_fn = NULL;
+        fn();
+    }
+    if (running && now >= run_until) longjmp(run_exit, 1);
+}
+
+/*
+ lcd_sync - Latch a write into the LCD if E fell since the last access to PORTB.
+ */
+static void lcd_sync(void)
+{
+    uint8_t e = portb & LCD_E;
+    if (lcd_e && !e && !(portb & LCD_RW)) {
+        uint8_t x = (portb & LCD_DATA_B) | (PORTD & LCD_DATA_D);
+        bool slow = !(portb & LCD_RS) && (x == 0x01 || (x & 0xFE) == 0x02);
+        lcd_busy_until = now + (uint64_t) (slow ? SIM_LCD_HOME_US : SIM_LCD_WRITE_US) * F_CPU / 1000000;
+        sim_stats.lcd_writes++;
+    }
+    lcd_e = e;
+}
+
+void sim_sync(void)
+{
+    lcd_sync();
+    if (!(ucsr0b & (1 << RXEN0))) {
+        for (int src = 0; src < 2; src++) {
+            sim_stats.dropped[src] += rx_len(src);
+            rx[src].head = rx[src].live;
+        }
+    }
+    if (!udr_used) return;
+    udr_used = false;
+    if (udr < UDR_READ) {
+        uint8_t byte = (uint8_t) udr;
+        sim_stats.tx_bytes[udr_src]++;
+        if (peer) {
+            in_peer = true;
+            peer(udr_src, byte);
+            in_peer = false;
+        }
+    } else if (rx_len(udr_src)) {
+        rx[udr_src].head++;
+        sim_stats.rx_bytes[udr_src]++;
+    }
+}
+
+// ---------- API ----------
+
+void sim_reset(bool use_mux)
+{
+    PINB = DDRB = portb = 0;
+    PINC = DDRC = PORTC = 0;
+    pind = DDRD = PORTD = 0;
+    lcd_e = 0;
+    lcd_busy_until = 0;
+    lcd_failed = false;
+    wdt_period = wdt_due = 0;
+    UCSR0C = 0;
+    UBRR0 = 0;
+    TCCR1A = TCCR1B = TIMSK1 = 0;
+    OCR1A = TCNT1 = 0;
+    MCUSR = WDTCSR = 0;
+    ucsr0a = ucsr0b = 0;
+    udr = UDR_READ;
+    udr_used = false;
+    memset(rx, 0, sizeof rx);
+    memset(sim_eeprom, 0xFF, sizeof sim_eeprom);
+    memset(&sim_stats, 0, sizeof sim_stats);
+    now = next_tick = 0;
+    alarm_fn = NULL;
+    int_enabled = in_isr = false;
+    mux = use_mux;
+}
+
+void sim_peer(void (*fn)(int, uint8_t))
+{
+    peer = fn;
+}
+
+void sim_alarm(void (*fn)(void), uint64_t us)
+{
+    alarm_fn = fn;
+    alarm_at = (us * F_CPU + 999999) / 1000000;     // Not before "us", as sim_now_us() rounds
+}
+
+void sim_rx(int src, const uint8_t * p, size_t n)
+{
+    if (rx[src].head == rx[src].tail) {
+        rx[src].head = rx[src].live = rx[src].tail = 0;
+        rx[src].next = 0;
+    }
+    if (n > RX_QUEUE - rx[src].tail) {
+        memmove(rx[src].buf, rx[src].buf + rx[src].head, rx[src].tail - rx[src].head);
+        rx[src].live -= rx[src].head;
+        rx[src].tail -= rx[src].head;
+        rx[src].head = 0;
+    }
+    if (n > RX_QUEUE - rx[src].tail) n = RX_QUEUE - rx[src].tail;
+    memcpy(rx[src].buf + rx[src].tail, p, n);
+    rx[src].tail += n;
+    if (!rx[src].next && rx[src].live < rx[src].tail) {
+        // The sender writes at once, heard or not: a peer's reply as soon as the byte it
+        // answers is sent, anything else as it is queued.
+        rx[src].next = now + byte_cycles();
+    }
+}
+
+size_t sim_pending(int src)
+{
+    sim_sync();
+    return rx[src].tail - rx[src].head;
+}
+
+uint64_t sim_now_us(void)
+{
+    return now * 1000000 / F_CPU;
+}
+
+uint64_t sim_cycles(void)
+{
+    return now;
+}
+
+void sim_lcd_fail(bool failed)
+{
+    lcd_failed = failed;
+}
+
+bool sim_run(void (*entry)(void), uint64_t us)
+{
+    run_until = now + us * F_CPU / 1000000;
+    running = true;
+    if (setjmp(run_exit) == 0) {
+        entry();
+        running = false;
+        sim_sync();
+        return false;
+    }
+    running = false;
+    in_isr = false;
+    sim_sync();
+    return true;
+}
+
+// ---------- PERIPHERALS ----------
+
+volatile uint8_t * sim_ucsr0a(void)
+{
+    sim_sync();
+    advance(SIM_POLL_CYCLES);
+    uint8_t v = (1 << UDRE0) | (1 << TXC0);
+    if ((ucsr0b & (1 << RXEN0)) && rx_len(src_selected())) v |= 1 << RXC0;
+    ucsr0a = v;
+    return &ucsr0a;
+}
+
+volatile uint8_t * sim_ucsr0b(void)
+{
+    sim_sync();
+    return &ucsr0b;
+}
+
+volatile int16_t * sim_udr0(void)
+{
+    sim_sync();
+    udr_src = src_selected();
+    udr = UDR_READ | (rx_len(udr_src) ? rx[udr_src].buf[rx[udr_src].head] : 0);
+    udr_used = true;
+    return &udr;
+}
+
+volatile uint8_t * sim_portb(void)
+{
+    sim_sync();
+    return &portb;
+}
+
+volatile uint8_t * sim_pind(void)
+{
+    sim_sync();
+    pind = (pind & ~LCD_BUSY) | (lcd_failed || now < lcd_busy_until ? LCD_BUSY : 0);
+    return &pind;
+}
+
+void sim_delay_cycles(uint64_t cycles)
+{
+    sim_sync();
+    advance(cycles);
+}
+
+void sim_sleep(void)
+{
+    sim_sync();
+    for (;;) {
+        uint64_t period = int_enabled ? timer_period() : 0;
+        if (period && !next_tick) next_tick = now + period;
+        uint64_t wake = period ? next_tick : 0;
+        if (wdt_period && (!wake || wdt_due < wake)) wake = wdt_due;
+        int src = src_selected();
+        if (int_enabled && (ucsr0b & (1 << RXCIE0)) && rx[src].next && (!wake || rx[src].next < wake))
+            wake = rx[src].next;    // The receive interrupt for the next byte
+        if (!wake) return;          // Nothing would ever wake the part
+        if (alarm_fn && alarm_at < wake) {
+            // Sleep through the alarm, which may send something that wakes the part sooner.
+            advance(alarm_at > now ? alarm_at - now : 0);
+            continue;
+        }
+        advance(wake > now ? wake - now : 0);
+        return;
+    }
+}
+
+void sim_sei(void)
+{
+    int_enabled = true;
+    advance(0);     // Take an interrupt that fell due while they were off
+}
+
+void sim_cli(void)
+{
+    int_enabled = false;
+}
+
+void sim_wdt_reset(void)
+{
+    wdt_due = now + wdt_period;
+}
+
+void sim_wdt_enable(int timeout)
+{
+    // As avr-libc's wdt_enable(): WDE set and WDIE cleared; -1 stops it.
+    WDTCSR = timeout < 0 ? 0 : (1 << WDE);
+    wdt_period = timeout < 0 ? 0 : (uint64_t) SIM_WDT_UNIT_US * F_CPU / 1000000 << timeout;
+    wdt_due = now + wdt_period;
+}
+
+// ---------- EEPROM ----------
+
+static size_t ee_addr(const void * p)
+{
+    return (size_t) (uintptr_t) p % SIM_EEPROM_SIZE;
+}
+
+uint8_t eeprom_read_byte(const uint8_t * addr)
+{
+    return sim_eeprom[ee_addr(addr)];
+}
+
+void eeprom_write_byte(uint8_t * addr, uint8_t value)
+{
+    sim_eeprom[ee_addr(addr)] = value;
+    sim_stats.eeprom_writes++;
+    sim_delay_cycles((uint64_t) SIM_EEPROM_WRITE_US * F_CPU / 1000000);
+}
+
+void eeprom_update_byte(uint8_t * addr, uint8_t value)
+{
+    if (sim_eeprom[ee_addr(addr)] != value) eeprom_write_byte(addr, value);
+}
+
+void eeprom_read_block(void * dst, const void * src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) ((uint8_t *) dst)[i] = sim_eeprom[(ee_addr(src) + i) % SIM_EEPROM_SIZE];
+}
+
+void eeprom_update_block(const void * src, void * dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        eeprom_update_byte((uint8_t *) (uintptr_t) ((ee_addr(dst) + i) % SIM_EEPROM_SIZE),
+                           ((const uint8_t *) src)[i]);
+    }
+}
+
+// ---------- PROGRAM MEMORY ----------
+
+int vsnprintf_P(char * s, size_t n, const char * fmt, va_list ap)
+{
+    // %S is a program memory string to avr-libc but a wide string to the host's printf.
+    char host[256];
+    size_t j = 0;
+    for (size_t i = 0; fmt[i] && j < sizeof host - 1; i++) {
+        host[j++] = fmt[i];
+        if (fmt[i] == '%' && fmt[i + 1] == '%') {
+            if (j < sizeof host - 1) host[j++] = fmt[++i];
+        } else if (fmt[i] == '%' && fmt[i + 1] == 'S') {
+            if (j < sizeof host - 1) host[j++] = 's';
+            i++;
+        }
+    }
+    host[j] = '\0';
+    return vsnprintf(s, n, host, ap);
+}
@@ -0,0 +1,122 @@
+/*************************************************************
+ *       sim.h - Host simulation of the ATmega328 peripherals the controller firmware uses.
+ *
+ *       The firmware sources are compiled unchanged for the host against the headers in
+ *       sim/include, which stand in for avr-libc. Registers are plain variables except where
+ *       the firmware waits on hardware:
+ *
+ *       USART0 - UCSR0A, UCSR0B and UDR0 go through the simulator. Received bytes are
+ *              queued per source; on the system controller PC0 selects the Imp (0) or the
+ *              XBee (1), as the UART mux does. Every transmitted byte is handed to the peer
+ *              callback, which may queue a reply. A reply starts down the line as soon as
+ *              the byte it answers is sent, and bytes queued from outside as they are
+ *              queued, whatever the mux and the receiver are doing, as from a sender with
+ *              no flow control; they arrive one character time (at the UBRR0 baud rate)
+ *              apart. The receiver holds
+ *              SIM_RX_FIFO unread bytes, its two-byte buffer and the shift register; a
+ *              byte arriving behind them is overrun and lost, as is one arriving while the
+ *              receiver is off or the other source is selected. Clearing RXEN0 drops what
+ *              has arrived and not been read. With RXCIE0 set and interrupts enabled, each
+ *              byte the receiver holds runs the firmware's USART_RX_vect, and the next one
+ *              due wakes the part from sleep.
+ *       LCD - An HD44780 on the system controller's wiring: E, R/W and RS on PB2-PB4, data on
+ *              PB0-PB1 and PD2-PD7. Every write it latches (the fall of E with R/W low)
+ *              keeps the busy flag, PD7 when read, set for SIM_LCD_WRITE_US, or
+ *              SIM_LCD_HOME_US for clear and home. sim_lcd_fail() holds it busy, as a failed
+ *              display does.
+ *       Watchdog - Times out SIM_WDT_UNIT_US << the WDTO_ value after the last wdt_reset().
+ *              With WDIE set the timeout runs the firmware's WDT_vect and clears WDIE;
+ *              otherwise it resets the part: the reset is counted and ends sim_run().
+ *       Timer 1 - CTC compare interrupts at the rate OCR1A and the prescaler give.
+ *       EEPROM - SIM_EEPROM_SIZE bytes, erased to 0xFF by sim_reset(). A write that changes
+ *              a cell costs SIM_EEPROM_WRITE_US.
+ *       Time - Virtual, in CPU cycles at F_CPU. It moves on with the _delay_* functions,
+ *              sleep, EEPROM writes, and SIM_POLL_CYCLES for every read of UCSR0A, the cost
+ *              of one pass of the firmware's wait loops.
+ *
+ *       Transmission takes no time, so TXC0 always reads set and times are the firmware's own
+ *       waits and delays; only received bytes come at the line rate.
+ *
+ *************************************************************/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIM_EEPROM_SIZE     1024
+#define SIM_EEPROM_WRITE_US 3400    // Erase and write of one cell
+#define SIM_POLL_CYCLES     6       // One pass of a UCSR0A wait loop
+#define SIM_RX_FIFO         3       // Unread bytes the receiver holds before an overrun
+#define SIM_LCD_WRITE_US    37      // HD44780 instruction or data write
+#define SIM_LCD_HOME_US     1520    // HD44780 clear display or return home
+#define SIM_WDT_UNIT_US     16000   // Watchdog timeout at WDTO_15MS (2K cycles at 128 kHz)
+
+// Serial sources
+#define SIM_IMP             0
+#define SIM_XBEE            1
+
+struct sim_stats {
+    uint64_t eeprom_writes;     // Cells actually written
+    uint64_t tx_bytes[2];
+    uint64_t rx_bytes[2];
+    uint64_t dropped[2];        // Bytes lost to RXEN0 off or the other source selected
+    uint64_t overruns[2];       // Bytes lost because the firmware read too slowly
+    uint64_t ticks;             // Timer 1 interrupts taken
+    uint64_t lcd_writes;        // Instructions and characters written to the LCD
+    uint64_t wdt_interrupts;    // Watchdog timeouts that ran WDT_vect
+    uint64_t wdt_resets;        // Watchdog timeouts that reset the part
+};
+
+extern uint8_t sim_eeprom[SIM_EEPROM_SIZE];
+extern struct sim_stats sim_stats;
+
+/* sim_reset - Power on: clear registers, queues and statistics, erase the EEPROM, time 0.
+ * "mux" is whether PC0 selects the serial source (system controller) or is a plain output. */
+void sim_reset(bool mux);
+
+/* sim_peer - Called with every byte the firmware transmits and the source it went to. */
+void sim_peer(void (*peer)(int src, uint8_t byte));
+
+/* sim_alarm - Call "fn" once virtual time reaches "us" microseconds, as a sender with its own
+ * clock; it may queue bytes with sim_rx(). One alarm is set at a time, and NULL clears it. */
+void sim_alarm(void (*fn)(void), uint64_t us);
+
+/* sim_rx - Queue bytes for the firmware to receive from source "src". */
+void sim_rx(int src, const uint8_t * p, size_t n);
+
+/* sim_pending - Bytes queued from source "src" and not yet read, arrived or not. */
+size_t sim_pending(int src);
+
+/* sim_now_us - Virtual time since sim_reset(), in microseconds. */
+uint64_t sim_now_us(void);
+
+/* sim_cycles - Virtual time since sim_reset(), in CPU cycles. */
+uint64_t sim_cycles(void);
+
+/* sim_run - Call "entry", normally the firmware's main loop, until "us" more microseconds of
+ * virtual time have passed, then return to the caller. Returns false if "entry" returned first. */
+bool sim_run(void (*entry)(void), uint64_t us);
+
+/* sim_lcd_fail - Make the LCD's busy flag stick (a failed display) or work again. */
+void sim_lcd_fail(bool failed);
+
+/* sim_sync - Finish the firmware's last register access; call before inspecting its output. */
+void sim_sync(void);
+
+// Used by the headers in sim/include
+volatile uint8_t * sim_ucsr0a(void);
+volatile uint8_t * sim_ucsr0b(void);
+volatile int16_t * sim_udr0(void);
+volatile uint8_t * sim_portb(void);
+volatile uint8_t * sim_pind(void);
+void sim_delay_cycles(uint64_t cycles);
+void sim_sleep(void);
+void sim_sei(void);
+void sim_cli(void);
+void sim_wdt_reset(void);
+void sim_wdt_enable(int timeout);
+
+#endif
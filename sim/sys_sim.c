@@ -0,0 +1,297 @@
+/*************************************************************
+ *       sys_sim.c - Run the system controller firmware on the host against simulated nodes.
+ *
+ *       Boots the controller with one live sensor node, then plays a short session from the
+ *       Imp: a state command, the same command again as a retry, a status request, a
+ *       telemetry request, a settings backup written back, a scene defined, applied by ID and
+ *       erased, a rule defined and erased, and a rule that fires. Then the display fails for a while and comes back,
+ *       and the sensor node goes silent long enough to be dropped, a time rule fires meanwhile,
+ *       and the node comes back. Prints what the controller sent back, the state broadcasts
+ *       rules caused, the display, and the EEPROM writes each step cost.
+ *
+ *           shs_sys_sim [seconds to run at the end]
+ *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodes.h"
+#include "protocol/shs_frames.h"
+#include "sim.h"
+
+// The firmware, built with -Dmain=firmware_main
+void sys_init(void);
+void sys_task(void);
+void sys_idle(void);
+extern char str_0[];
+extern char str_1[];
+extern volatile uint8_t sensor_wait;
+
+/*
+ run_for - Run the main loop for "ms" milliseconds of virtual time, a whole pass at a time.
+ */
+static void run_for(uint64_t ms)
+{
+    uint64_t end = sim_now_us() + ms * 1000;
+    while (sim_now_us() < end) {
+        sys_task();
+        sys_idle();
+    }
+}
+
+/*
+ step - Print what the controller sent the Imp and the EEPROM writes since the last step.
+ */
+static void step(const char * what)
+{
+    static uint64_t writes;
+    uint8_t out[256];
+    size_t n = nodes_imp_take(out, sizeof out);
+
+    printf("%8.3f s  %-26s eeprom writes %3llu  to imp:", sim_now_us() / 1e6, what,
+           (unsigned long long) (sim_stats.eeprom_writes - writes));
+    for (size_t i = 0; i < n; i++) printf(" %02X", out[i]);
+    printf("\n");
+    writes = sim_stats.eeprom_writes;
+}
+
+/*
+ broadcast - Print the last state broadcast to the sensor nodes and how long after "since" it
+ first went out, or that it went out before "since" and nothing new has since.
+ */
+static void broadcast(uint64_t since)
+{
+    uint8_t state[STATE_SIZE];
+    uint64_t at = nodes_state(state);
+
+    if (at >= since)
+        printf("          xbee state %02X %02X %02X, %.3f s after it was due\n", state[0], state[1],
+               state[2], (at - since) / 1e6);
+    else
+        printf("          xbee state %02X %02X %02X, unchanged since before it was due\n", state[0],
+               state[1], state[2]);
+}
+
+/*
+ cells_changed - Print the EEPROM cells that differ from "before".
+ */
+static void cells_changed(const uint8_t * before)
+{
+    printf("          eeprom cells changed:");
+    for (size_t i = 0; i < SIM_EEPROM_SIZE; i++) {
+        if (sim_eeprom[i] != before[i]) printf(" %02zX", i);
+    }
+    printf("\n");
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned long seconds = argc > 1 ? strtoul(argv[1], NULL, 0) : 30;
+
+    sim_reset(true);
+    nodes_reset();
+    nodes_sensor(0, true, 68, 40);
+
+    sys_init();
+    run_for(2000);
+    step("boot");
+
+    uint8_t state[STATE_SIZE] = { 0, 0, 0 };
+    state_set_heater(state, 1);
+    state_set_tempr(state, 72);
+    state_set_humid(state, 45);
+    nodes_imp_send(IMP_STATE, state, sizeof state, 1);
+    run_for(1000);
+    step("state command, id 1");
+
+    nodes_imp_send(IMP_STATE, state, sizeof state, 1);
+    run_for(1000);
+    step("same command again");
+
+    uint8_t ask[STATE_SIZE] = { 0, 0, 0 };
+    state_set_status_req(ask, 1);
+    nodes_imp_send(IMP_STATE, ask, sizeof ask, 0);
+    run_for(1000);
+    step("status request");
+
+    nodes_imp_send(IMP_TELEMETRY, NULL, 0, 0);
+    run_for(1000);
+    step("telemetry request");
+
+    // Back the settings up and write them back: the image comes in one burst.
+    uint8_t image[IMP_SETTINGS_LEN + 256];
+    nodes_imp_send(IMP_SETTINGS_GET, NULL, 0, 0);
+    run_for(2000);
+    nodes_imp_take(image, sizeof image);
+    size_t image_len = IMP_SETTINGS_LEN + image[IMP_SETTINGS_SIZE];    // Not what followed it
+    printf("%8.3f s  %-26s %zu bytes\n", sim_now_us() / 1e6, "settings backup", image_len);
+    nodes_imp_send(IMP_SETTINGS_PUT, image, image_len, 3);
+    run_for(2000);
+    step("settings restore, id 3");
+
+    // Scene packets are data to the end, 0xFF included: all 0xFF erases the slot.
+    uint8_t night[STATE_SIZE] = { 0, 0, 0 };    // Goodnight: heat to 66, humidifier on, lights off
+    state_set_heater(night, 1);
+    state_set_tempr(night, 66);
+    state_set_humid(night, 45);
+    state_set_humid_on(night, 1);
+    uint8_t scene[IMP_SCENE_SET_LEN] = { 1 };
+    memcpy(scene + IMP_SCENE_SET_STATE, night, STATE_SIZE);
+    nodes_imp_send(IMP_SCENE_SET, scene, sizeof scene, 4);
+    run_for(1000);
+    step("scene 1 defined, id 4");
+
+    // Applying it is one ID byte: one commit of the packet cells, the slot only read, and the
+    // sensor nodes told. Applying it again changes nothing and writes nothing.
+    uint8_t apply[IMP_SCENE_LEN] = { 1 };
+    uint8_t before[SIM_EEPROM_SIZE];
+    uint64_t sent = sim_now_us();
+    memcpy(before, sim_eeprom, sizeof before);
+    nodes_imp_send(IMP_SCENE, apply, sizeof apply, 11);
+    run_for(1000);
+    step("scene 1 applied, id 11");
+    cells_changed(before);
+    broadcast(sent);
+    nodes_imp_send(IMP_STATE, ask, sizeof ask, 0);
+    run_for(1000);
+    step("status request");
+    nodes_imp_send(IMP_SCENE, apply, sizeof apply, 12);
+    run_for(1000);
+    step("scene 1 again, id 12");
+
+    // A scene ID out of range, or of an erased slot, is acknowledged and otherwise ignored.
+    sent = sim_now_us();
+    apply[IMP_SCENE_SCENE] = 9;
+    nodes_imp_send(IMP_SCENE, apply, sizeof apply, 13);
+    run_for(1000);
+    step("scene 9 applied, id 13");
+    broadcast(sent);
+    memset(scene + IMP_SCENE_SET_STATE, 0xFF, STATE_SIZE);
+    nodes_imp_send(IMP_SCENE_SET, scene, sizeof scene, 5);
+    run_for(1000);
+    step("scene 1 erased, id 5");
+    sent = sim_now_us();
+    apply[IMP_SCENE_SCENE] = 1;
+    nodes_imp_send(IMP_SCENE, apply, sizeof apply, 14);
+    run_for(1000);
+    step("scene 1 applied, id 14");
+    broadcast(sent);
+    nodes_imp_send(IMP_STATE, ask, sizeof ask, 0);
+    run_for(1000);
+    step("status request");
+    nodes_imp_send(IMP_STATE, state, sizeof state, 15);
+    run_for(1000);
+    step("state command, id 15");
+
+    // The same for rules: all output bits set (operand 0xFF) turns the lights on.
+    uint8_t rule[IMP_RULE_SET_LEN] = { 2 };
+    rule_set_src(rule + IMP_RULE_SET_RULE, 3);          // First packet byte
+    rule_set_cmp(rule + IMP_RULE_SET_RULE, 3);          // All operand bits set
+    rule_set_operand(rule + IMP_RULE_SET_RULE, 0xFF);
+    rule_set_action(rule + IMP_RULE_SET_RULE, 3);       // Lighting
+    rule_set_arg(rule + IMP_RULE_SET_RULE, 2);
+    nodes_imp_send(IMP_RULE_SET, rule, sizeof rule, 6);
+    run_for(1000);
+    step("rule 2 defined, id 6");
+    memset(rule + IMP_RULE_SET_RULE, 0xFF, RULE_SIZE);
+    nodes_imp_send(IMP_RULE_SET, rule, sizeof rule, 7);
+    run_for(1000);
+    step("rule 2 erased, id 7");
+
+    // A rule that fires at once: above 67 F (the sensor reads 68) turn the lights on. The
+    // sensor nodes must hear the new state straight away, not at the next poll.
+    sent = sim_now_us();
+    memset(rule + IMP_RULE_SET_RULE, 0, RULE_SIZE);
+    rule[IMP_RULE_SET_INDEX] = 3;
+    rule_set_src(rule + IMP_RULE_SET_RULE, 0);          // Temperature
+    rule_set_cmp(rule + IMP_RULE_SET_RULE, 1);          // Greater than
+    rule_set_operand(rule + IMP_RULE_SET_RULE, 67);
+    rule_set_action(rule + IMP_RULE_SET_RULE, 3);       // Lighting
+    rule_set_arg(rule + IMP_RULE_SET_RULE, 2);          // On
+    nodes_imp_send(IMP_RULE_SET, rule, sizeof rule, 8);
+    run_for(1000);
+    step("rule 3 fires, id 8");
+    broadcast(sent);
+    nodes_imp_send(IMP_STATE, ask, sizeof ask, 0);
+    run_for(1000);
+    step("status request");
+
+    run_for(seconds * 1000);
+    step("running");
+
+    // The Imp writes whenever it likes: a command that comes while the mux is on the XBee for
+    // a sensor poll is lost, and the Imp's resend a second later is applied. The controller is
+    // held up for 28 ms first, so the poll it then starts is under way when the Imp writes.
+    uint64_t dropped = sim_stats.dropped[SIM_IMP];
+    nodes_imp_send(IMP_STATE, state, sizeof state, 16);
+    sim_delay_cycles(28 * (F_CPU / 1000));
+    sensor_wait = 0;
+    run_for(2000);
+    step("command in a poll, id 16");
+    printf("          %llu bytes from the imp dropped, %llu commands resent\n",
+           (unsigned long long) (sim_stats.dropped[SIM_IMP] - dropped),
+           (unsigned long long) nodes_imp_resends());
+
+    // A failed display must not slow the radio or the controls down.
+    uint64_t polls = nodes_polls();
+    sim_lcd_fail(true);
+    state_set_tempr(state, 70);
+    nodes_imp_send(IMP_STATE, state, sizeof state, 2);
+    run_for(20000);
+    step("display failed, command 2");
+    nodes_imp_send(IMP_TELEMETRY, NULL, 0, 0);
+    run_for(1000);
+    step("telemetry request");
+    printf("          %llu sensor polls with the display failed\n",
+           (unsigned long long) (nodes_polls() - polls));
+    sim_lcd_fail(false);
+    run_for(12000);
+    step("display repaired");
+    
+    // A silent node: stale (the heat call holds), then dropped (no call), then back.
+    nodes_sensor(0, false, 0, 0);
+    run_for(130000);
+    step("sensor silent 130 s");
+
+    // A time rule fires while no node answers, so no poll broadcasts the state: at 10:10
+    // turn the lighting to auto. Only the rule's own broadcast tells the sensor nodes.
+    uint8_t clock[IMP_CLOCK_LEN] = { 10, 9 };
+    nodes_imp_send(IMP_CLOCK, clock, sizeof clock, 9);
+    run_for(1000);
+    step("clock 10:09, id 9");
+    memset(rule + IMP_RULE_SET_RULE, 0, RULE_SIZE);
+    rule[IMP_RULE_SET_INDEX] = 4;
+    rule_set_src(rule + IMP_RULE_SET_RULE, 2);          // Time of day, 10 minute units
+    rule_set_cmp(rule + IMP_RULE_SET_RULE, 2);          // Equal
+    rule_set_operand(rule + IMP_RULE_SET_RULE, 61);     // 10:10
+    rule_set_action(rule + IMP_RULE_SET_RULE, 3);       // Lighting
+    rule_set_arg(rule + IMP_RULE_SET_RULE, 0);          // Auto
+    nodes_imp_send(IMP_RULE_SET, rule, sizeof rule, 10);
+    run_for(1000);
+    step("rule 4 at 10:10, id 10");
+    uint64_t ten_ten = sim_now_us() + 58000000;
+    run_for(59000);
+    step("10:10, rule 4 fires");
+    broadcast(ten_ten);
+    run_for(59000);
+    step("sensor silent 250 s");
+    nodes_sensor(0, true, 66, 40);
+    run_for(15000);
+    step("sensor back");
+
+    printf("display   |%s|\n          |%s|\n", str_0, str_1);
+    printf("%llu sensor polls, %llu timer ticks, %llu bytes to the xbee\n",
+           (unsigned long long) nodes_polls(), (unsigned long long) sim_stats.ticks,
+           (unsigned long long) sim_stats.tx_bytes[SIM_XBEE]);
+    printf("%llu bytes from the imp, %llu overrun, %llu dropped\n",
+           (unsigned long long) sim_stats.rx_bytes[SIM_IMP],
+           (unsigned long long) sim_stats.overruns[SIM_IMP],
+           (unsigned long long) sim_stats.dropped[SIM_IMP]);
+    printf("%llu commands resent by the imp, %llu lost\n", (unsigned long long) nodes_imp_resends(),
+           (unsigned long long) nodes_imp_lost());
+    printf("%llu LCD writes\n", (unsigned long long) sim_stats.lcd_writes);
+    printf("watchdog: %llu interrupts, %llu resets\n", (unsigned long long) sim_stats.wdt_interrupts,
+           (unsigned long long) sim_stats.wdt_resets);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""
+test_gen_codec.py - Round trip of the Python codec model in tools/gen_codec.py, and of the field
+tables generated into the Squirrel sources, for every layout in protocol/frames.schema.
+
+    tests/test_gen_codec.py
+
+The C and C++ codecs are checked against the same model by the tests gen_codec.py --tests
+writes; Squirrel has no interpreter here, so its tables are compared with the schema instead.
+"""
+
+import os
+import random
+import re
+import sys
+import unittest
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, os.path.join(ROOT, "tools"))
+
+import gen_codec  # noqa: E402
+
+CONSTS, LAYOUTS, FRAMES = gen_codec.parse(gen_codec.SCHEMA)
+
+
+class ModelTest(unittest.TestCase):
+    def test_values_round_trip(self):
+        for layout in LAYOUTS.values():
+            rng = random.Random(layout.name)
+            for _ in range(200):
+                values = {f.name: rng.randrange(f.mask + 1) for f in layout.fields}
+                data = gen_codec.pack(layout, values)
+                self.assertEqual(len(data), layout.size)
+                self.assertEqual(gen_codec.unpack(layout, data), values, layout.name)
+
+    def test_bytes_round_trip(self):
+        for layout in LAYOUTS.values():
+            used = gen_codec.used_bits(layout)
+            for data in gen_codec.vectors(layout):
+                kept = bytes(b & u for b, u in zip(data, used))
+                self.assertEqual(gen_codec.pack(layout, gen_codec.unpack(layout, data)), kept,
+                                 layout.name)
+
+    def test_fields_independent(self):
+        for layout in LAYOUTS.values():
+            for f in layout.fields:
+                values = gen_codec.unpack(layout, gen_codec.pack(layout, {f.name: f.mask}))
+                for g in layout.fields:
+                    self.assertEqual(values[g.name], f.mask if g is f else 0,
+                                     "%s.%s" % (layout.name, g.name))
+
+    def test_masked_on_pack(self):
+        for layout in LAYOUTS.values():
+            values = {f.name: 0xFF for f in layout.fields}
+            self.assertEqual(gen_codec.unpack(layout, gen_codec.pack(layout, values)),
+                             {f.name: f.mask for f in layout.fields}, layout.name)
+
+
+class SquirrelTest(unittest.TestCase):
+    TABLE = re.compile(r"^(\w+)_FIELDS <- \{\n(.*?)^\};", re.M | re.S)
+    ENTRY = re.compile(r"^\s+(\w+) = \[(\d+), (\d+), (0x[0-9A-F]+)\],$", re.M)
+
+    def test_field_tables(self):
+        for path in gen_codec.NUT_OUTS:
+            with open(path) as f:
+                text = f.read()
+            tables = {m.group(1): m.group(2) for m in self.TABLE.finditer(text)}
+            for layout in LAYOUTS.values():
+                entries = [(m.group(1), int(m.group(2)), int(m.group(3)), int(m.group(4), 16))
+                           for m in self.ENTRY.finditer(tables[layout.name.upper()])]
+                want = [(f.name, f.byte, f.bit, f.mask) for f in layout.fields]
+                self.assertEqual(entries, want, "%s in %s" % (layout.name, path))
+
+
+if __name__ == "__main__":
+    unittest.main()
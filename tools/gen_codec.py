@@ -0,0 +1,740 @@
+#!/usr/bin/env python3
+"""
+gen_codec.py - Generate the frame codecs for every target from protocol/frames.schema.
+
+    tools/gen_codec.py               Rewrite the generated files
+    tools/gen_codec.py --check       Exit non-zero if any generated file is out of date
+    tools/gen_codec.py --tests DIR   Write round-trip tests of the C and C++ codecs into DIR
+
+Outputs:
+    protocol/shs_frames.h            C accessors for the AVR firmware
+    gateway/include/shs/frames.hpp   C++ field tables and structs for the host gateway
+    imp_node.nut, server.nut         Squirrel tables, between the GENERATED FRAMES markers
+
+Every accessor is a fixed shift and mask, so no generated code branches on field values.
+pack() and unpack() below are the same codec in Python, the model the tests check the
+generated C and C++ against.
+"""
+
+import os
+import random
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SCHEMA = os.path.join(ROOT, "protocol", "frames.schema")
+
+C_OUT = os.path.join(ROOT, "protocol", "shs_frames.h")
+CPP_OUT = os.path.join(ROOT, "gateway", "include", "shs", "frames.hpp")
+NUT_OUTS = [os.path.join(ROOT, "imp_node.nut"), os.path.join(ROOT, "server.nut")]
+
+NUT_BEGIN = "// BEGIN GENERATED FRAMES"
+NUT_END = "// END GENERATED FRAMES"
+
+NOTICE = "Generated by tools/gen_codec.py from protocol/frames.schema. Do not edit."
+
+
+class SchemaError(Exception):
+    pass
+
+
+class Field:
+    def __init__(self, name, byte, bit, width):
+        self.name, self.byte, self.bit, self.width = name, byte, bit, width
+        self.mask = (1 << width) - 1
+
+
+class Layout:
+    def __init__(self, name, size):
+        self.name, self.size, self.fields = name, size, []
+
+
+class Item:
+    def __init__(self, name, type, count=None):
+        self.name, self.type, self.count = name, type, count
+
+
+class Frame:
+    def __init__(self, name, header, items):
+        self.name, self.header, self.items = name, header, items
+
+
+# ---------- PARSING ----------
+
+def parse(path):
+    consts, layouts, frames = {}, {}, []
+    layout = None
+
+    with open(path) as f:
+        lines = f.readlines()
+
+    for lineno, raw in enumerate(lines, 1):
+        line = raw.split("#", 1)[0].strip()
+        if not line:
+            continue
+        words = line.split()
+        where = "%s:%d" % (os.path.basename(path), lineno)
+
+        try:
+            if layout is not None:
+                if words == ["end"]:
+                    check_layout(layout)
+                    layouts[layout.name] = layout
+                    layout = None
+                elif len(words) == 4:
+                    byte, bit, width = (int(w, 0) for w in words[1:])
+                    layout.fields.append(Field(words[0], byte, bit, width))
+                else:
+                    raise SchemaError("expected '<field> <byte> <bit> <width>' or 'end'")
+            elif words[0] == "const" and len(words) == 3:
+                consts[words[1]] = int(words[2], 0)
+            elif words[0] == "layout" and len(words) == 3:
+                layout = Layout(words[1], int(words[2], 0))
+            elif words[0] == "frame" and ":" in words:
+                colon = words.index(":")
+                header = [consts[w] if w in consts else int(w, 0) for w in words[2:colon]]
+                items = [parse_item(w, layouts) for w in words[colon + 1:]]
+                frame = Frame(words[1], header, items)
+                check_frame(frame)
+                frames.append(frame)
+            else:
+                raise SchemaError("unrecognised line")
+        except (SchemaError, ValueError, KeyError) as e:
+            raise SchemaError("%s: %s" % (where, e))
+
+    if layout is not None:
+        raise SchemaError("layout %s has no 'end'" % layout.name)
+    return consts, layouts, frames
+
+
+def parse_item(word, layouts):
+    m = re.match(r"^(\w+)(?::(\w+))?(?:\[(\w+)\])?$", word)
+    if not m:
+        raise SchemaError("bad payload item '%s'" % word)
+    name, type, count = m.group(1), m.group(2), m.group(3)
+    if type is None:
+        type = name
+    if type != "u8" and type not in layouts:
+        raise SchemaError("unknown layout '%s'" % type)
+    return Item(name, type, count)
+
+
+def check_layout(layout):
+    used = [0] * layout.size
+    for f in layout.fields:
+        if f.byte >= layout.size:
+            raise SchemaError("%s.%s: byte %d outside %d byte layout"
+                              % (layout.name, f.name, f.byte, layout.size))
+        if f.width < 1 or f.bit + f.width > 8:
+            raise SchemaError("%s.%s: bits %d-%d do not fit in a byte"
+                              % (layout.name, f.name, f.bit, f.bit + f.width - 1))
+        bits = f.mask << f.bit
+        if used[f.byte] & bits:
+            raise SchemaError("%s.%s overlaps another field" % (layout.name, f.name))
+        used[f.byte] |= bits
+
+
+def check_frame(frame):
+    seen = []
+    for item in frame.items:
+        if item.count is not None:
+            if item.count not in seen:
+                raise SchemaError("%s.%s: count field '%s' must be an earlier u8"
+                                  % (frame.name, item.name, item.count))
+            if item is not frame.items[-1]:
+                raise SchemaError("%s.%s: repeated item must come last" % (frame.name, item.name))
+        if item.type == "u8":
+            seen.append(item.name)
+
+
+def item_size(item, layouts):
+    return 1 if item.type == "u8" else layouts[item.type].size
+
+
+def fixed_size(frame, layouts):
+    return sum(item_size(i, layouts) for i in frame.items if i.count is None)
+
+
+# ---------- MODEL ----------
+
+def unpack(layout, data):
+    """Field values of a payload of "layout" in bytes "data", as a dict by field name."""
+    return {f.name: (data[f.byte] >> f.bit) & f.mask for f in layout.fields}
+
+
+def pack(layout, values):
+    """Payload bytes of "layout" holding the fields in dict "values"; other bits are 0."""
+    data = bytearray(layout.size)
+    for f in layout.fields:
+        data[f.byte] |= (values.get(f.name, 0) & f.mask) << f.bit
+    return bytes(data)
+
+
+def used_bits(layout):
+    """Bits of each byte of "layout" that belong to a field."""
+    used = [0] * layout.size
+    for f in layout.fields:
+        used[f.byte] |= f.mask << f.bit
+    return used
+
+
+def vectors(layout):
+    """Test payloads of "layout": all zeros, all ones, each field alone at its maximum, and
+    random bytes from a generator seeded with the layout name, so every run is the same."""
+    out = [bytes(layout.size), bytes([0xFF] * layout.size)]
+    for f in layout.fields:
+        out.append(pack(layout, {f.name: f.mask}))
+    rng = random.Random(layout.name)
+    out += [bytes(rng.randrange(256) for _ in range(layout.size)) for _ in range(8)]
+    return out
+
+
+# ---------- C (AVR) ----------
+
+def gen_c(consts, layouts, frames):
+    out = []
+    w = out.append
+    w("/*************************************************************")
+    w(" *       shs_frames.h - Frame layouts shared by the AVR firmware.")
+    w(" *")
+    w(" *       %s" % NOTICE)
+    w(" *")
+    w(" *       <layout>_<field>(p) reads a field from a payload at p, <layout>_set_<field>(p, v)")
+    w(" *       writes one, and <LAYOUT>_<FIELD>_MASK is the field's bits within its byte.")
+    w(" *************************************************************/")
+    w("")
+    w("#ifndef SHS_FRAMES_H")
+    w("#define SHS_FRAMES_H")
+    w("")
+    w("#include <stdint.h>")
+    w("")
+    w("// ---------- PAYLOAD LAYOUTS ----------")
+    for layout in layouts.values():
+        L = layout.name.upper()
+        w("")
+        w("#define %-32s %d" % (L + "_SIZE", layout.size))
+        for f in layout.fields:
+            w("#define %-32s 0x%02X" % ("%s_%s_MASK" % (L, f.name.upper()), f.mask << f.bit))
+        w("")
+        for f in layout.fields:
+            get = "(p[%d] >> %d) & 0x%02X" % (f.byte, f.bit, f.mask) if f.bit else \
+                  "p[%d] & 0x%02X" % (f.byte, f.mask)
+            if f.width == 8:
+                get = "p[%d]" % f.byte
+            w("static inline uint8_t %s_%s(const uint8_t * p) { return %s; }"
+              % (layout.name, f.name, get))
+        for f in layout.fields:
+            m = f.mask << f.bit
+            if f.width == 8:
+                body = "p[%d] = v;" % f.byte
+            else:
+                body = "p[%d] = (uint8_t) ((p[%d] & 0x%02X) | ((v << %d) & 0x%02X));" \
+                       % (f.byte, f.byte, ~m & 0xFF, f.bit, m)
+            w("static inline void %s_set_%s(uint8_t * p, uint8_t v) { %s }"
+              % (layout.name, f.name, body))
+    w("")
+    w("// ---------- FRAMES ----------")
+    w("")
+    for name, value in consts.items():
+        w("#define %-32s 0x%02X" % (name, value))
+    for frame in frames:
+        F = frame.name.upper()
+        w("")
+        if frame.header:
+            w("#define %-32s 0x%02X" % (F, frame.header[-1]))
+        w("#define %-32s %d" % (F + "_LEN", fixed_size(frame, layouts)))
+        offset = 0
+        for item in frame.items:
+            w("#define %-32s %d" % ("%s_%s" % (F, item.name.upper()), offset))
+            offset += item_size(item, layouts)
+    w("")
+    w("#endif")
+    return "\n".join(out) + "\n"
+
+
+# ---------- C++ (GATEWAY) ----------
+
+def camel(name):
+    return "".join(part.capitalize() for part in name.split("_"))
+
+
+def gen_cpp(consts, layouts, frames):
+    out = []
+    w = out.append
+    w("// frames.hpp - Frame layouts for the host gateway.")
+    w("//")
+    w("// %s" % NOTICE)
+    w("//")
+    w("// Each layout has a table of Field descriptors and a struct with one byte per field.")
+    w("// unpack() and pack() are a fixed sequence of shifts and masks with no branches.")
+    w("// bits:: and layout describe the same fields as types for the compile-time codecs in")
+    w("// shs/codec.hpp.")
+    w("")
+    w("#pragma once")
+    w("")
+    w("#include <array>")
+    w("#include <cstddef>")
+    w("#include <cstdint>")
+    w("")
+    w("#include \"shs/codec.hpp\"")
+    w("")
+    w("namespace shs::proto {")
+    w("")
+    w("struct Field {")
+    w("    const char* name;")
+    w("    std::uint8_t byte;")
+    w("    std::uint8_t shift;")
+    w("    std::uint8_t mask;")
+    w("};")
+    w("")
+    w("constexpr std::uint8_t get(const std::uint8_t* p, const Field& f)")
+    w("{")
+    w("    return static_cast<std::uint8_t>((p[f.byte] >> f.shift) & f.mask);")
+    w("}")
+    w("")
+    w("constexpr void set(std::uint8_t* p, const Field& f, std::uint8_t v)")
+    w("{")
+    w("    p[f.byte] = static_cast<std::uint8_t>((p[f.byte] & ~(f.mask << f.shift)) |")
+    w("                                          ((v & f.mask) << f.shift));")
+    w("}")
+    for layout in layouts.values():
+        T = camel(layout.name)
+        w("")
+        w("// ---------- %s ----------" % layout.name)
+        w("")
+        w("struct %s {" % T)
+        w("    static constexpr std::size_t size = %d;" % layout.size)
+        w("    static constexpr std::array<Field, %d> fields{{" % len(layout.fields))
+        for f in layout.fields:
+            w("        {\"%s\", %d, %d, 0x%02X}," % (f.name, f.byte, f.bit, f.mask))
+        w("    }};")
+        w("")
+        w("    struct bits {")
+        for f in layout.fields:
+            w("        using %s = shs::BitField<%d, %d, %d>;" % (f.name, f.byte, f.bit, f.width))
+        w("    };")
+        w("    using layout = shs::Layout<%d, %s>;"
+          % (layout.size, ", ".join("bits::" + f.name for f in layout.fields)))
+        w("")
+        for f in layout.fields:
+            w("    std::uint8_t %s = 0;" % f.name)
+        w("")
+        w("    static constexpr %s unpack(const std::uint8_t* p)" % T)
+        w("    {")
+        w("        %s v;" % T)
+        for f in layout.fields:
+            w("        v.%s = static_cast<std::uint8_t>((p[%d] >> %d) & 0x%02X);"
+              % (f.name, f.byte, f.bit, f.mask))
+        w("        return v;")
+        w("    }")
+        w("")
+        w("    constexpr void pack(std::uint8_t* p) const")
+        w("    {")
+        for b in range(layout.size):
+            terms = ["((%s & 0x%02X) << %d)" % (f.name, f.mask, f.bit)
+                     for f in layout.fields if f.byte == b]
+            expr = " | ".join(terms) if terms else "0"
+            w("        p[%d] = static_cast<std::uint8_t>(%s);" % (b, expr))
+        w("    }")
+        w("};")
+    w("")
+    w("// ---------- FRAMES ----------")
+    w("")
+    for name, value in consts.items():
+        w("inline constexpr std::uint8_t %s = 0x%02X;" % (name.lower(), value))
+    for frame in frames:
+        w("")
+        w("struct %sFrame {" % camel(frame.name))
+        w("    static constexpr std::array<std::uint8_t, %d> header{{%s}};"
+          % (len(frame.header), ", ".join("0x%02X" % b for b in frame.header)))
+        w("    static constexpr std::size_t fixed = %d;    // Payload bytes before any repeats"
+          % fixed_size(frame, layouts))
+        offset = 0
+        for item in frame.items:
+            w("    static constexpr std::size_t %s = %d;" % (item.name, offset))
+            offset += item_size(item, layouts)
+        rep = [i for i in frame.items if i.count]
+        if rep:
+            w("    static constexpr std::size_t repeat = %d;  // Bytes per %s, times %s"
+              % (item_size(rep[0], layouts), rep[0].name, rep[0].count))
+        w("};")
+    w("")
+    w("}  // namespace shs::proto")
+    return "\n".join(out) + "\n"
+
+
+# ---------- TESTS ----------
+
+# For every vector of a layout the tests check, against the model:
+#   bytes   - the getters read the model's field values from the payload
+#   packed  - the setters, from zero, write the payload with the unused bits clear
+#   over    - the setters, over the payload, write the next vector's values and leave the
+#             unused bits as they were
+
+def test_data(layout):
+    vecs = vectors(layout)
+    used = used_bits(layout)
+    values = [unpack(layout, v) for v in vecs]
+    packed = [pack(layout, v) for v in values]
+    over = [bytes((b & ~u & 0xFF) | n for b, u, n in zip(v, used, packed[(i + 1) % len(vecs)]))
+            for i, v in enumerate(vecs)]
+    return vecs, values, packed, over
+
+
+def c_rows(rows):
+    return ["    {%s}," % ", ".join("0x%02X" % b for b in row) for row in rows]
+
+
+def gen_c_test(consts, layouts, frames):
+    out = []
+    w = out.append
+    w("/*************************************************************")
+    w(" *       codec_test.c - Round trip of the accessors in protocol/shs_frames.h against the")
+    w(" *       model in tools/gen_codec.py, for every layout and frame in the schema.")
+    w(" *")
+    w(" *       Generated by tools/gen_codec.py --tests. Do not edit.")
+    w(" *************************************************************/")
+    w("")
+    w("#include <stdio.h>")
+    w("#include <string.h>")
+    w("")
+    w("#include \"protocol/shs_frames.h\"")
+    w("")
+    w("static int failures;")
+    w("")
+    w("static void check(const char * what, int vector, unsigned got, unsigned want)")
+    w("{")
+    w("    if (got == want) return;")
+    w("    printf(\"%s, vector %d: got 0x%02X, want 0x%02X\\n\", what, vector, got, want);")
+    w("    failures++;")
+    w("}")
+    for layout in layouts.values():
+        vecs, values, packed, over = test_data(layout)
+        n, size, name = len(vecs), layout.size, layout.name
+        w("")
+        w("static void test_%s(void)" % name)
+        w("{")
+        for array, rows in (("bytes", vecs), ("packed", packed), ("over", over)):
+            w("    static const uint8_t %s[%d][%d] = {" % (array, n, size))
+            out.extend("    " + r for r in c_rows(rows))
+            w("    };")
+        w("    static const uint8_t values[%d][%d] = {" % (n, len(layout.fields)))
+        out.extend("    " + r for r in c_rows([[v[f.name] for f in layout.fields] for v in values]))
+        w("    };")
+        w("")
+        w("    for (int v = 0; v < %d; v++) {" % n)
+        w("        const uint8_t * next = values[(v + 1) %% %d];" % n)
+        w("        uint8_t p[%d];" % size)
+        w("")
+        for i, f in enumerate(layout.fields):
+            w("        check(\"%s_%s\", v, %s_%s(bytes[v]), values[v][%d]);"
+              % (name, f.name, name, f.name, i))
+        w("")
+        w("        memset(p, 0, sizeof p);")
+        for i, f in enumerate(layout.fields):
+            w("        %s_set_%s(p, values[v][%d]);" % (name, f.name, i))
+        w("        for (int b = 0; b < %d; b++) check(\"%s packed\", v, p[b], packed[v][b]);"
+          % (size, name))
+        w("")
+        w("        memcpy(p, bytes[v], sizeof p);")
+        for i, f in enumerate(layout.fields):
+            w("        %s_set_%s(p, next[%d]);" % (name, f.name, i))
+        w("        for (int b = 0; b < %d; b++) check(\"%s over\", v, p[b], over[v][b]);"
+          % (size, name))
+        w("    }")
+        w("}")
+    w("")
+    w("static void test_frames(void)")
+    w("{")
+    for frame in frames:
+        F = frame.name.upper()
+        w("    check(\"%s_LEN\", 0, %s_LEN, %d);" % (F, F, fixed_size(frame, layouts)))
+        offset = 0
+        for item in frame.items:
+            w("    check(\"%s_%s\", 0, %s_%s, %d);" % (F, item.name.upper(), F, item.name.upper(),
+                                                      offset))
+            offset += item_size(item, layouts)
+    w("}")
+    w("")
+    w("int main(void)")
+    w("{")
+    for layout in layouts.values():
+        w("    test_%s();" % layout.name)
+    w("    test_frames();")
+    w("    printf(\"codec_test: %d failures\\n\", failures);")
+    w("    return failures != 0;")
+    w("}")
+    return "\n".join(out) + "\n"
+
+
+def gen_cpp_test(consts, layouts, frames):
+    out = []
+    w = out.append
+    w("// codec_test.cpp - Round trip of the codecs in shs/frames.hpp and shs/codec.hpp against the")
+    w("// model in tools/gen_codec.py, for every layout and frame in the schema: unpack() and pack(),")
+    w("// the Field tables, the BitField accessors and decode_batch() with each instruction set.")
+    w("//")
+    w("// Generated by tools/gen_codec.py --tests. Do not edit.")
+    w("")
+    w("#include <array>")
+    w("#include <cstdint>")
+    w("#include <cstdio>")
+    w("#include <cstring>")
+    w("#include <vector>")
+    w("")
+    w("#include \"shs/codec.hpp\"")
+    w("#include \"shs/frames.hpp\"")
+    w("")
+    w("namespace {")
+    w("")
+    w("int failures;")
+    w("")
+    w("void check(const char* what, std::size_t vector, unsigned got, unsigned want)")
+    w("{")
+    w("    if (got == want) return;")
+    w("    std::printf(\"%s, vector %zu: got 0x%02X, want 0x%02X\\n\", what, vector, got, want);")
+    w("    failures++;")
+    w("}")
+    w("")
+    w("template <typename L, std::size_t... I>")
+    w("std::array<std::uint8_t, L::count> get_all(const std::uint8_t* p, std::index_sequence<I...>)")
+    w("{")
+    w("    return {shs::get<typename L::template field<I>>(p)...};")
+    w("}")
+    w("")
+    w("template <typename L, std::size_t... I>")
+    w("void set_all(std::uint8_t* p, const std::uint8_t* v, std::index_sequence<I...>)")
+    w("{")
+    w("    (shs::set<typename L::template field<I>>(p, v[I]), ...);")
+    w("}")
+    w("")
+    w("// Every check of layout T, given the vectors as gen_codec.py's test_data() lays them out.")
+    w("template <typename T, std::size_t N, std::size_t F>")
+    w("void test_layout(const char* name, const std::uint8_t (&bytes)[N][T::size],")
+    w("                 const std::uint8_t (&values)[N][F], const std::uint8_t (&packed)[N][T::size],")
+    w("                 const std::uint8_t (&over)[N][T::size])")
+    w("{")
+    w("    using L = typename T::layout;")
+    w("    static_assert(T::fields.size() == F && L::count == F && L::size == T::size);")
+    w("    constexpr auto seq = std::make_index_sequence<F>{};")
+    w("")
+    w("    for (std::size_t v = 0; v < N; v++) {")
+    w("        const std::uint8_t* next = values[(v + 1) % N];")
+    w("        std::uint8_t p[T::size];")
+    w("")
+    w("        // Field tables: get() and set()")
+    w("        for (std::size_t f = 0; f < F; f++) check(name, v, shs::proto::get(bytes[v], T::fields[f]), values[v][f]);")
+    w("        std::memcpy(p, bytes[v], T::size);")
+    w("        for (std::size_t f = 0; f < F; f++) shs::proto::set(p, T::fields[f], next[f]);")
+    w("        for (std::size_t b = 0; b < T::size; b++) check(name, v, p[b], over[v][b]);")
+    w("")
+    w("        // BitField accessors")
+    w("        auto got = get_all<L>(bytes[v], seq);")
+    w("        for (std::size_t f = 0; f < F; f++) check(name, v, got[f], values[v][f]);")
+    w("        std::memset(p, 0, T::size);")
+    w("        set_all<L>(p, values[v], seq);")
+    w("        for (std::size_t b = 0; b < T::size; b++) check(name, v, p[b], packed[v][b]);")
+    w("        std::memcpy(p, bytes[v], T::size);")
+    w("        set_all<L>(p, next, seq);")
+    w("        for (std::size_t b = 0; b < T::size; b++) check(name, v, p[b], over[v][b]);")
+    w("    }")
+    w("")
+    w("    // decode_batch(), over enough frames for the 16 and 32 lane paths and a tail")
+    w("    const std::size_t count = 3 * 32 + 5;")
+    w("    std::vector<std::uint8_t> frames(count * T::size);")
+    w("    for (std::size_t n = 0; n < count; n++) std::memcpy(&frames[n * T::size], bytes[n % N], T::size);")
+    w("    for (shs::Isa isa : {shs::Isa::scalar, shs::Isa::ssse3, shs::Isa::avx2}) {")
+    w("        if (isa > shs::best_isa()) continue;")
+    w("        std::vector<std::uint8_t> store(F * count);")
+    w("        shs::Columns<L> cols;")
+    w("        for (std::size_t f = 0; f < F; f++) cols[f] = &store[f * count];")
+    w("        shs::decode_batch<L>(frames.data(), count, cols, isa);")
+    w("        for (std::size_t n = 0; n < count; n++) {")
+    w("            for (std::size_t f = 0; f < F; f++) check(name, n, cols[f][n], values[n % N][f]);")
+    w("        }")
+    w("    }")
+    w("}")
+    for layout in layouts.values():
+        vecs, values, packed, over = test_data(layout)
+        T = camel(layout.name)
+        n, size = len(vecs), layout.size
+        w("")
+        w("void test_%s()" % layout.name)
+        w("{")
+        for array, rows in (("bytes", vecs), ("packed", packed), ("over", over)):
+            w("    static const std::uint8_t %s[%d][%d] = {" % (array, n, size))
+            out.extend("    " + r for r in c_rows(rows))
+            w("    };")
+        w("    static const std::uint8_t values[%d][%d] = {" % (n, len(layout.fields)))
+        out.extend("    " + r for r in c_rows([[v[f.name] for f in layout.fields] for v in values]))
+        w("    };")
+        w("    using T = shs::proto::%s;" % T)
+        w("    test_layout<T>(\"%s\", bytes, values, packed, over);" % layout.name)
+        w("")
+        w("    // unpack() and pack()")
+        w("    for (std::size_t v = 0; v < %d; v++) {" % n)
+        w("        T t = T::unpack(bytes[v]);")
+        for i, f in enumerate(layout.fields):
+            w("        check(\"%s.%s\", v, t.%s, values[v][%d]);" % (T, f.name, f.name, i))
+        w("        std::uint8_t p[T::size];")
+        w("        t.pack(p);")
+        w("        for (std::size_t b = 0; b < T::size; b++) check(\"%s::pack\", v, p[b], packed[v][b]);"
+          % T)
+        w("    }")
+        w("}")
+    w("")
+    w("// Frame offsets are compile-time constants: a mismatch fails the build.")
+    for frame in frames:
+        S = "shs::proto::%sFrame" % camel(frame.name)
+        w("static_assert(%s::fixed == %d);" % (S, fixed_size(frame, layouts)))
+        offset = 0
+        for item in frame.items:
+            w("static_assert(%s::%s == %d);" % (S, item.name, offset))
+            offset += item_size(item, layouts)
+    w("")
+    w("}  // namespace")
+    w("")
+    w("int main()")
+    w("{")
+    for layout in layouts.values():
+        w("    test_%s();" % layout.name)
+    w("    std::printf(\"codec_test: %d failures\\n\", failures);")
+    w("    return failures != 0;")
+    w("}")
+    return "\n".join(out) + "\n"
+
+
+# ---------- SQUIRREL (IMP) ----------
+
+def gen_nut(consts, layouts, frames):
+    out = []
+    w = out.append
+    w("%s - %s" % (NUT_BEGIN, NOTICE))
+    w("")
+    for name, value in consts.items():
+        w("const %s = 0x%02X;" % (name, value))
+    for frame in frames:
+        if frame.header:
+            w("const %s = 0x%02X;" % (frame.name.upper(), frame.header[-1]))
+    w("")
+    w("// Frame payloads: <FRAME>_LEN bytes before any repeated item, <FRAME>_<ITEM> offsets")
+    for frame in frames:
+        F = frame.name.upper()
+        w("const %s_LEN = %d;" % (F, fixed_size(frame, layouts)))
+        offset = 0
+        for item in frame.items:
+            w("const %s_%s = %d;" % (F, item.name.upper(), offset))
+            offset += item_size(item, layouts)
+    w("")
+    w("// Field tables: name -> [byte, shift, mask]")
+    for layout in layouts.values():
+        L = layout.name.upper()
+        w("const %s_SIZE = %d;" % (L, layout.size))
+        w("%s_FIELDS <- {" % L)
+        for f in layout.fields:
+            w("    %s = [%d, %d, 0x%02X]," % (f.name, f.byte, f.bit, f.mask))
+        w("};")
+    w("")
+    w("// layoutUnpack() reads every field of a layout from blob b at offset into a table.")
+    w("function layoutUnpack(fields, b, offset)")
+    w("{")
+    w("    local t = {};")
+    w("    foreach (name, f in fields) t[name] <- (b[offset + f[0]] >> f[1]) & f[2];")
+    w("    return t;")
+    w("}")
+    w("")
+    w("// layoutPack() writes the fields present in table t into a new blob of the layout's size.")
+    w("function layoutPack(fields, size, t)")
+    w("{")
+    w("    local b = blob(size);")
+    w("    for (local i = 0; i < size; i++) b[i] = 0;")
+    w("    foreach (name, f in fields) {")
+    w("        if (name in t) b[f[0]] = b[f[0]] | ((t[name] & f[2]) << f[1]);")
+    w("    }")
+    w("    return b;")
+    w("}")
+    w("")
+    w("// frameBlob() builds a frame from its header bytes and an array of payload bytes or blobs.")
+    w("function frameBlob(header, payload)")
+    w("{")
+    w("    local b = blob();")
+    w("    foreach (h in header) b.writen(h, 'b');")
+    w("    foreach (p in payload) {")
+    w("        if (typeof p == \"blob\") b.writeblob(p);")
+    w("        else b.writen(p, 'b');")
+    w("    }")
+    w("    return b;")
+    w("}")
+    w("")
+    w(NUT_END)
+    return "\n".join(out)
+
+
+def splice_nut(text, block, path):
+    start = text.find(NUT_BEGIN)
+    end = text.find(NUT_END)
+    if start < 0 or end < 0:
+        raise SchemaError("%s has no %s / %s markers" % (path, NUT_BEGIN, NUT_END))
+    return text[:start] + block + text[end + len(NUT_END):]
+
+
+# ---------- MAIN ----------
+
+def main(argv):
+    check = "--check" in argv[1:]
+    tests = argv[argv.index("--tests") + 1] if "--tests" in argv[1:-1] else None
+    try:
+        consts, layouts, frames = parse(SCHEMA)
+        if tests is not None:
+            return write_tests(tests, consts, layouts, frames)
+        outputs = {
+            C_OUT: gen_c(consts, layouts, frames),
+            CPP_OUT: gen_cpp(consts, layouts, frames),
+        }
+        block = gen_nut(consts, layouts, frames)
+        for path in NUT_OUTS:
+            with open(path) as f:
+                outputs[path] = splice_nut(f.read(), block, path)
+    except SchemaError as e:
+        sys.stderr.write("gen_codec: %s\n" % e)
+        return 2
+
+    stale = []
+    for path, text in outputs.items():
+        current = None
+        if os.path.exists(path):
+            with open(path) as f:
+                current = f.read()
+        if current == text:
+            continue
+        stale.append(os.path.relpath(path, ROOT))
+        if not check:
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            with open(path, "w") as f:
+                f.write(text)
+
+    if check and stale:
+        sys.stderr.write("gen_codec: out of date: %s\n" % ", ".join(stale))
+        return 1
+    for path in ([] if check else stale):
+        print("gen_codec: wrote %s" % path)
+    return 0
+
+
+def write_tests(path, consts, layouts, frames):
+    """Write the C and C++ codec tests into directory "path", leaving unchanged files alone."""
+    os.makedirs(path, exist_ok=True)
+    for name, text in (("codec_test.c", gen_c_test(consts, layouts, frames)),
+                       ("codec_test.cpp", gen_cpp_test(consts, layouts, frames))):
+        out = os.path.join(path, name)
+        if os.path.exists(out):
+            with open(out) as f:
+                if f.read() == text:
+                    continue
+        with open(out, "w") as f:
+            f.write(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+mem_report.py - Flash and SRAM use of a firmware build, from its ELF.
+
+    tools/mem_report.py atmega_sys_control.elf [--mcu atmega328p] [--top 10] [--map file.map]
+
+Prints how much of the part's flash and SRAM the image takes, what is left for the stack, and
+the largest SRAM symbols: the ones worth moving to program memory or shrinking. With the
+linker's map file (-Wl,-Map) it also breaks .text, .data and .bss down by module, the object
+file or library member each input section came from. Uses avr-size and avr-nm; --prefix
+selects another toolchain (--prefix "" for host tools).
+
+The firmware reports at run time how much of what is left the stack has actually used
+(stack_free in the controller's telemetry).
+"""
+
+import os
+import subprocess
+import sys
+
+# Flash and SRAM bytes of the parts the controllers are built for
+PARTS = {
+    "atmega328p": (32768, 2048),
+    "atmega328": (32768, 2048),
+    "atmega168": (16384, 1024),
+}
+
+SRAM_SECTIONS = (".data", ".bss", ".noinit")
+FLASH_SECTIONS = (".text", ".data")
+
+
+class ReportError(Exception):
+    pass
+
+
+def run(tool, args):
+    try:
+        return subprocess.run([tool] + args, check=True, capture_output=True, text=True).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        raise ReportError("%s: %s" % (tool, e))
+
+
+def sections(prefix, elf):
+    """Section name -> size, from size -A."""
+    out = {}
+    for line in run(prefix + "size", ["-A", elf]).splitlines():
+        words = line.split()
+        if len(words) >= 2 and words[0].startswith(".") and words[1].isdigit():
+            out[words[0]] = int(words[1])
+    return out
+
+
+def symbols(prefix, elf):
+    """(size, type, name) of every sized symbol, largest first."""
+    out = []
+    for line in run(prefix + "nm", ["-S", "--size-sort", "-r", elf]).splitlines():
+        words = line.split()
+        if len(words) == 4:
+            out.append((int(words[1], 16), words[2], words[3]))
+    return out
+
+
+def map_modules(path):
+    """Module -> {".text", ".data", ".bss"} byte counts, from the input sections in a map file."""
+    with open(path) as f:
+        lines = f.read().splitlines()
+    try:
+        lines = lines[lines.index("Linker script and memory map"):]
+    except ValueError:
+        raise ReportError("%s is not a linker map file" % path)
+
+    modules = {}
+    pending = None  # Input section whose name was too long to share a line with its size
+    for line in lines:
+        words = line.split()
+        if pending and len(words) == 3 and words[0].startswith("0x"):
+            words = [pending] + words
+        pending = None
+        if len(words) == 1 and line.startswith(" .") and not line.startswith(" .", 1):
+            pending = words[0]
+            continue
+        if len(words) != 4 or not line.startswith(" .") or not words[2].startswith("0x"):
+            continue
+        name, size, module = words[0], int(words[2], 16), os.path.basename(words[3])
+        kind = section_kind(name)
+        if kind and size:
+            counts = modules.setdefault(module, {".text": 0, ".data": 0, ".bss": 0})
+            counts[kind] += size
+    return modules
+
+
+def section_kind(name):
+    """Which output section an input section lands in on the AVR, or None."""
+    if name.startswith((".text", ".progmem", ".init", ".fini", ".vectors", ".trampolines")):
+        return ".text"
+    if name.startswith((".data", ".rodata")):
+        return ".data"     # No separate .rodata on the AVR: constants are copied to SRAM
+    if name.startswith((".bss", ".noinit", "COMMON")):
+        return ".bss"
+    return None
+
+
+def pct(used, total):
+    return 100.0 * used / total if total else 0.0
+
+
+def report(elf, mcu, top, prefix, map_path=None):
+    if mcu not in PARTS:
+        raise ReportError("unknown part %s (known: %s)" % (mcu, ", ".join(sorted(PARTS))))
+    flash_size, sram_size = PARTS[mcu]
+    sec = sections(prefix, elf)
+    flash = sum(sec.get(s, 0) for s in FLASH_SECTIONS)
+    sram = sum(sec.get(s, 0) for s in SRAM_SECTIONS)
+
+    lines = ["%s (%s)" % (os.path.basename(elf), mcu)]
+    lines.append("  flash %6d / %6d  %5.1f%%   .text %d + .data %d"
+                 % (flash, flash_size, pct(flash, flash_size),
+                    sec.get(".text", 0), sec.get(".data", 0)))
+    lines.append("  sram  %6d / %6d  %5.1f%%   .data %d + .bss %d + .noinit %d, %d left for the stack"
+                 % (sram, sram_size, pct(sram, sram_size), sec.get(".data", 0),
+                    sec.get(".bss", 0), sec.get(".noinit", 0), sram_size - sram))
+
+    # .data and .bss symbols are d/D and b/B; everything else stays in flash.
+    ram = [s for s in symbols(prefix, elf) if s[1] in "dDbB"]
+    if ram and top:
+        lines.append("  largest in sram:")
+        for size, kind, name in ram[:top]:
+            lines.append("    %5d  %s  %s" % (size, ".data" if kind in "dD" else ".bss ", name))
+
+    if map_path:
+        modules = map_modules(map_path)
+        lines.append("  by module, most sram first:")
+        lines.append("      .text   .data    .bss")
+        order = sorted(modules.items(), key=lambda m: (-(m[1][".data"] + m[1][".bss"]),
+                                                        -m[1][".text"], m[0]))
+        for module, c in order:
+            lines.append("    %7d %7d %7d  %s" % (c[".text"], c[".data"], c[".bss"], module))
+    return "\n".join(lines)
+
+
+def main(argv):
+    args = argv[1:]
+    mcu, top, prefix, map_path, elfs = "atmega328p", 10, "avr-", None, []
+    try:
+        while args:
+            a = args.pop(0)
+            if a == "--mcu":
+                mcu = args.pop(0)
+            elif a == "--top":
+                top = int(args.pop(0))
+            elif a == "--prefix":
+                prefix = args.pop(0)
+            elif a == "--map":
+                map_path = args.pop(0)
+            else:
+                elfs.append(a)
+        if not elfs:
+            raise ReportError("usage: mem_report.py <elf>... [--mcu part] [--top n] [--map file]"
+                              " [--prefix avr-]")
+        if map_path and len(elfs) > 1:
+            raise ReportError("--map goes with a single ELF")
+        print("\n".join(report(elf, mcu, top, prefix, map_path) for elf in elfs))
+    except (ReportError, IndexError, ValueError) as e:
+        sys.stderr.write("mem_report: %s\n" % (e or "missing option value"))
+        return 2
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
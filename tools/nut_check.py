@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+nut_check.py - Find constants a Squirrel source uses but never defines.
+
+    tools/nut_check.py imp_node.nut server.nut
+
+Squirrel resolves names only when a line runs, and there is no interpreter in the build, so a
+constant that was never defined (or never generated into the file) goes unnoticed until the
+device runs that line. This reads each file on its own, as the Imp and the agent each load
+one, and reports every upper-case name that is used but not defined there by const, enum,
+class, function, local or a "<-" slot. Names the Imp and agent APIs define are known.
+
+Exits 1 if any file uses an undefined constant.
+"""
+
+import re
+import sys
+
+# Constants of the Imp and agent APIs used by the sources
+API = {"UART_57", "PARITY_NONE", "NO_CTSRTS"}
+
+TOKEN = re.compile(r"""
+      (?P<comment>//[^\n]*|/\*.*?\*/)
+    | (?P<string>@"(?:[^"]|"")*"|"(?:\\.|[^"\\\n])*"|'(?:\\.|[^'\\\n])*')
+    | (?P<name>[A-Za-z_][A-Za-z0-9_]*)
+    | (?P<other>.)
+    """, re.S | re.X)
+
+CONSTANT = re.compile(r"^[A-Z][A-Z0-9_]+$")
+DEFINERS = {"const", "enum", "class", "function", "local"}
+
+
+def tokens(text):
+    """(kind, text, line) for every token that is not a comment or white space."""
+    line = 1
+    for m in TOKEN.finditer(text):
+        kind = m.lastgroup
+        if kind != "comment" and not (kind == "other" and m.group().isspace()):
+            yield kind, m.group(), line
+        line += m.group().count("\n")
+
+
+def undefined(text):
+    """(name, line) of each first use of a constant with no definition in text."""
+    toks = list(tokens(text))
+    defined, used = set(API), {}
+    for i, (kind, tok, line) in enumerate(toks):
+        if kind != "name":
+            continue
+        before = toks[i - 1][1] if i else ""
+        after = toks[i + 1][1] if i + 1 < len(toks) else ""
+        after2 = toks[i + 2][1] if i + 2 < len(toks) else ""
+        if before in DEFINERS or (after == "<" and after2 == "-"):
+            defined.add(tok)
+        elif before == "." or (after == "=" and after2 != "="):
+            continue    # A member, or a table key or assignment target
+        elif CONSTANT.match(tok):
+            used.setdefault(tok, line)
+    return sorted(((name, line) for name, line in used.items() if name not in defined),
+                  key=lambda u: u[1])
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write("usage: nut_check.py <file.nut>...\n")
+        return 2
+    bad = 0
+    for path in argv[1:]:
+        try:
+            with open(path) as f:
+                text = f.read()
+        except OSError as e:
+            sys.stderr.write("nut_check: %s\n" % e)
+            return 2
+        for name, line in undefined(text):
+            print("%s:%d: %s is not defined" % (path, line, name))
+            bad += 1
+    return 1 if bad else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
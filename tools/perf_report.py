@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+"""
+perf_report.py - Per-function code size and cycle counts of the system controller, for
+comparing commits.
+
+    tools/perf_report.py [--build dir] [--no-build] [--calls n] [-o report.json]
+    tools/perf_report.py diff old.json new.json
+
+The first form configures and builds the tree with CMake (default build directory "build"),
+then writes a JSON report of:
+
+    sections   - section sizes of the firmware image
+    symbols    - size of every function and variable in it
+    functions  - for each hot function, from sim/func_cycles.c run in the simulator: the
+                 simulated cycles per call spent in the firmware's delays and waits (exact),
+                 and host nanoseconds per call (timing, so only roughly repeatable)
+
+Sizes come from the AVR image when avr-gcc is configured, otherwise from the host build of
+the same source, which follows the same changes but not the same numbers. Reports are
+written one entry per line with sorted keys, so plain diff works on them too.
+
+The second form lists what changed between two reports and exits 1 if any section or
+symbol grew or any function takes more cycles. Host times are listed but never fail it.
+"""
+
+import json
+import os
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from mem_report import ReportError, run, sections, symbols  # noqa: E402
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+FIRMWARE = "atmega_sys_control"
+SIZE_KINDS = {"t": "text", "d": "data", "b": "bss", "r": "rodata"}
+HOST_NOTE = 0.2    # Host time changes smaller than this fraction are not listed
+
+
+def cache_value(build, key):
+    """Value of "key" in the build's CMakeCache.txt, or None."""
+    try:
+        with open(os.path.join(build, "CMakeCache.txt")) as f:
+            for line in f:
+                name, _, value = line.rstrip("\n").partition("=")
+                if name.split(":")[0] == key:
+                    return value
+    except OSError:
+        pass
+    return None
+
+
+def build_tree(build):
+    run("cmake", ["-S", ROOT, "-B", build])
+    targets = ["shs_func_cycles"]
+    if avr_prefix(build):
+        targets.append(FIRMWARE)
+    run("cmake", ["--build", build, "--target"] + targets)
+
+
+def avr_prefix(build):
+    """Prefix of the AVR tools if the build has them, else None."""
+    gcc = cache_value(build, "AVR_GCC")
+    if not gcc or gcc.endswith("NOTFOUND"):
+        return None
+    return gcc[:-len("gcc")]
+
+
+def image(build):
+    """(kind, path, tool prefix) of the firmware image to measure."""
+    prefix = avr_prefix(build)
+    if prefix:
+        return "avr", os.path.join(build, FIRMWARE + ".elf"), prefix
+    try:
+        with open(os.path.join(build, "sim_objects.txt")) as f:
+            objects = dict(line.split(None, 1) for line in f if line.strip())
+    except OSError:
+        raise ReportError("%s has no sim_objects.txt; is it a configured build?" % build)
+    return "host", objects[FIRMWARE].strip(), ""
+
+
+def func_cycles(build, calls):
+    """Function -> {calls, cycles, host_ns}, from shs_func_cycles."""
+    out = {}
+    for line in run(os.path.join(build, "sim", "shs_func_cycles"), [str(calls)]).splitlines():
+        words = line.split()
+        if len(words) == 4 and not line.startswith("#"):
+            out[words[0]] = {"calls": int(words[1]), "cycles": int(words[2]),
+                             "host_ns": int(words[3])}
+    if not out:
+        raise ReportError("shs_func_cycles printed no results")
+    return out
+
+
+def commit():
+    try:
+        return subprocess.run(["git", "-C", ROOT, "describe", "--always", "--dirty"],
+                              check=True, capture_output=True, text=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def collect(build, calls):
+    kind, path, prefix = image(build)
+    syms = {}
+    for size, t, name in symbols(prefix, path):
+        if t.lower() in SIZE_KINDS:
+            syms[name] = {"kind": SIZE_KINDS[t.lower()], "size": size}
+    return {
+        "firmware": FIRMWARE,
+        "image": kind,
+        "commit": commit(),
+        "sections": {s: n for s, n in sections(prefix, path).items()
+                     if s.startswith((".text", ".data", ".bss", ".rodata"))},
+        "symbols": syms,
+        "functions": func_cycles(build, calls),
+    }
+
+
+def dump(report):
+    """JSON with one line per section, symbol and function."""
+    lines = ["{"]
+    keys = sorted(report)
+    for i, key in enumerate(keys):
+        comma = "," if i < len(keys) - 1 else ""
+        value = report[key]
+        if not isinstance(value, dict):
+            lines.append(" %s: %s%s" % (json.dumps(key), json.dumps(value), comma))
+            continue
+        lines.append(" %s: {" % json.dumps(key))
+        names = sorted(value)
+        for j, name in enumerate(names):
+            lines.append("  %s: %s%s" % (json.dumps(name), json.dumps(value[name], sort_keys=True),
+                                         "," if j < len(names) - 1 else ""))
+        lines.append(" }%s" % comma)
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def load(path):
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (OSError, ValueError) as e:
+        raise ReportError("%s: %s" % (path, e))
+
+
+def change(old, new):
+    pct = " (%+.0f%%)" % (100.0 * (new - old) / old) if old else ""
+    return "%d -> %d%s" % (old, new, pct)
+
+
+def diff(old, new):
+    """(lines, regressed) comparing two reports."""
+    if old.get("image") != new.get("image"):
+        raise ReportError("reports measure different images (%s, %s)"
+                          % (old.get("image"), new.get("image")))
+    lines = ["%s %s -> %s (%s image)" % (new["firmware"], old["commit"], new["commit"],
+                                         new["image"])]
+    regressed = False
+
+    for name in sorted(set(old["sections"]) | set(new["sections"])):
+        a, b = old["sections"].get(name, 0), new["sections"].get(name, 0)
+        if a != b:
+            lines.append("  section  %-24s %s" % (name, change(a, b)))
+            regressed |= b > a
+
+    for name in sorted(set(old["symbols"]) | set(new["symbols"])):
+        a, b = old["symbols"].get(name), new["symbols"].get(name)
+        if a is None:
+            lines.append("  symbol   %-24s new, %d (%s)" % (name, b["size"], b["kind"]))
+            regressed = True
+        elif b is None:
+            lines.append("  symbol   %-24s removed, was %d" % (name, a["size"]))
+        elif a["size"] != b["size"]:
+            lines.append("  symbol   %-24s %s" % (name, change(a["size"], b["size"])))
+            regressed |= b["size"] > a["size"]
+
+    for name in sorted(set(old["functions"]) | set(new["functions"])):
+        a, b = old["functions"].get(name), new["functions"].get(name)
+        if a is None or b is None:
+            lines.append("  cycles   %-24s %s" % (name, "new" if a is None else "removed"))
+            continue
+        if a["cycles"] != b["cycles"]:
+            lines.append("  cycles   %-24s %s" % (name, change(a["cycles"], b["cycles"])))
+            regressed |= b["cycles"] > a["cycles"]
+        if a["host_ns"] and abs(b["host_ns"] - a["host_ns"]) > HOST_NOTE * a["host_ns"]:
+            lines.append("  host ns  %-24s %s" % (name, change(a["host_ns"], b["host_ns"])))
+
+    if len(lines) == 1:
+        lines.append("  no change")
+    return lines, regressed
+
+
+def main(argv):
+    args = argv[1:]
+    try:
+        if args[:1] == ["diff"]:
+            if len(args) != 3:
+                raise ReportError("usage: perf_report.py diff <old.json> <new.json>")
+            lines, regressed = diff(load(args[1]), load(args[2]))
+            print("\n".join(lines))
+            return 1 if regressed else 0
+
+        build, calls, out, do_build = "build", 200, None, True
+        while args:
+            a = args.pop(0)
+            if a == "--build":
+                build = args.pop(0)
+            elif a == "--calls":
+                calls = int(args.pop(0))
+            elif a == "-o":
+                out = args.pop(0)
+            elif a == "--no-build":
+                do_build = False
+            else:
+                raise ReportError("usage: perf_report.py [--build dir] [--no-build] [--calls n]"
+                                  " [-o report.json] | diff <old.json> <new.json>")
+        build = os.path.abspath(build)
+        if do_build:
+            build_tree(build)
+        text = dump(collect(build, calls))
+        if out:
+            with open(out, "w") as f:
+                f.write(text)
+        else:
+            sys.stdout.write(text)
+    except (ReportError, IndexError, ValueError, KeyError) as e:
+        sys.stderr.write("perf_report: %s\n" % (e or "missing option value"))
+        return 2
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))